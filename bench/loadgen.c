@@ -0,0 +1,536 @@
+#define _POSIX_C_SOURCE 200809L
+#include "distr.h"
+#include "integral_app.h"
+#include "internal.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define LG_EVENTS 256
+
+typedef enum {
+    DELAY_FIXED = 0,
+    DELAY_UNIFORM = 1,
+    DELAY_EXP = 2,
+    DELAY_LOGNORMAL = 3
+} delay_kind_t;
+
+typedef struct {
+    delay_kind_t kind;
+    double a;
+    double b;
+} delay_dist_t;
+
+typedef struct {
+    int fd;
+    int alive;
+    int got_task;
+    uint64_t result_sent_ns;
+    uint8_t *reply;
+    uint32_t reply_len;
+    uint8_t reply_type;
+} sim_worker_t;
+
+typedef struct {
+    uint64_t due_ns;
+    int worker;
+} lg_timer_t;
+
+typedef struct {
+    lg_timer_t *items;
+    int len;
+    int cap;
+} timer_heap_t;
+
+typedef struct {
+    double *v;
+    size_t len;
+    size_t cap;
+} sample_vec_t;
+
+typedef struct {
+    const char *host;
+    const char *port;
+    int workers;
+    int cores;
+    int timeout_sec;
+    delay_dist_t delay;
+    double disconnect_rate;
+    double error_rate;
+    uint64_t seed;
+} lg_cfg_t;
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ULL;
+
+static double rng_u01(void) {
+    g_rng ^= g_rng >> 12;
+    g_rng ^= g_rng << 25;
+    g_rng ^= g_rng >> 27;
+    return ((double)((g_rng * 0x2545F4914F6CDD1DULL) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double delay_sample_ms(const delay_dist_t *d) {
+    switch (d->kind) {
+    case DELAY_UNIFORM:
+        return d->a + (d->b - d->a) * rng_u01();
+    case DELAY_EXP:
+        return -d->a * log(rng_u01());
+    case DELAY_LOGNORMAL: {
+        double z = sqrt(-2.0 * log(rng_u01())) * cos(2.0 * 3.14159265358979323846 * rng_u01());
+        return exp(d->a + d->b * z);
+    }
+    case DELAY_FIXED:
+    default:
+        return d->a;
+    }
+}
+
+static int parse_delay(const char *s, delay_dist_t *d) {
+    char *end = NULL;
+    const char *arg;
+    if (strncmp(s, "fixed:", 6) == 0) {
+        d->kind = DELAY_FIXED;
+        arg = s + 6;
+    } else if (strncmp(s, "uniform:", 8) == 0) {
+        d->kind = DELAY_UNIFORM;
+        arg = s + 8;
+    } else if (strncmp(s, "exp:", 4) == 0) {
+        d->kind = DELAY_EXP;
+        arg = s + 4;
+    } else if (strncmp(s, "lognormal:", 10) == 0) {
+        d->kind = DELAY_LOGNORMAL;
+        arg = s + 10;
+    } else {
+        return -1;
+    }
+    d->a = strtod(arg, &end);
+    if (end == arg) {
+        return -1;
+    }
+    d->b = 0.0;
+    if (d->kind == DELAY_UNIFORM || d->kind == DELAY_LOGNORMAL) {
+        if (*end != ':') {
+            return -1;
+        }
+        arg = end + 1;
+        d->b = strtod(arg, &end);
+        if (end == arg) {
+            return -1;
+        }
+    }
+    return (*end == '\0' && d->a >= 0.0) ? 0 : -1;
+}
+
+static int heap_push(timer_heap_t *h, uint64_t due_ns, int worker) {
+    int i;
+    if (h->len == h->cap) {
+        int cap = (h->cap == 0) ? 1024 : h->cap * 2;
+        lg_timer_t *grown = (lg_timer_t *)realloc(h->items, (size_t)cap * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        h->items = grown;
+        h->cap = cap;
+    }
+    i = h->len++;
+    while (i > 0 && h->items[(i - 1) / 2].due_ns > due_ns) {
+        h->items[i] = h->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->items[i].due_ns = due_ns;
+    h->items[i].worker = worker;
+    return 0;
+}
+
+static lg_timer_t heap_pop(timer_heap_t *h) {
+    lg_timer_t top = h->items[0];
+    lg_timer_t last = h->items[--h->len];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= h->len) {
+            break;
+        }
+        if (c + 1 < h->len && h->items[c + 1].due_ns < h->items[c].due_ns) {
+            ++c;
+        }
+        if (h->items[c].due_ns >= last.due_ns) {
+            break;
+        }
+        h->items[i] = h->items[c];
+        i = c;
+    }
+    if (h->len > 0) {
+        h->items[i] = last;
+    }
+    return top;
+}
+
+static void sample_push(sample_vec_t *s, double v) {
+    if (s->len == s->cap) {
+        size_t cap = (s->cap == 0U) ? 4096U : s->cap * 2U;
+        double *grown = (double *)realloc(s->v, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return;
+        }
+        s->v = grown;
+        s->cap = cap;
+    }
+    s->v[s->len++] = v;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double pct(const sample_vec_t *s, double p) {
+    size_t idx;
+    if (s->len == 0U) {
+        return 0.0;
+    }
+    idx = (size_t)(p * (double)(s->len - 1U));
+    return s->v[idx];
+}
+
+static void raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        (void)setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static void sim_close(int epfd, sim_worker_t *w, int *alive) {
+    if (w->alive == 0) {
+        return;
+    }
+    (void)epoll_ctl(epfd, EPOLL_CTL_DEL, w->fd, NULL);
+    close(w->fd);
+    w->fd = -1;
+    w->alive = 0;
+    free(w->reply);
+    w->reply = NULL;
+    --*alive;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s --host <host> --port <port> --workers <N> [--cores C] [--timeout S]\n"
+            "       [--delay fixed:MS|uniform:A:B|exp:MEAN|lognormal:MU:SIGMA] [--disconnect P] [--error P]\n"
+            "       [--seed S]\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    lg_cfg_t cfg;
+    worker_cfg_t hello_cfg;
+    worker_cfg_t exec_cfg;
+    worker_ops_t wops;
+    sim_worker_t *ws = NULL;
+    timer_heap_t timers;
+    sample_vec_t lat;
+    struct epoll_event evs[LG_EVENTS];
+    uint8_t hello[PAYLOAD_BUF_SZ];
+    size_t hello_len = 0U;
+    uint8_t *in_buf = NULL;
+    uint64_t t_start;
+    uint64_t t_joined = 0U;
+    uint64_t t_first_task = 0U;
+    uint64_t t_last_result = 0U;
+    uint64_t deadline;
+    long tasks = 0;
+    long results = 0;
+    long disconnects = 0;
+    long errors = 0;
+    long shutdowns = 0;
+    long aborts = 0;
+    long cancels = 0;
+    int alive = 0;
+    int connected = 0;
+    int epfd = -1;
+    int rc = 2;
+    int i;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.host = "127.0.0.1";
+    cfg.port = NULL;
+    cfg.workers = 100;
+    cfg.cores = 1;
+    cfg.timeout_sec = 60;
+    cfg.delay.kind = DELAY_FIXED;
+    cfg.seed = 1U;
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
+            cfg.host = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            cfg.port = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            cfg.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {
+            cfg.cores = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            cfg.timeout_sec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--delay") == 0 && i + 1 < argc) {
+            if (parse_delay(argv[++i], &cfg.delay) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--disconnect") == 0 && i + 1 < argc) {
+            cfg.disconnect_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--error") == 0 && i + 1 < argc) {
+            cfg.error_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            cfg.seed = (uint64_t)strtoull(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.port == NULL || cfg.workers < 1 || cfg.cores < 1 || cfg.timeout_sec < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    g_rng ^= cfg.seed * 0xD1B54A32D192ED03ULL;
+    raise_fd_limit();
+
+    memset(&hello_cfg, 0, sizeof(hello_cfg));
+    hello_cfg.host = cfg.host;
+    hello_cfg.port = cfg.port;
+    hello_cfg.max_cores = cfg.cores;
+    hello_cfg.max_time_sec = cfg.timeout_sec;
+    exec_cfg = hello_cfg;
+    exec_cfg.max_cores = 1;
+    wops = integral_worker_ops();
+    wops.user_ctx = &exec_cfg;
+    if (wops.build_hello(hello, sizeof(hello), &hello_len, &hello_cfg, wops.user_ctx) != 0) {
+        return 2;
+    }
+
+    memset(&timers, 0, sizeof(timers));
+    memset(&lat, 0, sizeof(lat));
+    ws = (sim_worker_t *)calloc((size_t)cfg.workers, sizeof(*ws));
+    in_buf = (uint8_t *)malloc(TRACE_TASK_HDR_SZ + PAYLOAD_BUF_SZ);
+    epfd = epoll_create1(0);
+    if (ws == NULL || in_buf == NULL || epfd < 0) {
+        goto done;
+    }
+
+    t_start = now_ns();
+    deadline = t_start + (uint64_t)cfg.timeout_sec * 1000000000ULL;
+    for (i = 0; i < cfg.workers; ++i) {
+        struct epoll_event ev;
+        int fd = net_connect_timeout(cfg.host, cfg.port, 5);
+        if (fd < 0) {
+            fprintf(stderr, "[loadgen] connect failed for sim worker #%d: %s\n", i + 1, strerror(errno));
+            break;
+        }
+        if (net_send_packet(fd, NET_MSG_HELLO, hello, (uint32_t)hello_len, 5) < 0) {
+            close(fd);
+            break;
+        }
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)i;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            break;
+        }
+        ws[i].fd = fd;
+        ws[i].alive = 1;
+        ++alive;
+        ++connected;
+    }
+    t_joined = now_ns();
+    fprintf(stderr, "[loadgen] %d/%d simulated workers connected\n", connected, cfg.workers);
+
+    while (alive > 0) {
+        uint64_t now = now_ns();
+        int wait_ms = 1000;
+        int n;
+
+        if (now >= deadline) {
+            fprintf(stderr, "[loadgen] timeout with %d connections still open\n", alive);
+            break;
+        }
+        while (timers.len > 0 && timers.items[0].due_ns <= now) {
+            lg_timer_t t = heap_pop(&timers);
+            sim_worker_t *w = &ws[t.worker];
+            if (w->alive == 0 || w->reply == NULL) {
+                continue;
+            }
+            if (net_send_packet(w->fd, w->reply_type, w->reply, w->reply_len, 5) < 0) {
+                sim_close(epfd, w, &alive);
+                continue;
+            }
+            free(w->reply);
+            w->reply = NULL;
+            w->result_sent_ns = now_ns();
+            if (w->reply_type == NET_MSG_ERROR) {
+                ++errors;
+            } else {
+                ++results;
+                t_last_result = w->result_sent_ns;
+            }
+        }
+        if (timers.len > 0) {
+            uint64_t due = timers.items[0].due_ns;
+            now = now_ns();
+            wait_ms = (due > now) ? (int)((due - now + 999999ULL) / 1000000ULL) : 0;
+            if (wait_ms > 1000) {
+                wait_ms = 1000;
+            }
+        }
+        n = epoll_wait(epfd, evs, LG_EVENTS, wait_ms);
+        if (n < 0 && errno != EINTR) {
+            break;
+        }
+        for (i = 0; i < n; ++i) {
+            sim_worker_t *w = &ws[evs[i].data.u32];
+            uint8_t type = 0U;
+            uint32_t len = 0U;
+            uint64_t recv_ns;
+            const uint8_t *task;
+            size_t task_len;
+            size_t out_len = 0U;
+            size_t err_len = 0U;
+            uint8_t err_buf[64];
+            double u;
+            int traced;
+
+            if (w->alive == 0) {
+                continue;
+            }
+            if (net_recv_packet(w->fd, &type, in_buf, TRACE_TASK_HDR_SZ + PAYLOAD_BUF_SZ, &len, 5) < 0) {
+                sim_close(epfd, w, &alive);
+                continue;
+            }
+            recv_ns = now_ns();
+            if (type == NET_MSG_SHUTDOWN || type == NET_MSG_ABORT) {
+                if (type == NET_MSG_SHUTDOWN) {
+                    ++shutdowns;
+                } else {
+                    ++aborts;
+                }
+                sim_close(epfd, w, &alive);
+                continue;
+            }
+            if (type == NET_MSG_CANCEL) {
+                if (w->reply != NULL) {
+                    free(w->reply);
+                    w->reply = NULL;
+                    ++cancels;
+                    if (net_send_packet(w->fd, NET_MSG_CANCELLED, NULL, 0U, 5) < 0) {
+                        sim_close(epfd, w, &alive);
+                    }
+                }
+                continue;
+            }
+            traced = (type == NET_MSG_TRACE_TASK && len >= TRACE_TASK_HDR_SZ) ? 1 : 0;
+            if (type != NET_MSG_TASK && traced == 0) {
+                sim_close(epfd, w, &alive);
+                continue;
+            }
+            ++tasks;
+            if (t_first_task == 0U) {
+                t_first_task = recv_ns;
+            }
+            if (w->got_task != 0) {
+                sample_push(&lat, (double)(recv_ns - w->result_sent_ns) / 1000.0);
+            }
+            w->got_task = 1;
+
+            u = rng_u01();
+            if (u < cfg.disconnect_rate) {
+                ++disconnects;
+                sim_close(epfd, w, &alive);
+                continue;
+            }
+            w->reply = (uint8_t *)malloc(TRACE_RESULT_HDR_SZ + PAYLOAD_BUF_SZ);
+            if (w->reply == NULL) {
+                sim_close(epfd, w, &alive);
+                continue;
+            }
+            if (u < cfg.disconnect_rate + cfg.error_rate) {
+                static const char injected[] = "injected_error";
+                memcpy(w->reply, injected, sizeof(injected) - 1U);
+                w->reply_len = (uint32_t)(sizeof(injected) - 1U);
+                w->reply_type = NET_MSG_ERROR;
+            } else {
+                uint8_t *out = w->reply + ((traced != 0) ? TRACE_RESULT_HDR_SZ : 0U);
+                uint64_t k_begin;
+                task = in_buf + ((traced != 0) ? TRACE_TASK_HDR_SZ : 0U);
+                task_len = (size_t)len - ((traced != 0) ? TRACE_TASK_HDR_SZ : 0U);
+                k_begin = now_ns();
+                if (task_execute(&wops, task, task_len, out, PAYLOAD_BUF_SZ, &out_len, err_buf, sizeof(err_buf),
+                                 &err_len) != 0) {
+                    static const char failed[] = "task_failed";
+                    memcpy(w->reply, failed, sizeof(failed) - 1U);
+                    w->reply_len = (uint32_t)(sizeof(failed) - 1U);
+                    w->reply_type = NET_MSG_ERROR;
+                } else if (traced != 0) {
+                    uint64_t k_end = now_ns();
+                    memcpy(w->reply, in_buf, TRACE_TASK_HDR_SZ);
+                    trace_put_u64(w->reply + 8, recv_ns);
+                    trace_put_u64(w->reply + 16, k_begin);
+                    trace_put_u64(w->reply + 24, k_begin);
+                    trace_put_u64(w->reply + 32, k_end);
+                    trace_put_u64(w->reply + 40, k_end);
+                    w->reply_len = (uint32_t)(TRACE_RESULT_HDR_SZ + out_len);
+                    w->reply_type = NET_MSG_TRACE_RESULT;
+                } else {
+                    w->reply_len = (uint32_t)out_len;
+                    w->reply_type = NET_MSG_RESULT;
+                }
+            }
+            if (heap_push(&timers, recv_ns + (uint64_t)(delay_sample_ms(&cfg.delay) * 1e6),
+                          (int)evs[i].data.u32) != 0) {
+                sim_close(epfd, w, &alive);
+            }
+        }
+    }
+
+    qsort(lat.v, lat.len, sizeof(*lat.v), cmp_double);
+    printf("LOADGEN_WORKERS=%d\n", cfg.workers);
+    printf("CONNECTED=%d\n", connected);
+    printf("JOIN_SEC=%.6f\n", (double)(t_joined - t_start) / 1e9);
+    printf("ACCEPT_RATE=%.1f\n",
+           (t_first_task > t_start) ? (double)connected / ((double)(t_first_task - t_start) / 1e9) : 0.0);
+    printf("FIRST_TASK_SEC=%.6f\n", (t_first_task > t_start) ? (double)(t_first_task - t_start) / 1e9 : 0.0);
+    printf("TASKS=%ld\n", tasks);
+    printf("RESULTS=%ld\n", results);
+    printf("DISPATCH_LAT_US_P50=%.1f\n", pct(&lat, 0.50));
+    printf("DISPATCH_LAT_US_P90=%.1f\n", pct(&lat, 0.90));
+    printf("DISPATCH_LAT_US_P99=%.1f\n", pct(&lat, 0.99));
+    printf("DISPATCH_LAT_US_MAX=%.1f\n", pct(&lat, 1.0));
+    printf("COLLECT_THROUGHPUT=%.1f\n",
+           (t_last_result > t_first_task) ? (double)results / ((double)(t_last_result - t_first_task) / 1e9) : 0.0);
+    printf("INJECTED_DISCONNECTS=%ld\n", disconnects);
+    printf("INJECTED_ERRORS=%ld\n", errors);
+    printf("SHUTDOWNS=%ld\n", shutdowns);
+    printf("ABORTS=%ld\n", aborts);
+    printf("CANCELS=%ld\n", cancels);
+    rc = (alive == 0 && shutdowns == (long)connected) ? 0 : 3;
+
+done:
+    for (i = 0; ws != NULL && i < cfg.workers; ++i) {
+        if (ws[i].alive != 0) {
+            close(ws[i].fd);
+        }
+        free(ws[i].reply);
+    }
+    if (epfd >= 0) {
+        close(epfd);
+    }
+    free(ws);
+    free(in_buf);
+    free(timers.items);
+    free(lat.v);
+    return rc;
+}
@@ -0,0 +1,552 @@
+#define _POSIX_C_SOURCE 200809L
+#include "distr.h"
+#include "integral_app.h"
+#include "internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MB_HOST "127.0.0.1"
+#define MB_MAX_PAYLOAD (1024U * 1024U)
+#define MB_STREAM_BYTES (32U * 1024U * 1024U)
+#define MB_TRAPZ_N 20000000L
+#define MB_TRAPZ_FLOPS_PER_NODE 6.0
+#define MB_DISPATCH_TASKS 20000
+#define MB_DISPATCH_WORKERS 4
+#define MB_MAX_THREADS 64
+
+typedef struct {
+    FILE *out;
+    int reps;
+    int warmup;
+    int port;
+    int max_threads;
+    int first;
+} mb_ctx_t;
+
+typedef struct {
+    int listen_fd;
+    uint8_t *buf;
+} echo_ctx_t;
+
+typedef struct {
+    int total;
+    int built;
+    int done;
+    uint64_t t_first_ns;
+    uint64_t t_last_ns;
+} dispatch_ctx_t;
+
+typedef struct {
+    char port[16];
+} fake_worker_ctx_t;
+
+static volatile double g_sink;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double p) {
+    double pos = p * (double)(n - 1);
+    int lo = (int)pos;
+    double frac = pos - (double)lo;
+    if (lo + 1 >= n) {
+        return sorted[n - 1];
+    }
+    return sorted[lo] + (sorted[lo + 1] - sorted[lo]) * frac;
+}
+
+static void emit(mb_ctx_t *mb, const char *name, const char *unit, int higher_is_better, double *samples, int n,
+                 const char *extra) {
+    double mean = 0.0;
+    int i;
+    if (n < 1) {
+        return;
+    }
+    qsort(samples, (size_t)n, sizeof(*samples), cmp_double);
+    for (i = 0; i < n; ++i) {
+        mean += samples[i];
+    }
+    mean /= (double)n;
+    fprintf(mb->out,
+            "%s    {\"name\": \"%s\", \"unit\": \"%s\", \"better\": \"%s\", \"samples\": %d, "
+            "\"min\": %.6g, \"p50\": %.6g, \"p90\": %.6g, \"p99\": %.6g, \"max\": %.6g, \"mean\": %.6g%s%s}",
+            (mb->first != 0) ? "" : ",\n",
+            name,
+            unit,
+            (higher_is_better != 0) ? "higher" : "lower",
+            n,
+            samples[0],
+            percentile(samples, n, 0.50),
+            percentile(samples, n, 0.90),
+            percentile(samples, n, 0.99),
+            samples[n - 1],
+            mean,
+            (extra != NULL) ? ", " : "",
+            (extra != NULL) ? extra : "");
+    mb->first = 0;
+    fprintf(stderr, "[microbench] %-28s p50=%.6g %s\n", name, percentile(samples, n, 0.50), unit);
+}
+
+static void *echo_run(void *arg) {
+    echo_ctx_t *ec = (echo_ctx_t *)arg;
+    int fd = net_accept_timeout(ec->listen_fd, 5);
+    if (fd < 0) {
+        return NULL;
+    }
+    for (;;) {
+        uint8_t type = 0U;
+        uint32_t len = 0U;
+        if (net_recv_packet(fd, &type, ec->buf, MB_MAX_PAYLOAD, &len, 10) < 0 || type == NET_MSG_SHUTDOWN) {
+            break;
+        }
+        if (type == NET_MSG_TASK) {
+            if (net_send_packet(fd, NET_MSG_RESULT, ec->buf, len, 10) < 0) {
+                break;
+            }
+        } else if (type == NET_MSG_HELLO) {
+            if (net_send_packet(fd, NET_MSG_RESULT, NULL, 0U, 10) < 0) {
+                break;
+            }
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static int bench_net(mb_ctx_t *mb) {
+    static const uint32_t rtt_sizes[] = {0U, 64U, 1024U, 16384U, 262144U};
+    static const uint32_t bw_sizes[] = {1024U, 16384U, 262144U, MB_MAX_PAYLOAD};
+    echo_ctx_t ec;
+    pthread_t th;
+    char port[16];
+    uint8_t *buf = NULL;
+    double *samples = NULL;
+    int fd = -1;
+    int rc = -1;
+    size_t s;
+
+    snprintf(port, sizeof(port), "%d", mb->port);
+    ec.listen_fd = net_listen(MB_HOST, port);
+    ec.buf = (uint8_t *)malloc(MB_MAX_PAYLOAD);
+    buf = (uint8_t *)calloc(1U, MB_MAX_PAYLOAD);
+    samples = (double *)calloc((size_t)mb->reps, sizeof(*samples));
+    if (ec.listen_fd < 0 || ec.buf == NULL || buf == NULL || samples == NULL) {
+        fprintf(stderr, "[microbench] net setup failed\n");
+        goto done;
+    }
+    if (pthread_create(&th, NULL, echo_run, &ec) != 0) {
+        goto done;
+    }
+    fd = net_connect_timeout(MB_HOST, port, 5);
+    if (fd < 0) {
+        fprintf(stderr, "[microbench] connect failed\n");
+        close(ec.listen_fd);
+        ec.listen_fd = -1;
+        (void)pthread_join(th, NULL);
+        goto done;
+    }
+
+    for (s = 0U; s < sizeof(rtt_sizes) / sizeof(rtt_sizes[0]); ++s) {
+        char name[64];
+        int r;
+        for (r = -mb->warmup; r < mb->reps; ++r) {
+            uint8_t type = 0U;
+            uint32_t len = 0U;
+            uint64_t t0 = now_ns();
+            if (net_send_packet(fd, NET_MSG_TASK, buf, rtt_sizes[s], 10) < 0 ||
+                net_recv_packet(fd, &type, buf, MB_MAX_PAYLOAD, &len, 10) < 0) {
+                goto stop;
+            }
+            if (r >= 0) {
+                samples[r] = (double)(now_ns() - t0) / 1000.0;
+            }
+        }
+        snprintf(name, sizeof(name), "net_rtt/%uB", (unsigned)rtt_sizes[s]);
+        emit(mb, name, "us", 0, samples, mb->reps, NULL);
+    }
+
+    for (s = 0U; s < sizeof(bw_sizes) / sizeof(bw_sizes[0]); ++s) {
+        char name[64];
+        uint32_t count = MB_STREAM_BYTES / bw_sizes[s];
+        int r;
+        for (r = -mb->warmup; r < mb->reps; ++r) {
+            uint8_t type = 0U;
+            uint32_t len = 0U;
+            uint64_t t0 = now_ns();
+            uint32_t k;
+            for (k = 0U; k < count; ++k) {
+                if (net_send_packet(fd, NET_MSG_RESULT, buf, bw_sizes[s], 10) < 0) {
+                    goto stop;
+                }
+            }
+            if (net_send_packet(fd, NET_MSG_HELLO, NULL, 0U, 10) < 0 ||
+                net_recv_packet(fd, &type, buf, MB_MAX_PAYLOAD, &len, 10) < 0) {
+                goto stop;
+            }
+            if (r >= 0) {
+                double sec = (double)(now_ns() - t0) / 1e9;
+                samples[r] = (double)count * (double)bw_sizes[s] / sec / 1e6;
+            }
+        }
+        snprintf(name, sizeof(name), "net_throughput/%uB", (unsigned)bw_sizes[s]);
+        emit(mb, name, "MB/s", 1, samples, mb->reps, NULL);
+    }
+    rc = 0;
+
+stop:
+    (void)net_send_packet(fd, NET_MSG_SHUTDOWN, NULL, 0U, 5);
+    close(fd);
+    (void)pthread_join(th, NULL);
+done:
+    if (ec.listen_fd >= 0) {
+        close(ec.listen_fd);
+    }
+    free(ec.buf);
+    free(buf);
+    free(samples);
+    return rc;
+}
+
+static int cb_noop_hello(uint8_t *out, size_t out_sz, size_t *out_len, const worker_cfg_t *wcfg, void *user_ctx) {
+    (void)out;
+    (void)out_sz;
+    (void)wcfg;
+    (void)user_ctx;
+    *out_len = 0U;
+    return 0;
+}
+
+static int cb_noop_execute(const uint8_t *task_payload,
+                           size_t task_payload_len,
+                           uint8_t *result_payload,
+                           size_t result_payload_sz,
+                           size_t *result_payload_len,
+                           uint8_t *error_payload,
+                           size_t error_payload_sz,
+                           size_t *error_payload_len,
+                           void *user_ctx) {
+    (void)error_payload;
+    (void)error_payload_sz;
+    (void)user_ctx;
+    if (task_payload_len > result_payload_sz) {
+        return -1;
+    }
+    memcpy(result_payload, task_payload, task_payload_len);
+    *result_payload_len = task_payload_len;
+    *error_payload_len = 0U;
+    return 0;
+}
+
+static int bench_fork(mb_ctx_t *mb) {
+    static uint8_t result[PAYLOAD_BUF_SZ];
+    static uint8_t error[PAYLOAD_BUF_SZ];
+    worker_ops_t ops;
+    uint8_t task[16];
+    double *samples = (double *)calloc((size_t)mb->reps, sizeof(double));
+    int r;
+
+    if (samples == NULL) {
+        return -1;
+    }
+    memset(task, 0x5a, sizeof(task));
+    ops.build_hello = cb_noop_hello;
+    ops.execute_task = cb_noop_execute;
+    ops.plan_task = NULL;
+    ops.user_ctx = NULL;
+    for (r = -mb->warmup; r < mb->reps; ++r) {
+        size_t result_len = 0U;
+        size_t error_len = 0U;
+        int timed_out = 0;
+        uint64_t t0 = now_ns();
+        if (run_task_with_timeout(&ops, task, sizeof(task), 10, result, sizeof(result), &result_len, error,
+                                  sizeof(error), &error_len, &timed_out, NULL, NULL) != 0 ||
+            result_len != sizeof(task)) {
+            free(samples);
+            return -1;
+        }
+        if (r >= 0) {
+            samples[r] = (double)(now_ns() - t0) / 1000.0;
+        }
+    }
+    emit(mb, "run_task_with_timeout/noop", "us", 0, samples, mb->reps, NULL);
+    free(samples);
+    return 0;
+}
+
+static int bench_trapz(mb_ctx_t *mb) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    double *samples = (double *)calloc((size_t)mb->reps, sizeof(double));
+    double base_p50 = 0.0;
+    int threads;
+
+    if (samples == NULL) {
+        return -1;
+    }
+    if (mb->max_threads > 0) {
+        ncpu = mb->max_threads;
+    }
+    if (ncpu < 1) {
+        ncpu = 1;
+    }
+    if (ncpu > MB_MAX_THREADS) {
+        ncpu = MB_MAX_THREADS;
+    }
+    for (threads = 1;; threads = (threads * 2 < (int)ncpu) ? threads * 2 : (int)ncpu) {
+        char name[64];
+        char extra[64];
+        double p50;
+        int r;
+        for (r = -mb->warmup; r < mb->reps; ++r) {
+            uint64_t t0 = now_ns();
+            g_sink += integrate_trapz(NULL, 0.0, 1.0, MB_TRAPZ_N, threads);
+            if (r >= 0) {
+                samples[r] = (double)MB_TRAPZ_N * MB_TRAPZ_FLOPS_PER_NODE / ((double)(now_ns() - t0) / 1e9) / 1e9;
+            }
+        }
+        qsort(samples, (size_t)mb->reps, sizeof(*samples), cmp_double);
+        p50 = percentile(samples, mb->reps, 0.50);
+        if (threads == 1) {
+            base_p50 = p50;
+        }
+        snprintf(extra, sizeof(extra), "\"threads\": %d, \"speedup\": %.3f", threads,
+                 (base_p50 > 0.0) ? p50 / base_p50 : 0.0);
+        snprintf(name, sizeof(name), "trapz_gflops/threads=%d", threads);
+        emit(mb, name, "GFLOP/s", 1, samples, mb->reps, extra);
+        if (threads == (int)ncpu) {
+            break;
+        }
+    }
+    free(samples);
+    return 0;
+}
+
+static void *fake_worker_run(void *arg) {
+    fake_worker_ctx_t *fw = (fake_worker_ctx_t *)arg;
+    uint8_t buf[PAYLOAD_BUF_SZ];
+    int fd = -1;
+    int tries;
+    for (tries = 0; tries < 500 && fd < 0; ++tries) {
+        fd = net_connect_timeout(MB_HOST, fw->port, 5);
+        if (fd < 0) {
+            struct timespec ts = {0, 10000000L};
+            (void)nanosleep(&ts, NULL);
+        }
+    }
+    if (fd < 0 || net_send_packet(fd, NET_MSG_HELLO, NULL, 0U, 5) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    for (;;) {
+        uint8_t type = 0U;
+        uint32_t len = 0U;
+        if (net_recv_packet(fd, &type, buf, sizeof(buf), &len, 30) < 0 || type != NET_MSG_TASK) {
+            break;
+        }
+        if (net_send_packet(fd, NET_MSG_RESULT, buf, len, 5) < 0) {
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static int cb_dispatch_hello(int worker_index, const uint8_t *hello_payload, size_t hello_payload_len, void *user_ctx) {
+    (void)worker_index;
+    (void)hello_payload;
+    (void)hello_payload_len;
+    (void)user_ctx;
+    return 0;
+}
+
+static int cb_dispatch_build(int worker_index,
+                             uint8_t *task_payload,
+                             size_t task_payload_sz,
+                             size_t *task_payload_len,
+                             void *user_ctx) {
+    dispatch_ctx_t *dc = (dispatch_ctx_t *)user_ctx;
+    (void)worker_index;
+    if (dc->built >= dc->total) {
+        return 1;
+    }
+    if (task_payload_sz < 16U) {
+        return -1;
+    }
+    if (dc->built == 0) {
+        dc->t_first_ns = now_ns();
+    }
+    memset(task_payload, 0, 16U);
+    memcpy(task_payload, &dc->built, sizeof(dc->built));
+    *task_payload_len = 16U;
+    ++dc->built;
+    return 0;
+}
+
+static int cb_dispatch_result(int worker_index, const uint8_t *result_payload, size_t result_payload_len,
+                              void *user_ctx) {
+    dispatch_ctx_t *dc = (dispatch_ctx_t *)user_ctx;
+    (void)worker_index;
+    (void)result_payload;
+    if (result_payload_len != 16U) {
+        return -1;
+    }
+    ++dc->done;
+    dc->t_last_ns = now_ns();
+    return 0;
+}
+
+static uint64_t pool_misses(void) {
+    distr_pool_stats_t st[POOL_CLASSES];
+    uint64_t total = 0U;
+    int n = distr_pool_stats(st, POOL_CLASSES);
+    int k;
+    for (k = 0; k < n; ++k) {
+        total += st[k].misses;
+    }
+    return total;
+}
+
+static int bench_dispatch(mb_ctx_t *mb) {
+    fake_worker_ctx_t fw;
+    manager_cfg_t mcfg;
+    manager_ops_t ops;
+    pthread_t ths[MB_DISPATCH_WORKERS];
+    double *samples = (double *)calloc((size_t)mb->reps, sizeof(double));
+    int reps = mb->reps;
+    int warmup = (mb->warmup > 0) ? 1 : 0;
+    uint64_t misses = 0U;
+    char extra[64];
+    int r;
+
+    if (samples == NULL) {
+        return -1;
+    }
+    snprintf(fw.port, sizeof(fw.port), "%d", mb->port + 1);
+    memset(&mcfg, 0, sizeof(mcfg));
+    mcfg.host = MB_HOST;
+    mcfg.port = fw.port;
+    mcfg.required_workers = MB_DISPATCH_WORKERS;
+    mcfg.max_time_sec = 60;
+    ops.on_worker_hello = cb_dispatch_hello;
+    ops.build_task = cb_dispatch_build;
+    ops.on_worker_result = cb_dispatch_result;
+    ops.on_worker_partial = NULL;
+    ops.progress = NULL;
+    ops.on_control = NULL;
+    if (reps > 10) {
+        reps = 10;
+    }
+    for (r = -warmup; r < reps; ++r) {
+        dispatch_ctx_t dc;
+        int k;
+        int rc;
+        memset(&dc, 0, sizeof(dc));
+        dc.total = MB_DISPATCH_TASKS;
+        if (r == 0) {
+            misses = pool_misses();
+        }
+        ops.user_ctx = &dc;
+        for (k = 0; k < MB_DISPATCH_WORKERS; ++k) {
+            (void)pthread_create(&ths[k], NULL, fake_worker_run, &fw);
+        }
+        rc = run_manager(&mcfg, &ops);
+        for (k = 0; k < MB_DISPATCH_WORKERS; ++k) {
+            (void)pthread_join(ths[k], NULL);
+        }
+        if (rc != 0 || dc.done != dc.total) {
+            free(samples);
+            return -1;
+        }
+        if (r >= 0) {
+            samples[r] = (double)dc.done / ((double)(dc.t_last_ns - dc.t_first_ns) / 1e9);
+        }
+    }
+    snprintf(extra, sizeof(extra), "\"pool_misses\": %llu", (unsigned long long)(pool_misses() - misses));
+    emit(mb, "manager_dispatch/4_workers", "tasks/s", 1, samples, reps, extra);
+    free(samples);
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [--reps N] [--warmup N] [--port P] [--max-threads N] [--out <file|->]\n"
+            "       [--only net|fork|trapz|dispatch]\n",
+            argv0);
+}
+
+int main(int argc, char **argv) {
+    mb_ctx_t mb;
+    const char *out_path = "-";
+    const char *only = NULL;
+    int failed = 0;
+    int i;
+
+    mb.out = stdout;
+    mb.reps = 30;
+    mb.warmup = 3;
+    mb.port = 7400;
+    mb.max_threads = 0;
+    mb.first = 1;
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            mb.reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            mb.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            mb.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc) {
+            mb.max_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (mb.reps < 1 || mb.warmup < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (strcmp(out_path, "-") != 0) {
+        mb.out = fopen(out_path, "w");
+        if (mb.out == NULL) {
+            perror(out_path);
+            return 2;
+        }
+    }
+
+    fprintf(mb.out, "{\n  \"suite\": \"distr-microbench\",\n  \"reps\": %d,\n  \"warmup\": %d,\n", mb.reps, mb.warmup);
+    fprintf(mb.out, "  \"cpus\": %ld,\n  \"results\": [\n", sysconf(_SC_NPROCESSORS_ONLN));
+    if ((only == NULL || strcmp(only, "net") == 0) && bench_net(&mb) != 0) {
+        fprintf(stderr, "[microbench] net benchmark failed\n");
+        failed = 1;
+    }
+    if ((only == NULL || strcmp(only, "fork") == 0) && bench_fork(&mb) != 0) {
+        fprintf(stderr, "[microbench] fork benchmark failed\n");
+        failed = 1;
+    }
+    if ((only == NULL || strcmp(only, "trapz") == 0) && bench_trapz(&mb) != 0) {
+        fprintf(stderr, "[microbench] trapz benchmark failed\n");
+        failed = 1;
+    }
+    if ((only == NULL || strcmp(only, "dispatch") == 0) && bench_dispatch(&mb) != 0) {
+        fprintf(stderr, "[microbench] dispatch benchmark failed\n");
+        failed = 1;
+    }
+    fprintf(mb.out, "\n  ]\n}\n");
+    if (mb.out != stdout) {
+        fclose(mb.out);
+    }
+    return (failed != 0) ? 3 : 0;
+}
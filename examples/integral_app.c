@@ -1,37 +1,80 @@
 #define _POSIX_C_SOURCE 200809L
 #include "integral_app.h"
+#include "integral_mc.h"
+#include "integral_wire.h"
 
-#include <arpa/inet.h>
+#include <dirent.h>
+#include <float.h>
+#include <dlfcn.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 typedef struct {
+    expr_prog_t prog;
+    integral_fn_t fn;
     double a;
     double h;
-    long i_begin;
-    long i_end;
-    double *out_partial;
-} thr_ctx_t;
+    double lo;
+    double hi;
+    int bins;
+    int midpoint;
+    uint32_t id;
+    uint64_t start_us;
+} node_ctx_t;
+
+_Static_assert(sizeof(node_ctx_t) <= DISTR_PLAN_STATE_SZ, "node_ctx_t does not fit the task plan state");
 
 typedef struct {
-    uint32_t cores_be;
-} hello_msg_t;
+    distr_moments_t moments;
+    distr_hist_t hist;
+} hist_acc_t;
 
 typedef struct {
-    uint32_t id_be;
-    uint64_t a_be;
-    uint64_t b_be;
-    uint64_t n_be;
-    uint32_t threads_be;
-} task_msg_t;
+    distr_sum_t sum;
+    double abs_sum;
+    double max_dev;
+} mixed_acc_t;
 
 typedef struct {
-    uint32_t id_be;
-    uint64_t value_be;
-} result_msg_t;
+    const integral_fn_t *fn;
+    double a;
+    double h;
+    long i_begin;
+    long i_end;
+    const double *params;
+    int count;
+    double *acc;
+    distr_task_local_t *task;
+} sweep_thr_ctx_t;
+
+static void *g_kernel_handles[INTEGRAL_KERNELS_MAX];
+static const integral_kernel_t *g_kernels[INTEGRAL_KERNELS_MAX];
+static int g_kernel_count = 0;
+static char g_host_id[INTEGRAL_HOST_ID_MAX];
+
+static const double gk15_xgk[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+
+static const double gk15_wgk[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+
+static const double gk15_wg[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
 
 static double f(double x) {
     return 4.0 / (1.0 + x * x);
@@ -43,294 +86,2426 @@ uint64_t integral_now_ms(void) {
     return ((uint64_t)tv.tv_sec * 1000ULL) + ((uint64_t)tv.tv_usec / 1000ULL);
 }
 
-static uint64_t host_to_be64(uint64_t v) {
-    uint64_t hi = (uint64_t)htonl((uint32_t)(v >> 32));
-    uint64_t lo = (uint64_t)htonl((uint32_t)(v & 0xffffffffU));
-    return (lo << 32) | hi;
+static uint64_t now_us(void) {
+    struct timeval tv;
+    (void)gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000000ULL) + (uint64_t)tv.tv_usec;
+}
+
+static void table_eval(const integral_fn_t *fn, const double *x, double *y, int count) {
+    const double *t = fn->table;
+    double last = (double)(fn->table_len - 1);
+    double scale = last / (fn->table_hi - fn->table_lo);
+    int k;
+    for (k = 0; k < count; ++k) {
+        double u = (x[k] - fn->table_lo) * scale;
+        long j;
+        if (u <= 0.0) {
+            y[k] = t[0];
+            continue;
+        }
+        if (u >= last) {
+            y[k] = t[fn->table_len - 1];
+            continue;
+        }
+        j = (long)u;
+        y[k] = t[j] + (u - (double)j) * (t[j + 1] - t[j]);
+    }
+}
+
+void integral_fn_eval(const integral_fn_t *fn, const double *const *vars, double *y, int count) {
+    int k;
+    if (fn != NULL && fn->table != NULL) {
+        table_eval(fn, vars[0], y, count);
+        return;
+    }
+    if (fn == NULL || fn->prog == NULL) {
+        for (k = 0; k < count; ++k) {
+            y[k] = f(vars[0][k]);
+        }
+        return;
+    }
+    expr_eval_block(fn->prog, vars, fn->params, y, count);
+}
+
+static void fn_eval(const integral_fn_t *fn, const double *x, double *y, int count) {
+    integral_fn_eval(fn, &x, y, count);
+}
+
+static void fn_eval_f32(const integral_fn_t *fn, const float *x, float *y, int count) {
+    int k;
+    if (fn->prog == NULL) {
+        for (k = 0; k < count; ++k) {
+            y[k] = 4.0f / (1.0f + x[k] * x[k]);
+        }
+        return;
+    }
+    expr_eval_block_f32(fn->prog, &x, fn->params, y, count);
 }
 
-static uint64_t be64_to_host(uint64_t v) {
-    uint64_t hi = (uint64_t)ntohl((uint32_t)(v >> 32));
-    uint64_t lo = (uint64_t)ntohl((uint32_t)(v & 0xffffffffU));
-    return (lo << 32) | hi;
+static void node_map_f32(long begin, long end, void *acc, void *user_ctx) {
+    const node_ctx_t *ctx = (const node_ctx_t *)user_ctx;
+    mixed_acc_t *m = (mixed_acc_t *)acc;
+    float xs[EXPR_BLOCK];
+    float ys[EXPR_BLOCK];
+    long i;
+
+    for (i = begin; i <= end && distr_task_cancelled() == 0;) {
+        int cnt = (end - i + 1 < EXPR_BLOCK) ? (int)(end - i + 1) : EXPR_BLOCK;
+        double x0 = ctx->a + (double)i * ctx->h;
+        double part = 0.0;
+        double mag = 0.0;
+        double y0;
+        double dev;
+        int k;
+        for (k = 0; k < cnt; ++k) {
+            xs[k] = (float)(ctx->a + (double)(i + k) * ctx->h);
+        }
+        fn_eval_f32(&ctx->fn, xs, ys, cnt);
+        for (k = 0; k < cnt; ++k) {
+            part += (double)ys[k];
+            mag += fabs((double)ys[k]);
+        }
+        if (i == begin) {
+            part -= 0.5 * (double)ys[0];
+        }
+        if (i + cnt - 1 == end) {
+            part -= 0.5 * (double)ys[cnt - 1];
+        }
+        distr_sum_add(&m->sum, part);
+        m->abs_sum += mag;
+        fn_eval(&ctx->fn, &x0, &y0, 1);
+        dev = fabs((double)ys[0] - y0) / fmax(fabs(y0), mag / (double)cnt);
+        if (dev > m->max_dev) {
+            m->max_dev = dev;
+        }
+        i += cnt;
+    }
 }
 
-static uint64_t double_to_be64(double d) {
-    uint64_t u = 0U;
-    memcpy(&u, &d, sizeof(u));
-    return host_to_be64(u);
+static void node_map_f64(long begin, long end, void *acc, void *user_ctx) {
+    const node_ctx_t *ctx = (const node_ctx_t *)user_ctx;
+    mixed_acc_t *m = (mixed_acc_t *)acc;
+    double xs[EXPR_BLOCK];
+    double ys[EXPR_BLOCK];
+    long i;
+
+    for (i = begin; i <= end && distr_task_cancelled() == 0;) {
+        int cnt = (end - i + 1 < EXPR_BLOCK) ? (int)(end - i + 1) : EXPR_BLOCK;
+        double part = 0.0;
+        double mag = 0.0;
+        int k;
+        for (k = 0; k < cnt; ++k) {
+            xs[k] = ctx->a + (double)(i + k) * ctx->h;
+        }
+        fn_eval(&ctx->fn, xs, ys, cnt);
+        for (k = 0; k < cnt; ++k) {
+            part += ys[k];
+            mag += fabs(ys[k]);
+        }
+        if (i == begin) {
+            part -= 0.5 * ys[0];
+        }
+        if (i + cnt - 1 == end) {
+            part -= 0.5 * ys[cnt - 1];
+        }
+        distr_sum_add(&m->sum, part);
+        m->abs_sum += mag;
+        i += cnt;
+    }
 }
 
-static double be64_to_double(uint64_t be) {
-    uint64_t u = be64_to_host(be);
-    double d = 0.0;
-    memcpy(&d, &u, sizeof(d));
-    return d;
+static void mixed_combine(void *acc, const void *other, void *user_ctx) {
+    mixed_acc_t *m = (mixed_acc_t *)acc;
+    const mixed_acc_t *o = (const mixed_acc_t *)other;
+    (void)user_ctx;
+    distr_sum_merge(&m->sum, &o->sum);
+    m->abs_sum += o->abs_sum;
+    if (o->max_dev > m->max_dev) {
+        m->max_dev = o->max_dev;
+    }
 }
 
-static void *thr_run(void *arg) {
-    thr_ctx_t *ctx = (thr_ctx_t *)arg;
+static void node_map(long begin, long end, void *acc, void *user_ctx) {
+    const node_ctx_t *ctx = (const node_ctx_t *)user_ctx;
+    double xs[EXPR_BLOCK];
+    double ys[EXPR_BLOCK];
     double sum = 0.0;
+    double first = 0.0;
+    double last = 0.0;
+    long i_end = (ctx->midpoint != 0) ? end - 1L : end;
     long i;
 
-    for (i = ctx->i_begin; i < ctx->i_end; ++i) {
-        {
-            double x1 = ctx->a + (double)i * ctx->h;
-            double x2 = x1 + ctx->h;
-            sum += 0.5 * (f(x1) + f(x2)) * ctx->h;
+    for (i = begin; i <= i_end && distr_task_cancelled() == 0;) {
+        int cnt = (i_end - i + 1 < EXPR_BLOCK) ? (int)(i_end - i + 1) : EXPR_BLOCK;
+        double part = 0.0;
+        int k;
+        for (k = 0; k < cnt; ++k) {
+            xs[k] = ctx->a + (double)(i + k) * ctx->h;
+        }
+        fn_eval(&ctx->fn, xs, ys, cnt);
+        for (k = 0; k < cnt; ++k) {
+            part += ys[k];
+        }
+        if (i == begin) {
+            first = ys[0];
+        }
+        last = ys[cnt - 1];
+        sum += part;
+        i += cnt;
+    }
+    if (ctx->midpoint != 0) {
+        distr_sum_add((distr_sum_t *)acc, sum * ctx->h);
+    } else {
+        distr_sum_add((distr_sum_t *)acc, (sum - 0.5 * (first + last)) * ctx->h);
+    }
+}
+
+static void sum_combine(void *acc, const void *other, void *user_ctx) {
+    (void)user_ctx;
+    distr_sum_merge((distr_sum_t *)acc, (const distr_sum_t *)other);
+}
+
+static distr_reduce_t node_reduce(node_ctx_t *ctx, double a, double b, long n, int midpoint) {
+    distr_reduce_t r;
+    ctx->h = (n > 0L) ? (b - a) / (double)n : 0.0;
+    ctx->a = (midpoint != 0) ? a + 0.5 * ctx->h : a;
+    ctx->midpoint = midpoint;
+    r.acc_size = sizeof(distr_sum_t);
+    r.init = NULL;
+    r.map = node_map;
+    r.combine = sum_combine;
+    r.user_ctx = ctx;
+    return r;
+}
+
+static double node_sum(const integral_fn_t *fn, double a, double b, long n, int threads, int midpoint) {
+    node_ctx_t ctx;
+    distr_reduce_t r;
+    distr_sum_t acc;
+
+    if (n <= 0L || b <= a) {
+        return 0.0;
+    }
+    ctx.fn = *fn;
+    r = node_reduce(&ctx, a, b, n, midpoint);
+    if (distr_map_reduce(&r, n, threads, &acc) != 0) {
+        return 0.0;
+    }
+    return distr_sum_value(&acc);
+}
+
+double integrate_trapz(const integral_fn_t *fn, double a, double b, long n, int threads) {
+    return node_sum(fn, a, b, n, threads, 0);
+}
+
+double integrate_midpoint(const integral_fn_t *fn, double a, double b, long n, int threads) {
+    return node_sum(fn, a, b, n, threads, 1);
+}
+
+static void *sweep_thr_run(void *arg) {
+    sweep_thr_ctx_t *ctx = (sweep_thr_ctx_t *)arg;
+    double xs[EXPR_BLOCK];
+    double ps[EXPR_BLOCK];
+    double ws[EXPR_BLOCK];
+    double ys[EXPR_BLOCK];
+    int qs[EXPR_BLOCK];
+    const double *vars[2];
+    long i = ctx->i_begin;
+    int q = 0;
+
+    distr_task_bind(ctx->task);
+    vars[0] = xs;
+    vars[1] = ps;
+    while (i <= ctx->i_end && distr_task_cancelled() == 0) {
+        double x = ctx->a + (double)i * ctx->h;
+        double w = (i == ctx->i_begin || i == ctx->i_end) ? 0.5 : 1.0;
+        int cnt = 0;
+        int k;
+        while (cnt < EXPR_BLOCK && i <= ctx->i_end) {
+            xs[cnt] = x;
+            ps[cnt] = ctx->params[q];
+            ws[cnt] = w;
+            qs[cnt] = q;
+            ++cnt;
+            if (++q == ctx->count) {
+                q = 0;
+                ++i;
+                x = ctx->a + (double)i * ctx->h;
+                w = (i == ctx->i_end) ? 0.5 : 1.0;
+            }
+        }
+        integral_fn_eval(ctx->fn, vars, ys, cnt);
+        for (k = 0; k < cnt; ++k) {
+            ctx->acc[qs[k]] += ws[k] * ys[k];
         }
     }
-    *ctx->out_partial = sum;
     return NULL;
 }
 
-double integrate_trapz(double a, double b, long n, int threads) {
+int integrate_trapz_sweep(const integral_fn_t *fn,
+                          double a,
+                          double b,
+                          long n,
+                          int threads,
+                          const double *params,
+                          int count,
+                          double *out) {
+    expr_prog_t prog;
+    integral_fn_t bound;
     pthread_t *ths = NULL;
-    thr_ctx_t *ctxs = NULL;
-    double *parts = NULL;
-    double res = 0.0;
+    sweep_thr_ctx_t *ctxs = NULL;
+    double *acc = NULL;
     double h;
     long base;
     long rem;
+    long cursor = 0L;
     int t;
+    int q;
 
+    if (fn == NULL || params == NULL || out == NULL || count < 1) {
+        return -1;
+    }
+    if (fn->prog == NULL) {
+        double val = integrate_trapz(fn, a, b, n, threads);
+        for (q = 0; q < count; ++q) {
+            out[q] = val;
+        }
+        return 0;
+    }
+    memset(out, 0, (size_t)count * sizeof(*out));
     if (n <= 0L || b <= a) {
-        return 0.0;
+        return 0;
+    }
+    prog = *fn->prog;
+    if (prog.nvars > 1 || expr_bind_param(&prog, 0, 1) != 0) {
+        return -1;
     }
+    bound = *fn;
+    bound.prog = &prog;
     if (threads < 1) {
         threads = 1;
     }
     if ((long)threads > n) {
         threads = (int)n;
     }
-
     h = (b - a) / (double)n;
 
     ths = (pthread_t *)calloc((size_t)threads, sizeof(*ths));
-    ctxs = (thr_ctx_t *)calloc((size_t)threads, sizeof(*ctxs));
-    parts = (double *)calloc((size_t)threads, sizeof(*parts));
-    if (ths == NULL || ctxs == NULL || parts == NULL) {
+    ctxs = (sweep_thr_ctx_t *)calloc((size_t)threads, sizeof(*ctxs));
+    acc = (double *)calloc((size_t)threads * (size_t)count, sizeof(*acc));
+    if (ths == NULL || ctxs == NULL || acc == NULL) {
         free(ths);
         free(ctxs);
-        free(parts);
-        return 0.0;
+        free(acc);
+        return -1;
     }
-
     base = n / threads;
     rem = n % threads;
-    {
-        long cursor = 0L;
-        for (t = 0; t < threads; ++t) {
-            long span = base + ((t < rem) ? 1L : 0L);
-            ctxs[t].a = a;
-            ctxs[t].h = h;
-            ctxs[t].i_begin = cursor;
-            ctxs[t].i_end = cursor + span;
-            ctxs[t].out_partial = &parts[t];
-            cursor += span;
-            (void)pthread_create(&ths[t], NULL, thr_run, &ctxs[t]);
-        }
+    for (t = 0; t < threads; ++t) {
+        long span = base + ((t < rem) ? 1L : 0L);
+        ctxs[t].fn = &bound;
+        ctxs[t].a = a;
+        ctxs[t].h = h;
+        ctxs[t].i_begin = cursor;
+        ctxs[t].i_end = cursor + span;
+        ctxs[t].params = params;
+        ctxs[t].count = count;
+        ctxs[t].acc = acc + (size_t)t * (size_t)count;
+        ctxs[t].task = distr_task_current();
+        cursor += span;
+        (void)pthread_create(&ths[t], NULL, sweep_thr_run, &ctxs[t]);
     }
     for (t = 0; t < threads; ++t) {
         (void)pthread_join(ths[t], NULL);
-        res += parts[t];
+        for (q = 0; q < count; ++q) {
+            out[q] += ctxs[t].acc[q];
+        }
+    }
+    for (q = 0; q < count; ++q) {
+        out[q] *= h;
     }
 
     free(ths);
     free(ctxs);
-    free(parts);
-    return res;
+    free(acc);
+    return 0;
 }
 
-int integral_manager_ctx_init(integral_manager_ctx_t *ctx, int required_workers, integral_job_t job) {
-    if (ctx == NULL || required_workers < 1 || job.n < 1 || job.b <= job.a) {
-        return -1;
+double integrate_gk15(const integral_fn_t *fn, double a, double b, double *abserr) {
+    double c = 0.5 * (a + b);
+    double hl = 0.5 * (b - a);
+    double xs[15];
+    double ys[15];
+    double fc;
+    double resg;
+    double resk;
+    double reskh;
+    double resasc;
+    double err;
+    int j;
+
+    xs[14] = c;
+    for (j = 0; j < 7; ++j) {
+        double dx = hl * gk15_xgk[j];
+        xs[2 * j] = c - dx;
+        xs[2 * j + 1] = c + dx;
     }
-    memset(ctx, 0, sizeof(*ctx));
-    ctx->required_workers = required_workers;
-    ctx->job = job;
-    ctx->next_left = job.a;
-    ctx->worker_cores = (int *)calloc((size_t)required_workers, sizeof(*ctx->worker_cores));
-    if (ctx->worker_cores == NULL) {
-        integral_manager_ctx_free(ctx);
-        return -1;
+    fn_eval(fn, xs, ys, 15);
+    fc = ys[14];
+    resg = fc * gk15_wg[3];
+    resk = fc * gk15_wgk[7];
+    for (j = 0; j < 7; ++j) {
+        double pair = ys[2 * j] + ys[2 * j + 1];
+        resk += gk15_wgk[j] * pair;
+        if ((j & 1) != 0) {
+            resg += gk15_wg[j / 2] * pair;
+        }
     }
-    return 0;
+    reskh = 0.5 * resk;
+    resasc = gk15_wgk[7] * fabs(fc - reskh);
+    for (j = 0; j < 7; ++j) {
+        resasc += gk15_wgk[j] * (fabs(ys[2 * j] - reskh) + fabs(ys[2 * j + 1] - reskh));
+    }
+    resasc *= fabs(hl);
+    err = fabs((resk - resg) * hl);
+    if (resasc != 0.0 && err != 0.0) {
+        double scale = pow(200.0 * err / resasc, 1.5);
+        err = resasc * ((scale < 1.0) ? scale : 1.0);
+    }
+    if (abserr != NULL) {
+        *abserr = err;
+    }
+    return resk * hl;
 }
 
-void integral_manager_ctx_free(integral_manager_ctx_t *ctx) {
-    if (ctx == NULL) {
-        return;
+static size_t encode_fn(const expr_prog_t *prog, const double *params, uint8_t *out, size_t out_sz) {
+    size_t off = fn_expr_wire_size();
+    size_t code_len = 0U;
+    int k;
+
+    if (out_sz < off) {
+        return 0U;
     }
-    free(ctx->worker_cores);
-    ctx->worker_cores = NULL;
+    fn_expr_wire_init(out, WIRE_FN_EXPR);
+    if (prog != NULL) {
+        fn_expr_wire_set_nparams(out, (uint8_t)prog->nparams);
+        for (k = 0; k < prog->nparams; ++k) {
+            fn_expr_wire_set_params(out, (size_t)k, params[k]);
+        }
+        code_len = expr_encode(prog, out + off, out_sz - off);
+        if (code_len == 0U) {
+            return 0U;
+        }
+        off += code_len;
+    }
+    fn_expr_wire_set_code_len(out, (uint16_t)code_len);
+    return off;
 }
 
-static int cb_on_worker_hello(int worker_index, const uint8_t *hello_payload, size_t hello_payload_len, void *user_ctx) {
-    integral_manager_ctx_t *ctx = (integral_manager_ctx_t *)user_ctx;
-    hello_msg_t hello;
-    int cores;
-    if (ctx == NULL || worker_index < 0 || worker_index >= ctx->required_workers) {
-        return -1;
+static size_t encode_kernel(const char *name, const double *params, uint8_t *out, size_t out_sz) {
+    size_t name_len = strlen(name);
+    int k;
+
+    if (name_len == 0U || name_len > INTEGRAL_KERNEL_NAME_MAX || out_sz < fn_kernel_wire_size() + name_len) {
+        return 0U;
     }
-    if (hello_payload == NULL || hello_payload_len != sizeof(hello)) {
-        return -1;
+    fn_kernel_wire_init(out, WIRE_FN_KERNEL);
+    fn_kernel_wire_set_name_len(out, (uint8_t)name_len);
+    fn_kernel_wire_set_nparams(out, (uint8_t)EXPR_MAX_PARAMS);
+    for (k = 0; k < EXPR_MAX_PARAMS; ++k) {
+        fn_kernel_wire_set_params(out, (size_t)k, params[k]);
     }
-    memcpy(&hello, hello_payload, sizeof(hello));
-    cores = (int)ntohl(hello.cores_be);
-    if (cores < 1) {
-        cores = 1;
+    memcpy(out + fn_kernel_wire_size(), name, name_len);
+    return fn_kernel_wire_size() + name_len;
+}
+
+static const integral_kernel_t *find_kernel(const char *name, size_t name_len) {
+    int k;
+    for (k = 0; k < g_kernel_count; ++k) {
+        if (strlen(g_kernels[k]->name) == name_len && memcmp(g_kernels[k]->name, name, name_len) == 0) {
+            return g_kernels[k];
+        }
     }
-    ctx->worker_cores[worker_index] = cores;
-    ctx->total_cores += cores;
-    return 0;
+    return NULL;
 }
 
-static int cb_build_task(int worker_index,
-                         uint8_t *task_payload,
-                         size_t task_payload_sz,
-                         size_t *task_payload_len,
-                         void *user_ctx) {
-    integral_manager_ctx_t *ctx = (integral_manager_ctx_t *)user_ctx;
-    task_msg_t msg;
-    double right;
-    long ni;
-    if (ctx == NULL || task_payload == NULL || task_payload_len == NULL || task_payload_sz < sizeof(msg) ||
-        worker_index < 0 || worker_index >= ctx->required_workers || ctx->total_cores < 1) {
+int integral_kernels_load(const char *dir) {
+    DIR *d;
+    struct dirent *ent;
+
+    if (dir == NULL) {
         return -1;
     }
-
-    ctx->prefix_cores += ctx->worker_cores[worker_index];
-    if (worker_index == ctx->required_workers - 1) {
-        right = ctx->job.b;
-        ni = ctx->job.n - ctx->assigned_n;
-    } else {
-        right = ctx->job.a +
-                (ctx->job.b - ctx->job.a) * ((double)ctx->prefix_cores / (double)ctx->total_cores);
-        ni = (long)((double)ctx->job.n * ((double)ctx->worker_cores[worker_index] / (double)ctx->total_cores));
-        if (ni < 1) {
-            ni = 1;
+    d = opendir(dir);
+    if (d == NULL) {
+        perror(dir);
+        return -1;
+    }
+    while ((ent = readdir(d)) != NULL && g_kernel_count < INTEGRAL_KERNELS_MAX) {
+        char path[4096];
+        size_t len = strlen(ent->d_name);
+        const integral_kernel_t *k;
+        void *h;
+        if (len < 4U || strcmp(ent->d_name + len - 3U, ".so") != 0) {
+            continue;
+        }
+        if (snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) >= (int)sizeof(path)) {
+            continue;
         }
-        if (ctx->assigned_n + ni > ctx->job.n) {
-            ni = ctx->job.n - ctx->assigned_n;
+        h = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (h == NULL) {
+            fprintf(stderr, "[integral] %s\n", dlerror());
+            continue;
         }
+        k = (const integral_kernel_t *)dlsym(h, INTEGRAL_KERNEL_SYMBOL);
+        if (k == NULL || k->abi_version != INTEGRAL_KERNEL_ABI || k->name == NULL || k->integrate == NULL ||
+            strlen(k->name) == 0U || strlen(k->name) > INTEGRAL_KERNEL_NAME_MAX ||
+            find_kernel(k->name, strlen(k->name)) != NULL) {
+            fprintf(stderr, "[integral] %s is not a compatible kernel\n", path);
+            (void)dlclose(h);
+            continue;
+        }
+        g_kernel_handles[g_kernel_count] = h;
+        g_kernels[g_kernel_count] = k;
+        ++g_kernel_count;
+        fprintf(stderr, "[integral] kernel %s loaded from %s\n", k->name, path);
     }
-    ctx->assigned_n += ni;
-    msg.id_be = htonl((uint32_t)worker_index);
-    msg.a_be = double_to_be64(ctx->next_left);
-    msg.b_be = double_to_be64(right);
-    msg.n_be = host_to_be64((uint64_t)(int64_t)ni);
-    msg.threads_be = htonl((uint32_t)ctx->worker_cores[worker_index]);
-    memcpy(task_payload, &msg, sizeof(msg));
-    *task_payload_len = sizeof(msg);
-    ctx->next_left = right;
-    return 0;
+    closedir(d);
+    return g_kernel_count;
 }
 
-static int cb_on_worker_result(int worker_index,
-                               const uint8_t *result_payload,
-                               size_t result_payload_len,
-                               void *user_ctx) {
-    integral_manager_ctx_t *ctx = (integral_manager_ctx_t *)user_ctx;
-    result_msg_t msg;
-    int id;
-    double val;
-    (void)worker_index;
-    if (ctx == NULL) {
+void integral_kernels_unload(void) {
+    while (g_kernel_count > 0) {
+        --g_kernel_count;
+        (void)dlclose(g_kernel_handles[g_kernel_count]);
+        g_kernel_handles[g_kernel_count] = NULL;
+        g_kernels[g_kernel_count] = NULL;
+    }
+}
+
+static size_t encode_table_fn(int blob, double lo, double hi, uint8_t *out, size_t out_sz) {
+    if (out_sz < fn_table_wire_size()) {
+        return 0U;
+    }
+    fn_table_wire_init(out, WIRE_FN_TABLE);
+    fn_table_wire_set_blob(out, (uint32_t)blob);
+    fn_table_wire_set_lo(out, lo);
+    fn_table_wire_set_hi(out, hi);
+    return fn_table_wire_size();
+}
+
+static int decode_table_fn(const uint8_t *in, size_t in_len, int dims, integral_fn_t *fn) {
+    const uint8_t *data;
+    size_t size;
+    if (dims != 1 || fn_table_wire_check(in, in_len) != 0) {
         return -1;
     }
-    if (result_payload == NULL || result_payload_len != sizeof(msg)) {
+    if (distr_blob_get((int)fn_table_wire_get_blob(in), &data, &size) != 0 || size % sizeof(double) != 0U ||
+        size < 2U * sizeof(double)) {
         return -1;
     }
-    memcpy(&msg, result_payload, sizeof(msg));
-    id = (int)ntohl(msg.id_be);
-    val = be64_to_double(msg.value_be);
-    if (id < 0 || id >= ctx->required_workers) {
+    fn->table = (const double *)(const void *)data;
+    fn->table_len = (long)(size / sizeof(double));
+    fn->table_lo = fn_table_wire_get_lo(in);
+    fn->table_hi = fn_table_wire_get_hi(in);
+    return (fn->table_hi > fn->table_lo) ? 0 : -1;
+}
+
+static int decode_fn(const uint8_t *in, size_t in_len, int dims, expr_prog_t *prog, integral_fn_t *fn) {
+    const uint8_t *code;
+    size_t code_len;
+    int nparams;
+    int k;
+
+    memset(fn, 0, sizeof(*fn));
+    if (in_len < DISTR_WIRE_HDR_SZ) {
         return -1;
     }
-    ctx->total += val;
+    if (distr_wire_tag(in) == WIRE_FN_TABLE) {
+        return decode_table_fn(in, in_len, dims, fn);
+    }
+    if (distr_wire_tag(in) != WIRE_FN_EXPR || fn_expr_wire_check(in, in_len) != 0) {
+        return -1;
+    }
+    code = fn_expr_wire_tail(in);
+    code_len = (size_t)fn_expr_wire_get_code_len(in);
+    nparams = (int)fn_expr_wire_get_nparams(in);
+    if (nparams > EXPR_MAX_PARAMS || (size_t)(code - in) + code_len != in_len) {
+        return -1;
+    }
+    if (code_len == 0U) {
+        return 0;
+    }
+    for (k = 0; k < nparams; ++k) {
+        fn->params[k] = fn_expr_wire_get_params(in, (size_t)k);
+    }
+    if (expr_decode(code, code_len, prog) != 0 || prog->nparams > nparams || prog->nvars > dims) {
+        return -1;
+    }
+    fn->prog = prog;
     return 0;
 }
 
-manager_ops_t integral_manager_ops(integral_manager_ctx_t *ctx) {
-    manager_ops_t ops;
-    ops.on_worker_hello = cb_on_worker_hello;
-    ops.build_task = cb_build_task;
-    ops.on_worker_result = cb_on_worker_result;
-    ops.user_ctx = ctx;
-    return ops;
+static double seg_key(const integral_segment_t *s) {
+    return (s->evaluated != 0) ? s->error : HUGE_VAL;
 }
 
-static int cb_build_hello(uint8_t *out,
-                          size_t out_sz,
-                          size_t *out_len,
-                          const worker_cfg_t *wcfg,
-                          void *user_ctx) {
-    hello_msg_t msg;
-    (void)user_ctx;
-    if (out == NULL || out_len == NULL || wcfg == NULL || out_sz < sizeof(msg)) {
+static void heap_push(integral_adapt_t *ad, integral_segment_t seg) {
+    long i = ad->heap_len++;
+    while (i > 0) {
+        long parent = (i - 1) / 2;
+        if (seg_key(&ad->heap[parent]) >= seg_key(&seg)) {
+            break;
+        }
+        ad->heap[i] = ad->heap[parent];
+        i = parent;
+    }
+    ad->heap[i] = seg;
+    if (seg.evaluated != 0) {
+        ad->heap_err += seg.error;
+    } else {
+        ++ad->unevaluated;
+    }
+}
+
+static integral_segment_t heap_pop(integral_adapt_t *ad) {
+    integral_segment_t top = ad->heap[0];
+    integral_segment_t last = ad->heap[--ad->heap_len];
+    long i = 0;
+    for (;;) {
+        long child = 2 * i + 1;
+        if (child >= ad->heap_len) {
+            break;
+        }
+        if (child + 1 < ad->heap_len && seg_key(&ad->heap[child + 1]) > seg_key(&ad->heap[child])) {
+            ++child;
+        }
+        if (seg_key(&ad->heap[child]) <= seg_key(&last)) {
+            break;
+        }
+        ad->heap[i] = ad->heap[child];
+        i = child;
+    }
+    if (ad->heap_len > 0) {
+        ad->heap[i] = last;
+    }
+    if (top.evaluated != 0) {
+        ad->heap_err -= top.error;
+    } else {
+        --ad->unevaluated;
+    }
+    return top;
+}
+
+static int adapt_init(integral_adapt_t *ad, int required_workers, long max_segments) {
+    ad->heap_cap = max_segments;
+    ad->heap = (integral_segment_t *)calloc((size_t)max_segments, sizeof(*ad->heap));
+    ad->pending = (integral_segment_t *)calloc((size_t)required_workers * INTEGRAL_ADAPT_BATCH, sizeof(*ad->pending));
+    ad->pending_count = (int *)calloc((size_t)required_workers, sizeof(*ad->pending_count));
+    ad->pending_err = (double *)calloc((size_t)required_workers, sizeof(*ad->pending_err));
+    if (ad->heap == NULL || ad->pending == NULL || ad->pending_count == NULL || ad->pending_err == NULL) {
         return -1;
     }
-    msg.cores_be = htonl((uint32_t)wcfg->max_cores);
-    memcpy(out, &msg, sizeof(msg));
-    *out_len = sizeof(msg);
     return 0;
 }
 
-static int cb_execute_task(const uint8_t *task_payload,
-                           size_t task_payload_len,
-                           uint8_t *result_payload,
-                           size_t result_payload_sz,
-                           size_t *result_payload_len,
-                           uint8_t *error_payload,
-                           size_t error_payload_sz,
-                           size_t *error_payload_len,
-                           void *user_ctx) {
-    task_msg_t task;
-    result_msg_t out;
-    int id;
-    double a;
-    double b;
-    long n;
-    int threads;
-    double val;
-    const worker_cfg_t *wcfg = (const worker_cfg_t *)user_ctx;
+static void adapt_free(integral_adapt_t *ad) {
+    free(ad->heap);
+    free(ad->pending);
+    free(ad->pending_count);
+    free(ad->pending_err);
+    memset(ad, 0, sizeof(*ad));
+}
 
-    if (task_payload == NULL || task_payload_len != sizeof(task) || result_payload == NULL ||
-        result_payload_len == NULL || error_payload == NULL || error_payload_len == NULL || wcfg == NULL) {
+static void adapt_seed(integral_manager_ctx_t *ctx) {
+    integral_adapt_t *ad = &ctx->adapt;
+    long pieces = (long)ctx->required_workers * INTEGRAL_ADAPT_BATCH;
+    double width;
+    long k;
+    if (pieces > ad->heap_cap) {
+        pieces = ad->heap_cap;
+    }
+    width = (ctx->job.b - ctx->job.a) / (double)pieces;
+    for (k = 0; k < pieces; ++k) {
+        integral_segment_t seg;
+        memset(&seg, 0, sizeof(seg));
+        seg.a = ctx->job.a + (double)k * width;
+        seg.b = (k == pieces - 1) ? ctx->job.b : seg.a + width;
+        heap_push(ad, seg);
+    }
+    ad->seeded = 1;
+}
+
+static int adapt_converged(const integral_manager_ctx_t *ctx) {
+    const integral_adapt_t *ad = &ctx->adapt;
+    return ad->unevaluated == 0 && ad->heap_err + ad->pending_err_sum <= ctx->job.tol;
+}
+
+static void adapt_finish(integral_manager_ctx_t *ctx) {
+    const integral_adapt_t *ad = &ctx->adapt;
+    double total = 0.0;
+    double error = 0.0;
+    long k;
+    for (k = 0; k < ad->heap_len; ++k) {
+        total += ad->heap[k].value;
+        error += ad->heap[k].error;
+    }
+    ctx->total = total;
+    ctx->error = error;
+}
+
+static int mode_is_sampling(integral_mode_t mode) {
+    return mode == INTEGRAL_MODE_MC || mode == INTEGRAL_MODE_QMC;
+}
+
+int integral_manager_ctx_init(integral_manager_ctx_t *ctx, int required_workers, integral_job_t job) {
+    int d;
+    if (ctx == NULL || required_workers < 1 || job.n < 1) {
         return -1;
     }
-    if (result_payload_sz < sizeof(out)) {
+    if (mode_is_sampling(job.mode)) {
+        if (job.dims < 1 || job.dims > INTEGRAL_MAX_DIMS) {
+            return -1;
+        }
+        for (d = 0; d < job.dims; ++d) {
+            if (job.hi[d] <= job.lo[d]) {
+                return -1;
+            }
+        }
+    } else {
+        if (job.b <= job.a) {
+            return -1;
+        }
+        job.dims = 1;
+    }
+    if (job.mode == INTEGRAL_MODE_ADAPTIVE && (job.tol <= 0.0 || job.n < 2)) {
         return -1;
     }
-    memcpy(&task, task_payload, sizeof(task));
-    id = (int)ntohl(task.id_be);
-    a = be64_to_double(task.a_be);
-    b = be64_to_double(task.b_be);
-    n = (long)(int64_t)be64_to_host(task.n_be);
-    threads = (int)ntohl(task.threads_be);
-    if (threads < 1) {
-        threads = 1;
+    if (job.sweep_len < 0 || job.sweep_len > INTEGRAL_SWEEP_MAX ||
+        (job.sweep_len > 0 && (job.sweep == NULL || job.mode != INTEGRAL_MODE_FIXED))) {
+        return -1;
     }
-    if (threads > wcfg->max_cores) {
-        threads = wcfg->max_cores;
+    if (job.kernel != NULL && (job.mode != INTEGRAL_MODE_FIXED || job.expr != NULL || job.sweep_len > 0)) {
+        return -1;
+    }
+    if (job.use_table != 0 &&
+        (job.expr != NULL || job.kernel != NULL || job.sweep_len > 0 || job.table_hi <= job.table_lo ||
+         (mode_is_sampling(job.mode) && job.dims != 1))) {
+        return -1;
+    }
+    if (job.progressive != 0 &&
+        (job.mode != INTEGRAL_MODE_FIXED || job.kernel != NULL || job.sweep_len > 0 || job.tol <= 0.0)) {
+        return -1;
+    }
+    if (job.precision != 0 && (job.mode != INTEGRAL_MODE_FIXED || job.kernel != NULL || job.sweep_len > 0 ||
+                               job.progressive != 0 || job.precision_tol < 0.0)) {
+        return -1;
+    }
+    if (job.mode == INTEGRAL_MODE_HIST && (job.kernel != NULL || job.sweep_len > 0 || job.hist_bins < 1 ||
+                                           job.hist_bins > DISTR_HIST_MAX_BINS || job.hist_hi <= job.hist_lo)) {
+        return -1;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    distr_moments_init(&ctx->moments);
+    if (job.mode == INTEGRAL_MODE_HIST) {
+        (void)distr_hist_init(&ctx->hist, job.hist_lo, job.hist_hi, job.hist_bins);
+    }
+    ctx->required_workers = required_workers;
+    ctx->job = job;
+    ctx->next_left = job.a;
+    if (job.expr != NULL) {
+        char err[128];
+        if (expr_compile(job.expr, &ctx->prog, err, sizeof(err)) != 0) {
+            fprintf(stderr, "[integral] bad expression: %s\n", err);
+            return -1;
+        }
+        if (ctx->prog.nvars > job.dims) {
+            fprintf(stderr, "[integral] expression uses x%d but job has %d dimension(s)\n",
+                    ctx->prog.nvars - 1, job.dims);
+            return -1;
+        }
+        ctx->has_prog = 1;
+    }
+    if (mode_is_sampling(job.mode)) {
+        long tasks = (long)required_workers * INTEGRAL_MC_TASKS_PER_WORKER;
+        ctx->mc.tasks_total = (int)((tasks < job.n) ? tasks : job.n);
+    }
+    if (job.kernel != NULL) {
+        ctx->fn_wire_len = encode_kernel(job.kernel, job.params, ctx->fn_wire, sizeof(ctx->fn_wire));
+    } else if (job.use_table != 0) {
+        ctx->fn_wire_len = encode_table_fn(job.table_blob, job.table_lo, job.table_hi, ctx->fn_wire,
+                                           sizeof(ctx->fn_wire));
+    } else {
+        ctx->fn_wire_len = encode_fn((ctx->has_prog != 0) ? &ctx->prog : NULL, job.params, ctx->fn_wire,
+                                     sizeof(ctx->fn_wire));
+    }
+    if (ctx->fn_wire_len == 0U) {
+        return -1;
+    }
+    ctx->worker_cores = (int *)calloc((size_t)required_workers, sizeof(*ctx->worker_cores));
+    ctx->worker_weight = (double *)calloc((size_t)required_workers, sizeof(*ctx->worker_weight));
+    ctx->worker_host = calloc((size_t)required_workers, sizeof(*ctx->worker_host));
+    ctx->worker_task_us = (uint64_t *)calloc((size_t)required_workers, sizeof(*ctx->worker_task_us));
+    ctx->worker_task_n = (long *)calloc((size_t)required_workers, sizeof(*ctx->worker_task_n));
+    if (ctx->worker_cores == NULL || ctx->worker_weight == NULL || ctx->worker_host == NULL ||
+        ctx->worker_task_us == NULL || ctx->worker_task_n == NULL) {
+        integral_manager_ctx_free(ctx);
+        return -1;
+    }
+    if (job.mode == INTEGRAL_MODE_ADAPTIVE && adapt_init(&ctx->adapt, required_workers, job.n) != 0) {
+        integral_manager_ctx_free(ctx);
+        return -1;
+    }
+    if (job.sweep_len > 0) {
+        ctx->sweep_totals = (double *)calloc((size_t)job.sweep_len, sizeof(*ctx->sweep_totals));
+        if (ctx->sweep_totals == NULL) {
+            integral_manager_ctx_free(ctx);
+            return -1;
+        }
+    }
+    if (job.progressive != 0) {
+        integral_prog_t *pg = &ctx->prog_state;
+        pg->hist = (double *)calloc((size_t)required_workers * 3U, sizeof(*pg->hist));
+        pg->levels = (int *)calloc((size_t)required_workers, sizeof(*pg->levels));
+        pg->est = (double *)calloc((size_t)required_workers, sizeof(*pg->est));
+        pg->err = (double *)calloc((size_t)required_workers, sizeof(*pg->err));
+        if (pg->hist == NULL || pg->levels == NULL || pg->est == NULL || pg->err == NULL) {
+            integral_manager_ctx_free(ctx);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void integral_manager_ctx_free(integral_manager_ctx_t *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    free(ctx->worker_cores);
+    ctx->worker_cores = NULL;
+    free(ctx->worker_weight);
+    ctx->worker_weight = NULL;
+    free(ctx->worker_host);
+    ctx->worker_host = NULL;
+    free(ctx->worker_task_us);
+    ctx->worker_task_us = NULL;
+    free(ctx->worker_task_n);
+    ctx->worker_task_n = NULL;
+    free(ctx->sweep_totals);
+    ctx->sweep_totals = NULL;
+    adapt_free(&ctx->adapt);
+    free(ctx->prog_state.hist);
+    free(ctx->prog_state.levels);
+    free(ctx->prog_state.est);
+    free(ctx->prog_state.err);
+    memset(&ctx->prog_state, 0, sizeof(ctx->prog_state));
+}
+
+static int parse_hello(const uint8_t *hello_payload, size_t hello_payload_len, int *cores, char *host) {
+    size_t k;
+    if (hello_wire_check(hello_payload, hello_payload_len) != 0 || distr_wire_tag(hello_payload) != WIRE_HELLO) {
+        return -1;
+    }
+    *cores = (int)hello_wire_get_cores(hello_payload);
+    if (*cores < 1) {
+        *cores = 1;
+    }
+    for (k = 0; k < INTEGRAL_HOST_ID_MAX; ++k) {
+        host[k] = (char)hello_wire_get_host(hello_payload, k);
+    }
+    host[INTEGRAL_HOST_ID_MAX - 1] = '\0';
+    if (host[0] != '\0' && !integral_profile_host_ok(host)) {
+        fprintf(stderr, "[integral] worker host id is not printable, profile disabled for it\n");
+        host[0] = '\0';
+    }
+    return 0;
+}
+
+static void profile_sample(integral_profile_t *p, const char *host, int cores, long n, uint64_t start_us,
+                           uint64_t exec_us) {
+    uint64_t wall = now_us() - start_us;
+    if (p == NULL || n < 1 || cores < 1 || wall == 0U) {
+        return;
+    }
+    if (exec_us == 0U || exec_us > wall) {
+        exec_us = wall;
+    }
+    (void)integral_profile_record(p, host, (double)n * 1e6 / (double)exec_us / (double)cores,
+                                  (double)(wall - exec_us));
+}
+
+static int hello_has_kernel(const uint8_t *hello_payload, size_t hello_payload_len, const char *name) {
+    size_t off = (size_t)(hello_wire_tail(hello_payload) - hello_payload);
+    size_t name_len = strlen(name);
+    uint32_t k;
+    for (k = 0; k < hello_wire_get_kernel_count(hello_payload) && off < hello_payload_len; ++k) {
+        size_t len = hello_payload[off++];
+        if (off + len > hello_payload_len) {
+            return 0;
+        }
+        if (len == name_len && memcmp(hello_payload + off, name, len) == 0) {
+            return 1;
+        }
+        off += len;
+    }
+    return 0;
+}
+
+static int cb_on_worker_hello(int worker_index, const uint8_t *hello_payload, size_t hello_payload_len, void *user_ctx) {
+    integral_manager_ctx_t *ctx = (integral_manager_ctx_t *)user_ctx;
+    int cores;
+    if (ctx == NULL || worker_index < 0 || worker_index >= ctx->required_workers) {
+        return -1;
+    }
+    if (parse_hello(hello_payload, hello_payload_len, &cores, ctx->worker_host[worker_index]) != 0) {
+        return -1;
+    }
+    if (ctx->job.kernel != NULL && !hello_has_kernel(hello_payload, hello_payload_len, ctx->job.kernel)) {
+        fprintf(stderr, "[integral] worker has no kernel %s, rejected\n", ctx->job.kernel);
+        return -1;
+    }
+    ctx->worker_cores[worker_index] = cores;
+    ctx->total_cores += cores;
+    return 0;
+}
+
+static void plan_shares(integral_manager_ctx_t *ctx) {
+    const integral_profile_entry_t *e;
+    double known_rate = 0.0;
+    double known_overhead = 0.0;
+    double rate_sum = 0.0;
+    double lag = 0.0;
+    double t;
+    int known = 0;
+    int w;
+
+    ctx->total_weight = (double)ctx->total_cores;
+    for (w = 0; w < ctx->required_workers; ++w) {
+        ctx->worker_weight[w] = (double)ctx->worker_cores[w];
+        e = integral_profile_find(ctx->profile, ctx->worker_host[w]);
+        if (e != NULL) {
+            known_rate += e->rate;
+            known_overhead += e->overhead_us;
+            ++known;
+        }
+    }
+    if (known == 0) {
+        return;
+    }
+    for (w = 0; w < ctx->required_workers; ++w) {
+        e = integral_profile_find(ctx->profile, ctx->worker_host[w]);
+        ctx->worker_weight[w] = ((e != NULL) ? e->rate : known_rate / (double)known) * (double)ctx->worker_cores[w];
+        rate_sum += ctx->worker_weight[w];
+        lag += ctx->worker_weight[w] * 1e-6 * ((e != NULL) ? e->overhead_us : known_overhead / (double)known);
+    }
+    t = ((double)ctx->job.n + lag) / rate_sum;
+    ctx->total_weight = 0.0;
+    for (w = 0; w < ctx->required_workers; ++w) {
+        e = integral_profile_find(ctx->profile, ctx->worker_host[w]);
+        ctx->worker_weight[w] *= t - 1e-6 * ((e != NULL) ? e->overhead_us : known_overhead / (double)known);
+        if (ctx->worker_weight[w] < 1.0) {
+            ctx->worker_weight[w] = 1.0;
+        }
+        ctx->total_weight += ctx->worker_weight[w];
+    }
+    for (w = 0; w < ctx->required_workers; ++w) {
+        fprintf(stderr, "[integral] worker#%d host %s share %.1f%%%s\n", w, ctx->worker_host[w],
+                100.0 * ctx->worker_weight[w] / ctx->total_weight,
+                (integral_profile_find(ctx->profile, ctx->worker_host[w]) != NULL) ? "" : " (no profile)");
+    }
+}
+
+static int trapz_next_share(integral_manager_ctx_t *ctx, int worker_index, double *left, double *right, long *ni) {
+    if (ctx->tasks_built >= ctx->required_workers) {
+        return 1;
+    }
+    if (ctx->tasks_built == 0) {
+        plan_shares(ctx);
+    }
+    ++ctx->tasks_built;
+
+    ctx->prefix_weight += ctx->worker_weight[worker_index];
+    *left = ctx->next_left;
+    if (worker_index == ctx->required_workers - 1) {
+        *right = ctx->job.b;
+        *ni = ctx->job.n - ctx->assigned_n;
+    } else {
+        *right = ctx->job.a + (ctx->job.b - ctx->job.a) * (ctx->prefix_weight / ctx->total_weight);
+        *ni = (long)((double)ctx->job.n * (ctx->worker_weight[worker_index] / ctx->total_weight));
+        if (*ni < 1) {
+            *ni = 1;
+        }
+        if (ctx->assigned_n + *ni > ctx->job.n) {
+            *ni = ctx->job.n - ctx->assigned_n;
+        }
+    }
+    ctx->assigned_n += *ni;
+    ctx->next_left = *right;
+    return 0;
+}
+
+static int build_trapz_task(integral_manager_ctx_t *ctx,
+                            int worker_index,
+                            uint8_t *task_payload,
+                            size_t task_payload_sz,
+                            size_t *task_payload_len) {
+    uint32_t kind = TASK_KIND_TRAPZ;
+    double left;
+    double right;
+    long ni;
+    if (task_payload_sz < task_wire_size() + ctx->fn_wire_len) {
+        return -1;
+    }
+    if (trapz_next_share(ctx, worker_index, &left, &right, &ni) != 0) {
+        return DISTR_BUILD_DONE;
+    }
+    if (ctx->job.kernel != NULL) {
+        kind = TASK_KIND_KERNEL;
+    } else if (ctx->job.progressive != 0) {
+        kind = TASK_KIND_TRAPZ_PROG;
+    }
+    task_wire_init(task_payload, kind);
+    task_wire_set_id(task_payload, (uint32_t)worker_index);
+    task_wire_set_threads(task_payload, (uint32_t)ctx->worker_cores[worker_index]);
+    task_wire_set_a(task_payload, left);
+    task_wire_set_b(task_payload, right);
+    task_wire_set_n(task_payload, (int64_t)ni);
+    if (kind == TASK_KIND_TRAPZ && ctx->job.precision != 0) {
+        task_wire_set_precision(task_payload, TASK_PRECISION_F32);
+        task_wire_set_tol(task_payload, ctx->job.precision_tol * ((double)ni / (double)ctx->job.n));
+    }
+    memcpy(task_payload + task_wire_size(), ctx->fn_wire, ctx->fn_wire_len);
+    *task_payload_len = task_wire_size() + ctx->fn_wire_len;
+    ctx->worker_task_us[worker_index] = now_us();
+    ctx->worker_task_n[worker_index] = ni;
+    return 0;
+}
+
+static int build_hist_task(integral_manager_ctx_t *ctx,
+                           int worker_index,
+                           uint8_t *task_payload,
+                           size_t task_payload_sz,
+                           size_t *task_payload_len) {
+    size_t len = distr_group_wire_size();
+    double left;
+    double right;
+    long ni;
+    long parts;
+    long p;
+    if (task_payload_sz < len) {
+        return -1;
+    }
+    if (trapz_next_share(ctx, worker_index, &left, &right, &ni) != 0) {
+        return DISTR_BUILD_DONE;
+    }
+    distr_group_wire_init(task_payload, DISTR_WIRE_GROUP);
+    parts = (ni < INTEGRAL_HIST_GROUP) ? ni : INTEGRAL_HIST_GROUP;
+    for (p = 0; p < parts; ++p) {
+        long i0 = ni * p / parts;
+        long i1 = ni * (p + 1) / parts;
+        uint8_t *sub = distr_wire_group_add(task_payload, task_payload_sz, &len,
+                                            hist_task_wire_size() + ctx->fn_wire_len);
+        if (sub == NULL) {
+            return -1;
+        }
+        hist_task_wire_init(sub, TASK_KIND_HIST);
+        hist_task_wire_set_id(sub, (uint32_t)worker_index);
+        hist_task_wire_set_threads(sub, (uint32_t)ctx->worker_cores[worker_index]);
+        hist_task_wire_set_bins(sub, (uint32_t)ctx->job.hist_bins);
+        hist_task_wire_set_a(sub, left + (right - left) * ((double)i0 / (double)ni));
+        hist_task_wire_set_b(sub, (i1 == ni) ? right : left + (right - left) * ((double)i1 / (double)ni));
+        hist_task_wire_set_n(sub, (int64_t)(i1 - i0));
+        hist_task_wire_set_lo(sub, ctx->job.hist_lo);
+        hist_task_wire_set_hi(sub, ctx->job.hist_hi);
+        memcpy(sub + hist_task_wire_size(), ctx->fn_wire, ctx->fn_wire_len);
+    }
+    *task_payload_len = len;
+    return 0;
+}
+
+static int on_hist_result(integral_manager_ctx_t *ctx, const uint8_t *result_payload, size_t result_payload_len) {
+    distr_moments_t m;
+    distr_hist_t h;
+    uint32_t k;
+    if (hist_result_wire_check(result_payload, result_payload_len) != 0 ||
+        hist_result_wire_get_id(result_payload) >= (uint32_t)ctx->required_workers ||
+        hist_result_wire_get_bins(result_payload) != ctx->hist.bins) {
+        return -1;
+    }
+    m.count = hist_result_wire_get_count(result_payload);
+    m.min = hist_result_wire_get_min(result_payload);
+    m.max = hist_result_wire_get_max(result_payload);
+    m.mean = hist_result_wire_get_mean(result_payload);
+    m.m2 = hist_result_wire_get_m2(result_payload);
+    h = ctx->hist;
+    h.under = hist_result_wire_get_under(result_payload);
+    h.over = hist_result_wire_get_over(result_payload);
+    for (k = 0U; k < h.bins; ++k) {
+        h.count[k] = hist_result_wire_get_counts(result_payload, k);
+    }
+    distr_moments_merge(&ctx->moments, &m);
+    distr_hist_merge(&ctx->hist, &h);
+    return 0;
+}
+
+static int build_sweep_task(integral_manager_ctx_t *ctx,
+                            int worker_index,
+                            uint8_t *task_payload,
+                            size_t task_payload_sz,
+                            size_t *task_payload_len) {
+    size_t hdr_len = sweep_task_wire_size();
+    size_t params_len = (size_t)ctx->job.sweep_len * sizeof(double);
+    double left;
+    double right;
+    long ni;
+    int q;
+    if (task_payload_sz < hdr_len + params_len + ctx->fn_wire_len) {
+        return -1;
+    }
+    if (trapz_next_share(ctx, worker_index, &left, &right, &ni) != 0) {
+        return DISTR_BUILD_DONE;
+    }
+    sweep_task_wire_init(task_payload, TASK_KIND_SWEEP);
+    sweep_task_wire_set_id(task_payload, (uint32_t)worker_index);
+    sweep_task_wire_set_threads(task_payload, (uint32_t)ctx->worker_cores[worker_index]);
+    sweep_task_wire_set_count(task_payload, (uint32_t)ctx->job.sweep_len);
+    sweep_task_wire_set_a(task_payload, left);
+    sweep_task_wire_set_b(task_payload, right);
+    sweep_task_wire_set_n(task_payload, (int64_t)ni);
+    for (q = 0; q < ctx->job.sweep_len; ++q) {
+        distr_wire_store_f64(task_payload + hdr_len + (size_t)q * sizeof(double), ctx->job.sweep[q]);
+    }
+    memcpy(task_payload + hdr_len + params_len, ctx->fn_wire, ctx->fn_wire_len);
+    *task_payload_len = hdr_len + params_len + ctx->fn_wire_len;
+    return 0;
+}
+
+static int build_gk15_task(integral_manager_ctx_t *ctx,
+                           int worker_index,
+                           uint8_t *task_payload,
+                           size_t task_payload_sz,
+                           size_t *task_payload_len) {
+    integral_adapt_t *ad = &ctx->adapt;
+    integral_segment_t *slot = &ad->pending[(size_t)worker_index * INTEGRAL_ADAPT_BATCH];
+    size_t hdr_len = gk_task_wire_size();
+    int max_count;
+    int count = 0;
+    int k;
+
+    if (task_payload_sz < hdr_len + ctx->fn_wire_len || ad->pending_count[worker_index] != 0) {
+        return -1;
+    }
+    max_count = (int)((task_payload_sz - hdr_len - ctx->fn_wire_len) / (2U * sizeof(double)));
+    if (max_count > INTEGRAL_ADAPT_BATCH) {
+        max_count = INTEGRAL_ADAPT_BATCH;
+    }
+    if (max_count < 2) {
+        return -1;
+    }
+    if (ad->seeded == 0) {
+        adapt_seed(ctx);
+    }
+    while (count + 2 <= max_count && ad->heap_len > 0 && !adapt_converged(ctx)) {
+        integral_segment_t seg;
+        if (ad->heap[0].evaluated == 0) {
+            seg = heap_pop(ad);
+            slot[count++] = seg;
+            continue;
+        }
+        if (ad->heap_len + ad->pending_segments + count + 1 > ad->heap_cap ||
+            ad->heap[0].b - ad->heap[0].a <= 1e-12 * (fabs(ad->heap[0].a) + fabs(ad->heap[0].b))) {
+            break;
+        }
+        seg = heap_pop(ad);
+        ad->pending_err[worker_index] += seg.error;
+        ad->pending_err_sum += seg.error;
+        slot[count].a = seg.a;
+        slot[count].b = 0.5 * (seg.a + seg.b);
+        slot[count + 1].a = slot[count].b;
+        slot[count + 1].b = seg.b;
+        count += 2;
+    }
+    if (count == 0) {
+        if (ad->pending_tasks == 0) {
+            adapt_finish(ctx);
+            return DISTR_BUILD_DONE;
+        }
+        return DISTR_BUILD_WAIT;
+    }
+
+    gk_task_wire_init(task_payload, TASK_KIND_GK15);
+    gk_task_wire_set_id(task_payload, (uint32_t)worker_index);
+    gk_task_wire_set_threads(task_payload, (uint32_t)ctx->worker_cores[worker_index]);
+    gk_task_wire_set_count(task_payload, (uint32_t)count);
+    for (k = 0; k < count; ++k) {
+        distr_wire_store_f64(task_payload + hdr_len + (size_t)(2 * k) * sizeof(double), slot[k].a);
+        distr_wire_store_f64(task_payload + hdr_len + (size_t)(2 * k + 1) * sizeof(double), slot[k].b);
+    }
+    *task_payload_len = hdr_len + (size_t)count * 2U * sizeof(double);
+    memcpy(task_payload + *task_payload_len, ctx->fn_wire, ctx->fn_wire_len);
+    *task_payload_len += ctx->fn_wire_len;
+    ad->pending_count[worker_index] = count;
+    ad->pending_segments += count;
+    ++ad->pending_tasks;
+    return 0;
+}
+
+static int build_mc_task(integral_manager_ctx_t *ctx,
+                         int worker_index,
+                         uint8_t *task_payload,
+                         size_t task_payload_sz,
+                         size_t *task_payload_len) {
+    integral_mc_state_t *mc = &ctx->mc;
+    size_t off = mc_task_wire_size();
+    uint64_t ni;
+    int d;
+
+    if (task_payload_sz < off + (size_t)ctx->job.dims * 2U * sizeof(double) + ctx->fn_wire_len) {
+        return -1;
+    }
+    if (mc->next_task >= mc->tasks_total) {
+        return DISTR_BUILD_DONE;
+    }
+    ni = (uint64_t)ctx->job.n / (uint64_t)mc->tasks_total;
+    if (mc->next_task == mc->tasks_total - 1) {
+        ni = (uint64_t)ctx->job.n - mc->assigned;
+    }
+    mc_task_wire_init(task_payload, (ctx->job.mode == INTEGRAL_MODE_QMC) ? TASK_KIND_QMC : TASK_KIND_MC);
+    mc_task_wire_set_id(task_payload, (uint32_t)mc->next_task);
+    mc_task_wire_set_threads(task_payload, (uint32_t)ctx->worker_cores[worker_index]);
+    mc_task_wire_set_dims(task_payload, (uint32_t)ctx->job.dims);
+    mc_task_wire_set_n(task_payload, ni);
+    mc_task_wire_set_seed(task_payload, ctx->job.seed);
+    for (d = 0; d < ctx->job.dims; ++d) {
+        distr_wire_store_f64(task_payload + off, ctx->job.lo[d]);
+        distr_wire_store_f64(task_payload + off + sizeof(double), ctx->job.hi[d]);
+        off += 2U * sizeof(double);
+    }
+    memcpy(task_payload + off, ctx->fn_wire, ctx->fn_wire_len);
+    *task_payload_len = off + ctx->fn_wire_len;
+    mc->assigned += ni;
+    ++mc->next_task;
+    return 0;
+}
+
+static int on_mc_result(integral_manager_ctx_t *ctx, const uint8_t *result_payload, size_t result_payload_len) {
+    integral_mc_state_t *mc = &ctx->mc;
+    uint64_t count;
+    double volume = 1.0;
+    double mean;
+    int id;
+    int d;
+
+    if (mc_result_wire_check(result_payload, result_payload_len) != 0 ||
+        distr_wire_tag(result_payload) != WIRE_MC_RESULT) {
+        return -1;
+    }
+    id = (int)mc_result_wire_get_id(result_payload);
+    count = mc_result_wire_get_count(result_payload);
+    if (id < 0 || id >= mc->tasks_total || count == 0U) {
+        return -1;
+    }
+    mc->count += count;
+    mc->sum += mc_result_wire_get_sum(result_payload);
+    mc->sumsq += mc_result_wire_get_sumsq(result_payload);
+    mean = mc_result_wire_get_sum(result_payload) / (double)count;
+    mc->mean_sum += mean;
+    mc->mean_sumsq += mean * mean;
+    ++mc->tasks_done;
+
+    for (d = 0; d < ctx->job.dims; ++d) {
+        volume *= ctx->job.hi[d] - ctx->job.lo[d];
+    }
+    mean = mc->sum / (double)mc->count;
+    ctx->variance = volume * volume * (mc->sumsq / (double)mc->count - mean * mean);
+    if (ctx->variance < 0.0) {
+        ctx->variance = 0.0;
+    }
+    ctx->total = volume * mean;
+    if (ctx->job.mode == INTEGRAL_MODE_QMC) {
+        int r = mc->tasks_done;
+        double spread = 0.0;
+        if (r > 1) {
+            double m = mc->mean_sum / (double)r;
+            spread = (mc->mean_sumsq - (double)r * m * m) / (double)(r - 1);
+        }
+        ctx->error = (spread > 0.0) ? volume * sqrt(spread / (double)r) : 0.0;
+    } else {
+        ctx->error = sqrt(ctx->variance / (double)mc->count);
+    }
+    return 0;
+}
+
+static int cb_build_task(int worker_index,
+                         uint8_t *task_payload,
+                         size_t task_payload_sz,
+                         size_t *task_payload_len,
+                         void *user_ctx) {
+    integral_manager_ctx_t *ctx = (integral_manager_ctx_t *)user_ctx;
+    if (ctx == NULL || task_payload == NULL || task_payload_len == NULL ||
+        worker_index < 0 || worker_index >= ctx->required_workers || ctx->total_cores < 1) {
+        return -1;
+    }
+    if (ctx->job.mode == INTEGRAL_MODE_ADAPTIVE) {
+        return build_gk15_task(ctx, worker_index, task_payload, task_payload_sz, task_payload_len);
+    }
+    if (mode_is_sampling(ctx->job.mode)) {
+        return build_mc_task(ctx, worker_index, task_payload, task_payload_sz, task_payload_len);
+    }
+    if (ctx->job.sweep_len > 0) {
+        return build_sweep_task(ctx, worker_index, task_payload, task_payload_sz, task_payload_len);
+    }
+    if (ctx->job.mode == INTEGRAL_MODE_HIST) {
+        return build_hist_task(ctx, worker_index, task_payload, task_payload_sz, task_payload_len);
+    }
+    return build_trapz_task(ctx, worker_index, task_payload, task_payload_sz, task_payload_len);
+}
+
+static int on_gk15_result(integral_manager_ctx_t *ctx,
+                          int worker_index,
+                          const uint8_t *result_payload,
+                          size_t result_payload_len) {
+    integral_adapt_t *ad = &ctx->adapt;
+    integral_segment_t *slot;
+    const uint8_t *est;
+    int count;
+    int k;
+
+    if (worker_index < 0 || worker_index >= ctx->required_workers ||
+        vec_result_wire_check(result_payload, result_payload_len) != 0) {
+        return -1;
+    }
+    est = vec_result_wire_tail(result_payload);
+    count = (int)vec_result_wire_get_count(result_payload);
+    if ((int)vec_result_wire_get_id(result_payload) != worker_index || count != ad->pending_count[worker_index] ||
+        result_payload_len != (size_t)(est - result_payload) + (size_t)count * 2U * sizeof(double)) {
+        return -1;
+    }
+    slot = &ad->pending[(size_t)worker_index * INTEGRAL_ADAPT_BATCH];
+    for (k = 0; k < count; ++k) {
+        slot[k].value = distr_wire_load_f64(est + (size_t)(2 * k) * sizeof(double));
+        slot[k].error = distr_wire_load_f64(est + (size_t)(2 * k + 1) * sizeof(double));
+        slot[k].evaluated = 1;
+        heap_push(ad, slot[k]);
+    }
+    ad->pending_err_sum -= ad->pending_err[worker_index];
+    if (ad->pending_err_sum < 0.0) {
+        ad->pending_err_sum = 0.0;
+    }
+    ad->pending_err[worker_index] = 0.0;
+    ad->pending_segments -= count;
+    ad->pending_count[worker_index] = 0;
+    --ad->pending_tasks;
+    return 0;
+}
+
+static int on_sweep_result(integral_manager_ctx_t *ctx,
+                           int worker_index,
+                           const uint8_t *result_payload,
+                           size_t result_payload_len) {
+    const uint8_t *vals;
+    int q;
+    if (vec_result_wire_check(result_payload, result_payload_len) != 0) {
+        return -1;
+    }
+    vals = vec_result_wire_tail(result_payload);
+    if ((int)vec_result_wire_get_id(result_payload) != worker_index ||
+        (int)vec_result_wire_get_count(result_payload) != ctx->job.sweep_len ||
+        result_payload_len != (size_t)(vals - result_payload) + (size_t)ctx->job.sweep_len * sizeof(double)) {
+        return -1;
+    }
+    for (q = 0; q < ctx->job.sweep_len; ++q) {
+        ctx->sweep_totals[q] += distr_wire_load_f64(vals + (size_t)q * sizeof(double));
+    }
+    return 0;
+}
+
+static void prog_push(integral_manager_ctx_t *ctx, int worker_index, double value) {
+    integral_prog_t *pg = &ctx->prog_state;
+    double *h = &pg->hist[(size_t)worker_index * 3U];
+    int level;
+
+    h[0] = h[1];
+    h[1] = h[2];
+    h[2] = value;
+    level = ++pg->levels[worker_index];
+    if (level == 1) {
+        pg->est[worker_index] = value;
+        return;
+    }
+    pg->est[worker_index] = h[2] + (h[2] - h[1]) / 3.0;
+    if (level >= 3) {
+        double prev = h[1] + (h[1] - h[0]) / 3.0;
+        double err = fabs(pg->est[worker_index] - prev);
+        if (level == 3) {
+            ++pg->ready;
+        } else {
+            pg->err_sum -= pg->err[worker_index];
+        }
+        pg->err[worker_index] = err;
+        pg->err_sum += err;
+    }
+}
+
+static void prog_totals(integral_manager_ctx_t *ctx) {
+    const integral_prog_t *pg = &ctx->prog_state;
+    int w;
+    ctx->total = 0.0;
+    ctx->error = 0.0;
+    for (w = 0; w < ctx->required_workers; ++w) {
+        ctx->total += pg->est[w];
+        ctx->error += pg->err[w];
+    }
+}
+
+static int cb_on_worker_partial(int worker_index,
+                                const uint8_t *partial_payload,
+                                size_t partial_payload_len,
+                                void *user_ctx) {
+    integral_manager_ctx_t *ctx = (integral_manager_ctx_t *)user_ctx;
+    integral_prog_t *pg;
+
+    if (ctx == NULL || ctx->job.progressive == 0 || partial_wire_check(partial_payload, partial_payload_len) != 0 ||
+        worker_index < 0 || worker_index >= ctx->required_workers) {
+        return -1;
+    }
+    pg = &ctx->prog_state;
+    if ((int)partial_wire_get_id(partial_payload) != worker_index ||
+        (int)partial_wire_get_level(partial_payload) != pg->levels[worker_index]) {
+        return -1;
+    }
+    prog_push(ctx, worker_index, partial_wire_get_value(partial_payload));
+    if (ctx->tasks_built == ctx->required_workers && pg->ready == ctx->required_workers &&
+        pg->err_sum <= ctx->job.tol) {
+        prog_totals(ctx);
+        pg->stopped = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static int cb_on_worker_result(int worker_index,
+                               const uint8_t *result_payload,
+                               size_t result_payload_len,
+                               void *user_ctx) {
+    integral_manager_ctx_t *ctx = (integral_manager_ctx_t *)user_ctx;
+    int id;
+    double val;
+    if (ctx == NULL || result_payload == NULL) {
+        return -1;
+    }
+    ++ctx->tasks_done;
+    if (ctx->job.mode == INTEGRAL_MODE_ADAPTIVE) {
+        return on_gk15_result(ctx, worker_index, result_payload, result_payload_len);
+    }
+    if (mode_is_sampling(ctx->job.mode)) {
+        return on_mc_result(ctx, result_payload, result_payload_len);
+    }
+    if (ctx->job.sweep_len > 0) {
+        return on_sweep_result(ctx, worker_index, result_payload, result_payload_len);
+    }
+    if (ctx->job.mode == INTEGRAL_MODE_HIST) {
+        return on_hist_result(ctx, result_payload, result_payload_len);
+    }
+    if (result_wire_check(result_payload, result_payload_len) != 0) {
+        return -1;
+    }
+    id = (int)result_wire_get_id(result_payload);
+    val = result_wire_get_value(result_payload);
+    if (id < 0 || id >= ctx->required_workers) {
+        return -1;
+    }
+    if (ctx->job.progressive == 0 && worker_index >= 0 && worker_index < ctx->required_workers) {
+        profile_sample(ctx->profile, ctx->worker_host[worker_index], ctx->worker_cores[worker_index],
+                       ctx->worker_task_n[worker_index], ctx->worker_task_us[worker_index],
+                       result_wire_get_exec_us(result_payload));
+    }
+    if (ctx->job.progressive != 0) {
+        prog_push(ctx, id, val);
+        prog_totals(ctx);
+        return 0;
+    }
+    if (result_wire_get_precision(result_payload) == TASK_PRECISION_F32) {
+        ++ctx->f32_tasks;
+    }
+    ctx->rounding_bound += result_wire_get_error_bound(result_payload);
+    ctx->total += val;
+    return 0;
+}
+
+static double cb_progress(void *user_ctx) {
+    const integral_manager_ctx_t *ctx = (const integral_manager_ctx_t *)user_ctx;
+    if (ctx->job.mode == INTEGRAL_MODE_ADAPTIVE) {
+        return -1.0;
+    }
+    if (mode_is_sampling(ctx->job.mode)) {
+        return (double)ctx->mc.tasks_done / (double)ctx->mc.tasks_total;
+    }
+    return (double)ctx->tasks_done / (double)ctx->required_workers;
+}
+
+manager_ops_t integral_manager_ops(integral_manager_ctx_t *ctx) {
+    manager_ops_t ops;
+    ops.on_worker_hello = cb_on_worker_hello;
+    ops.build_task = cb_build_task;
+    ops.on_worker_result = cb_on_worker_result;
+    ops.on_worker_partial = cb_on_worker_partial;
+    ops.progress = cb_progress;
+    ops.on_control = NULL;
+    ops.user_ctx = ctx;
+    return ops;
+}
+
+int integral_batch_ctx_init(integral_batch_ctx_t *ctx, int required_workers, FILE *in, FILE *out, long chunk_n) {
+    if (ctx == NULL || in == NULL || out == NULL || required_workers < 1 || chunk_n < 1) {
+        return -1;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->in = in;
+    ctx->out = out;
+    ctx->required_workers = required_workers;
+    ctx->chunk_n = chunk_n;
+    ctx->deadline_ms = -1;
+    ctx->slot_count = 2 * required_workers;
+    ctx->worker_cores = (int *)calloc((size_t)required_workers, sizeof(*ctx->worker_cores));
+    ctx->worker_rate = (double *)calloc((size_t)required_workers, sizeof(*ctx->worker_rate));
+    ctx->worker_task_us = (uint64_t *)calloc((size_t)required_workers, sizeof(*ctx->worker_task_us));
+    ctx->worker_task_span = (long *)calloc((size_t)required_workers, sizeof(*ctx->worker_task_span));
+    ctx->worker_min_span = (long *)calloc((size_t)required_workers, sizeof(*ctx->worker_min_span));
+    ctx->worker_host = calloc((size_t)required_workers, sizeof(*ctx->worker_host));
+    ctx->slots = (integral_batch_slot_t *)calloc((size_t)ctx->slot_count, sizeof(*ctx->slots));
+    if (ctx->worker_cores == NULL || ctx->worker_rate == NULL || ctx->worker_task_us == NULL ||
+        ctx->worker_task_span == NULL || ctx->worker_min_span == NULL || ctx->worker_host == NULL ||
+        ctx->slots == NULL) {
+        integral_batch_ctx_free(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+void integral_batch_ctx_free(integral_batch_ctx_t *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    free(ctx->worker_cores);
+    free(ctx->worker_rate);
+    free(ctx->worker_task_us);
+    free(ctx->worker_task_span);
+    free(ctx->worker_min_span);
+    free(ctx->worker_host);
+    free(ctx->slots);
+    ctx->worker_cores = NULL;
+    ctx->worker_rate = NULL;
+    ctx->worker_task_us = NULL;
+    ctx->worker_task_span = NULL;
+    ctx->worker_min_span = NULL;
+    ctx->worker_host = NULL;
+    ctx->slots = NULL;
+}
+
+static int batch_parse_line(integral_batch_ctx_t *ctx, const char *line, integral_batch_slot_t *slot) {
+    static const double no_params[EXPR_MAX_PARAMS] = {0.0};
+    expr_prog_t prog;
+    const char *expr;
+    char *end = NULL;
+    char err[128];
+    long deadline_ms = ctx->deadline_ms;
+
+    if (*line == '@') {
+        deadline_ms = strtol(line + 1, &end, 10);
+        if (end == line + 1 || deadline_ms < 0 || (*end != ' ' && *end != '\t')) {
+            return -1;
+        }
+        line = end;
+    }
+    slot->arrival_ms = integral_now_ms();
+    slot->deadline_ms = (deadline_ms >= 0) ? slot->arrival_ms + (uint64_t)deadline_ms : 0U;
+    slot->a = strtod(line, &end);
+    if (end == line) {
+        return -1;
+    }
+    line = end;
+    slot->b = strtod(line, &end);
+    if (end == line) {
+        return -1;
+    }
+    line = end;
+    slot->n = strtol(line, &end, 10);
+    if (end == line || slot->n < 1 || slot->b <= slot->a) {
+        return -1;
+    }
+    while (*end == ' ' || *end == '\t') {
+        ++end;
+    }
+    expr = (*end != '\0') ? end : ctx->default_expr;
+    if (expr == NULL) {
+        slot->fn_wire_len = encode_fn(NULL, no_params, slot->fn_wire, sizeof(slot->fn_wire));
+        return (slot->fn_wire_len == 0U) ? -1 : 0;
+    }
+    if (expr_compile(expr, &prog, err, sizeof(err)) != 0 || prog.nvars > 1 || prog.nparams > 0) {
+        return -1;
+    }
+    slot->fn_wire_len = encode_fn(&prog, no_params, slot->fn_wire, sizeof(slot->fn_wire));
+    return (slot->fn_wire_len == 0U) ? -1 : 0;
+}
+
+static integral_batch_slot_t *batch_refill(integral_batch_ctx_t *ctx) {
+    integral_batch_slot_t *slot = NULL;
+    char line[1024];
+    int k;
+
+    for (k = 0; k < ctx->slot_count; ++k) {
+        if (ctx->slots[k].active == 0) {
+            slot = &ctx->slots[k];
+            break;
+        }
+    }
+    while (slot != NULL && ctx->eof == 0) {
+        char *p;
+        size_t len;
+        int overlong;
+        if (fgets(line, sizeof(line), ctx->in) == NULL) {
+            ctx->eof = 1;
+            break;
+        }
+        ++ctx->line_no;
+        len = strlen(line);
+        overlong = len > 0U && line[len - 1U] != '\n' && feof(ctx->in) == 0;
+        if (overlong) {
+            int c;
+            while ((c = fgetc(ctx->in)) != EOF && c != '\n') {
+            }
+        }
+        while (len > 0U && (line[len - 1U] == '\n' || line[len - 1U] == '\r')) {
+            line[--len] = '\0';
+        }
+        p = line;
+        while (*p == ' ' || *p == '\t') {
+            ++p;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        memset(slot, 0, sizeof(*slot));
+        if (overlong || batch_parse_line(ctx, p, slot) != 0) {
+            fprintf(ctx->out, "%ld ERROR bad_job\n", ctx->line_no);
+            (void)fflush(ctx->out);
+            ++ctx->jobs_failed;
+            continue;
+        }
+        slot->line_no = ctx->line_no;
+        slot->active = 1;
+        return slot;
+    }
+    return NULL;
+}
+
+static int batch_slot_before(const integral_batch_slot_t *s, const integral_batch_slot_t *t) {
+    uint64_t ds = (s->deadline_ms != 0U) ? s->deadline_ms : UINT64_MAX;
+    uint64_t dt = (t->deadline_ms != 0U) ? t->deadline_ms : UINT64_MAX;
+    return ds < dt || (ds == dt && s->line_no < t->line_no);
+}
+
+static long batch_span(integral_batch_ctx_t *ctx, integral_batch_slot_t *slot, int worker_index) {
+    long left = slot->n - slot->next_i;
+    long span = ctx->chunk_n * (long)ctx->worker_cores[worker_index];
+    double rate = 0.0;
+    uint64_t now;
+    uint64_t eta;
+    int k;
+
+    if (span < ctx->worker_min_span[worker_index]) {
+        span = ctx->worker_min_span[worker_index];
+    }
+    if (slot->deadline_ms != 0U && ctx->total_cores > 0) {
+        for (k = 0; k < ctx->required_workers; ++k) {
+            rate += ctx->worker_rate[k];
+        }
+        now = integral_now_ms();
+        eta = (rate > 0.0) ? now + (uint64_t)((double)left / rate / 1000.0) : now;
+        if (eta > slot->deadline_ms || now >= slot->deadline_ms) {
+            long share = (long)(((double)left * (double)ctx->worker_cores[worker_index] +
+                                 (double)ctx->total_cores - 1.0) /
+                                (double)ctx->total_cores);
+            if (slot->at_risk == 0) {
+                slot->at_risk = 1;
+                fprintf(stderr, "[integral] job at line %ld is predicted to miss its deadline, spreading over the pool\n",
+                        slot->line_no);
+            }
+            if (share >= 1 && share < span) {
+                span = share;
+            }
+        }
+    }
+    return (span > left) ? left : span;
+}
+
+static int cb_batch_on_worker_hello(int worker_index,
+                                    const uint8_t *hello_payload,
+                                    size_t hello_payload_len,
+                                    void *user_ctx) {
+    integral_batch_ctx_t *ctx = (integral_batch_ctx_t *)user_ctx;
+    const integral_profile_entry_t *e;
+    int cores;
+    if (ctx == NULL || worker_index < 0 || worker_index >= ctx->required_workers) {
+        return -1;
+    }
+    if (parse_hello(hello_payload, hello_payload_len, &cores, ctx->worker_host[worker_index]) != 0) {
+        return -1;
+    }
+    ctx->worker_cores[worker_index] = cores;
+    ctx->total_cores += cores;
+    e = integral_profile_find(ctx->profile, ctx->worker_host[worker_index]);
+    if (e != NULL) {
+        ctx->worker_rate[worker_index] = e->rate * (double)cores * 1e-6;
+        ctx->worker_min_span[worker_index] =
+            (long)(ctx->worker_rate[worker_index] * e->overhead_us * INTEGRAL_PROFILE_GRAIN);
+        fprintf(stderr, "[integral] worker#%d host %s seeded from profile: %.3g evals/s per core, overhead %.0f us\n",
+                worker_index, ctx->worker_host[worker_index], e->rate, e->overhead_us);
+    }
+    return 0;
+}
+
+static int cb_batch_build_task(int worker_index,
+                               uint8_t *task_payload,
+                               size_t task_payload_sz,
+                               size_t *task_payload_len,
+                               void *user_ctx) {
+    integral_batch_ctx_t *ctx = (integral_batch_ctx_t *)user_ctx;
+    integral_batch_slot_t *slot = NULL;
+    double h;
+    long span;
+    long k;
+
+    if (ctx == NULL || task_payload == NULL || task_payload_len == NULL || worker_index < 0 ||
+        worker_index >= ctx->required_workers) {
+        return -1;
+    }
+    while (batch_refill(ctx) != NULL) {
+    }
+    for (k = 0; k < ctx->slot_count; ++k) {
+        integral_batch_slot_t *s = &ctx->slots[k];
+        if (s->active != 0 && s->next_i < s->n && (slot == NULL || batch_slot_before(s, slot))) {
+            slot = s;
+        }
+    }
+    if (slot == NULL) {
+        return (ctx->eof != 0) ? DISTR_BUILD_DONE : DISTR_BUILD_WAIT;
+    }
+    if (task_payload_sz < task_wire_size() + slot->fn_wire_len) {
+        return -1;
+    }
+    span = batch_span(ctx, slot, worker_index);
+    h = (slot->b - slot->a) / (double)slot->n;
+    task_wire_init(task_payload, TASK_KIND_TRAPZ);
+    task_wire_set_id(task_payload, (uint32_t)(slot - ctx->slots));
+    task_wire_set_threads(task_payload, (uint32_t)ctx->worker_cores[worker_index]);
+    task_wire_set_a(task_payload, slot->a + (double)slot->next_i * h);
+    task_wire_set_b(task_payload,
+                    (slot->next_i + span == slot->n) ? slot->b : slot->a + (double)(slot->next_i + span) * h);
+    task_wire_set_n(task_payload, (int64_t)span);
+    memcpy(task_payload + task_wire_size(), slot->fn_wire, slot->fn_wire_len);
+    *task_payload_len = task_wire_size() + slot->fn_wire_len;
+    slot->next_i += span;
+    ++slot->tasks_out;
+    ctx->worker_task_us[worker_index] = now_us();
+    ctx->worker_task_span[worker_index] = span;
+    return 0;
+}
+
+static int cb_batch_on_worker_result(int worker_index,
+                                     const uint8_t *result_payload,
+                                     size_t result_payload_len,
+                                     void *user_ctx) {
+    integral_batch_ctx_t *ctx = (integral_batch_ctx_t *)user_ctx;
+    integral_batch_slot_t *slot;
+    uint64_t elapsed_us;
+    int id;
+    if (ctx == NULL || worker_index < 0 || worker_index >= ctx->required_workers ||
+        result_wire_check(result_payload, result_payload_len) != 0) {
+        return -1;
+    }
+    elapsed_us = now_us() - ctx->worker_task_us[worker_index];
+    profile_sample(ctx->profile, ctx->worker_host[worker_index], ctx->worker_cores[worker_index],
+                   ctx->worker_task_span[worker_index], ctx->worker_task_us[worker_index],
+                   result_wire_get_exec_us(result_payload));
+    if (ctx->worker_task_span[worker_index] > 0 && elapsed_us > 0U) {
+        double rate = (double)ctx->worker_task_span[worker_index] / (double)elapsed_us;
+        ctx->worker_rate[worker_index] =
+            (ctx->worker_rate[worker_index] > 0.0) ? 0.7 * ctx->worker_rate[worker_index] + 0.3 * rate : rate;
+        ctx->worker_task_span[worker_index] = 0;
+    }
+    id = (int)result_wire_get_id(result_payload);
+    if (id < 0 || id >= ctx->slot_count || ctx->slots[id].active == 0 || ctx->slots[id].tasks_out < 1) {
+        return -1;
+    }
+    slot = &ctx->slots[id];
+    slot->total += result_wire_get_value(result_payload);
+    --slot->tasks_out;
+    if (slot->tasks_out == 0 && slot->next_i == slot->n) {
+        uint64_t now = integral_now_ms();
+        fprintf(ctx->out, "%ld %.17g %.17g %ld %.15g", slot->line_no, slot->a, slot->b, slot->n, slot->total);
+        if (slot->deadline_ms != 0U) {
+            ++ctx->deadline_jobs;
+            if (now > slot->deadline_ms) {
+                ++ctx->deadline_missed;
+                if (now - slot->deadline_ms > ctx->max_late_ms) {
+                    ctx->max_late_ms = now - slot->deadline_ms;
+                }
+                fprintf(ctx->out, " MISSED %llu", (unsigned long long)(now - slot->deadline_ms));
+            }
+        }
+        fputc('\n', ctx->out);
+        (void)fflush(ctx->out);
+        slot->active = 0;
+        ++ctx->jobs_done;
+    }
+    return 0;
+}
+
+static int cb_batch_on_control(const char *command, char *reply, size_t reply_sz, void *user_ctx) {
+    integral_batch_ctx_t *ctx = (integral_batch_ctx_t *)user_ctx;
+    long chunk_n;
+    char tail;
+    if (sscanf(command, "chunk %ld %c", &chunk_n, &tail) != 1) {
+        return 1;
+    }
+    if (chunk_n < 1) {
+        return -1;
+    }
+    ctx->chunk_n = chunk_n;
+    fprintf(stderr, "[integral] batch chunk set to %ld\n", chunk_n);
+    (void)snprintf(reply, reply_sz, "{\"ok\": true, \"chunk\": %ld}", chunk_n);
+    return 0;
+}
+
+manager_ops_t integral_batch_manager_ops(integral_batch_ctx_t *ctx) {
+    manager_ops_t ops;
+    ops.on_worker_hello = cb_batch_on_worker_hello;
+    ops.build_task = cb_batch_build_task;
+    ops.on_worker_result = cb_batch_on_worker_result;
+    ops.on_worker_partial = NULL;
+    ops.progress = NULL;
+    ops.on_control = cb_batch_on_control;
+    ops.user_ctx = ctx;
+    return ops;
+}
+
+int integral_set_host_id(const char *host) {
+    if (host != NULL && !integral_profile_host_ok(host)) {
+        return -1;
+    }
+    (void)snprintf(g_host_id, sizeof(g_host_id), "%s", (host != NULL) ? host : "");
+    return 0;
+}
+
+static int cb_build_hello(uint8_t *out,
+                          size_t out_sz,
+                          size_t *out_len,
+                          const worker_cfg_t *wcfg,
+                          void *user_ctx) {
+    char host[INTEGRAL_HOST_ID_MAX];
+    size_t off = hello_wire_size();
+    size_t h;
+    int k;
+    (void)user_ctx;
+    if (out == NULL || out_len == NULL || wcfg == NULL || out_sz < off) {
+        return -1;
+    }
+    memcpy(host, g_host_id, sizeof(host));
+    if (host[0] == '\0' && gethostname(host, sizeof(host)) != 0) {
+        host[0] = '\0';
+    }
+    host[sizeof(host) - 1U] = '\0';
+    if (!integral_profile_host_ok(host)) {
+        host[0] = '\0';
+    }
+    hello_wire_init(out, WIRE_HELLO);
+    hello_wire_set_cores(out, (uint32_t)wcfg->max_cores);
+    hello_wire_set_kernel_count(out, (uint32_t)g_kernel_count);
+    for (h = 0U; host[h] != '\0'; ++h) {
+        hello_wire_set_host(out, h, (uint8_t)host[h]);
+    }
+    for (k = 0; k < g_kernel_count; ++k) {
+        size_t len = strlen(g_kernels[k]->name);
+        if (off + 1U + len > out_sz) {
+            return -1;
+        }
+        out[off++] = (uint8_t)len;
+        memcpy(out + off, g_kernels[k]->name, len);
+        off += len;
+    }
+    *out_len = off;
+    return 0;
+}
+
+static int clamp_threads(uint32_t threads, const worker_cfg_t *wcfg) {
+    if (threads < 1U) {
+        return 1;
+    }
+    if (threads > (uint32_t)wcfg->max_cores) {
+        return wcfg->max_cores;
+    }
+    return (int)threads;
+}
+
+static size_t put_result(uint8_t *result_payload, uint32_t id, double value, uint64_t start_us) {
+    result_wire_init(result_payload, WIRE_RESULT);
+    result_wire_set_id(result_payload, id);
+    result_wire_set_value(result_payload, value);
+    result_wire_set_exec_us(result_payload, now_us() - start_us);
+    return result_wire_size();
+}
+
+static int exec_trapz_task(const uint8_t *task_payload,
+                           size_t task_payload_len,
+                           uint8_t *result_payload,
+                           size_t result_payload_sz,
+                           size_t *result_payload_len,
+                           const worker_cfg_t *wcfg) {
+    node_ctx_t ctx;
+    distr_reduce_t r;
+    mixed_acc_t acc;
+    const uint8_t *fn_wire;
+    uint64_t start_us = now_us();
+    uint32_t precision = TASK_PRECISION_F32;
+    double a;
+    double b;
+    double eps;
+    double bound;
+    double val;
+    long n;
+    int threads;
+
+    if (task_wire_check(task_payload, task_payload_len) != 0 || result_payload_sz < result_wire_size()) {
+        return -1;
+    }
+    fn_wire = task_wire_tail(task_payload);
+    if (decode_fn(fn_wire, task_payload_len - (size_t)(fn_wire - task_payload), 1, &ctx.prog, &ctx.fn) != 0) {
+        return -1;
+    }
+    a = task_wire_get_a(task_payload);
+    b = task_wire_get_b(task_payload);
+    n = (long)task_wire_get_n(task_payload);
+    threads = clamp_threads(task_wire_get_threads(task_payload), wcfg);
+    r = node_reduce(&ctx, a, b, n, 0);
+    r.acc_size = sizeof(mixed_acc_t);
+    r.map = node_map_f32;
+    r.combine = mixed_combine;
+    if (ctx.fn.table != NULL || n <= 0L || b <= a ||
+        distr_map_reduce(&r, n, threads, &acc) != 0) {
+        precision = TASK_PRECISION_F64;
+        memset(&acc, 0, sizeof(acc));
+    }
+    if (distr_task_cancelled() != 0) {
+        return -1;
+    }
+    eps = (double)((ctx.fn.prog != NULL) ? ctx.fn.prog->len + 1 : 4) * (double)FLT_EPSILON * 0.5;
+    if (2.0 * acc.max_dev > eps) {
+        eps = 2.0 * acc.max_dev;
+    }
+    bound = acc.abs_sum * ctx.h * eps;
+    val = distr_sum_value(&acc.sum) * ctx.h;
+    if (precision == TASK_PRECISION_F64 ||
+        (task_wire_get_tol(task_payload) > 0.0 && bound > task_wire_get_tol(task_payload))) {
+        precision = TASK_PRECISION_F64;
+        memset(&acc, 0, sizeof(acc));
+        r.map = node_map_f64;
+        if ((n > 0L && b > a && distr_map_reduce(&r, n, threads, &acc) != 0) || distr_task_cancelled() != 0) {
+            return -1;
+        }
+        bound = acc.abs_sum * ctx.h * (double)((ctx.fn.prog != NULL) ? ctx.fn.prog->len + 1 : 4) * DBL_EPSILON * 0.5;
+        val = distr_sum_value(&acc.sum) * ctx.h;
+    }
+    *result_payload_len = put_result(result_payload, task_wire_get_id(task_payload), val, start_us);
+    result_wire_set_precision(result_payload, precision);
+    result_wire_set_error_bound(result_payload, bound);
+    return 0;
+}
+
+static int trapz_finalize(const void *acc,
+                          uint8_t *result_payload,
+                          size_t result_payload_sz,
+                          size_t *result_payload_len,
+                          void *user_ctx) {
+    const node_ctx_t *ctx = (const node_ctx_t *)user_ctx;
+    if (result_payload_sz < result_wire_size()) {
+        return -1;
+    }
+    *result_payload_len =
+        put_result(result_payload, ctx->id, distr_sum_value((const distr_sum_t *)acc), ctx->start_us);
+    return 0;
+}
+
+static int plan_trapz_task(const uint8_t *task_payload,
+                           size_t task_payload_len,
+                           distr_task_plan_t *plan,
+                           const worker_cfg_t *wcfg) {
+    node_ctx_t *ctx = (node_ctx_t *)(void *)plan->state.bytes;
+    const uint8_t *fn_wire;
+    double a;
+    double b;
+    long n;
+
+    if (task_wire_check(task_payload, task_payload_len) != 0) {
+        return -1;
+    }
+    ctx->start_us = now_us();
+    fn_wire = task_wire_tail(task_payload);
+    if (decode_fn(fn_wire, task_payload_len - (size_t)(fn_wire - task_payload), 1, &ctx->prog, &ctx->fn) != 0) {
+        return -1;
+    }
+    a = task_wire_get_a(task_payload);
+    b = task_wire_get_b(task_payload);
+    n = (long)task_wire_get_n(task_payload);
+    if (task_wire_get_precision(task_payload) == TASK_PRECISION_F32) {
+        return 1;
+    }
+    ctx->id = task_wire_get_id(task_payload);
+    plan->reduce = node_reduce(ctx, a, b, n, 0);
+    plan->items = (n > 0L && b > a) ? n : 0L;
+    plan->threads = clamp_threads(task_wire_get_threads(task_payload), wcfg);
+    plan->finalize = trapz_finalize;
+    return 0;
+}
+
+static void hist_map(long begin, long end, void *acc, void *user_ctx) {
+    const node_ctx_t *ctx = (const node_ctx_t *)user_ctx;
+    hist_acc_t *h = (hist_acc_t *)acc;
+    double xs[EXPR_BLOCK];
+    double ys[EXPR_BLOCK];
+    long i;
+
+    for (i = begin; i < end && distr_task_cancelled() == 0;) {
+        int cnt = (end - i < EXPR_BLOCK) ? (int)(end - i) : EXPR_BLOCK;
+        int k;
+        for (k = 0; k < cnt; ++k) {
+            xs[k] = ctx->a + ((double)(i + k) + 0.5) * ctx->h;
+        }
+        fn_eval(&ctx->fn, xs, ys, cnt);
+        for (k = 0; k < cnt; ++k) {
+            distr_moments_add(&h->moments, ys[k]);
+            distr_hist_add(&h->hist, ys[k]);
+        }
+        i += cnt;
+    }
+}
+
+static void hist_acc_init(void *acc, void *user_ctx) {
+    const node_ctx_t *ctx = (const node_ctx_t *)user_ctx;
+    hist_acc_t *h = (hist_acc_t *)acc;
+    distr_moments_init(&h->moments);
+    (void)distr_hist_init(&h->hist, ctx->lo, ctx->hi, ctx->bins);
+}
+
+static void hist_combine(void *acc, const void *other, void *user_ctx) {
+    hist_acc_t *h = (hist_acc_t *)acc;
+    const hist_acc_t *o = (const hist_acc_t *)other;
+    (void)user_ctx;
+    distr_moments_merge(&h->moments, &o->moments);
+    distr_hist_merge(&h->hist, &o->hist);
+}
+
+static int hist_finalize(const void *acc,
+                         uint8_t *result_payload,
+                         size_t result_payload_sz,
+                         size_t *result_payload_len,
+                         void *user_ctx) {
+    const node_ctx_t *ctx = (const node_ctx_t *)user_ctx;
+    const hist_acc_t *h = (const hist_acc_t *)acc;
+    uint32_t k;
+    if (result_payload_sz < hist_result_wire_size()) {
+        return -1;
+    }
+    hist_result_wire_init(result_payload, WIRE_HIST_RESULT);
+    hist_result_wire_set_id(result_payload, ctx->id);
+    hist_result_wire_set_bins(result_payload, h->hist.bins);
+    hist_result_wire_set_count(result_payload, h->moments.count);
+    hist_result_wire_set_min(result_payload, h->moments.min);
+    hist_result_wire_set_max(result_payload, h->moments.max);
+    hist_result_wire_set_mean(result_payload, h->moments.mean);
+    hist_result_wire_set_m2(result_payload, h->moments.m2);
+    hist_result_wire_set_under(result_payload, h->hist.under);
+    hist_result_wire_set_over(result_payload, h->hist.over);
+    for (k = 0U; k < h->hist.bins; ++k) {
+        hist_result_wire_set_counts(result_payload, k, h->hist.count[k]);
+    }
+    *result_payload_len = hist_result_wire_size();
+    return 0;
+}
+
+static int plan_hist_task(const uint8_t *task_payload,
+                          size_t task_payload_len,
+                          distr_task_plan_t *plan,
+                          const worker_cfg_t *wcfg) {
+    node_ctx_t *ctx = (node_ctx_t *)(void *)plan->state.bytes;
+    const uint8_t *fn_wire;
+    double a;
+    double b;
+    long n;
+
+    if (hist_task_wire_check(task_payload, task_payload_len) != 0) {
+        return -1;
+    }
+    fn_wire = hist_task_wire_tail(task_payload);
+    if (decode_fn(fn_wire, task_payload_len - (size_t)(fn_wire - task_payload), 1, &ctx->prog, &ctx->fn) != 0) {
+        return -1;
+    }
+    a = hist_task_wire_get_a(task_payload);
+    b = hist_task_wire_get_b(task_payload);
+    n = (long)hist_task_wire_get_n(task_payload);
+    ctx->id = hist_task_wire_get_id(task_payload);
+    ctx->lo = hist_task_wire_get_lo(task_payload);
+    ctx->hi = hist_task_wire_get_hi(task_payload);
+    ctx->bins = (int)hist_task_wire_get_bins(task_payload);
+    ctx->a = a;
+    ctx->h = (n > 0L) ? (b - a) / (double)n : 0.0;
+    ctx->midpoint = 1;
+    if (ctx->bins < 1 || ctx->bins > DISTR_HIST_MAX_BINS || !(ctx->hi > ctx->lo)) {
+        return -1;
+    }
+    plan->reduce.acc_size = sizeof(hist_acc_t);
+    plan->reduce.init = hist_acc_init;
+    plan->reduce.map = hist_map;
+    plan->reduce.combine = hist_combine;
+    plan->reduce.user_ctx = ctx;
+    plan->items = (n > 0L && b > a) ? n : 0L;
+    plan->threads = clamp_threads(hist_task_wire_get_threads(task_payload), wcfg);
+    plan->finalize = hist_finalize;
+    return 0;
+}
+
+static int exec_prog_task(const uint8_t *task_payload,
+                          size_t task_payload_len,
+                          uint8_t *result_payload,
+                          size_t result_payload_sz,
+                          size_t *result_payload_len,
+                          const worker_cfg_t *wcfg) {
+    const uint8_t *fn_wire;
+    uint8_t part[sizeof(partial_wire_layout_t)];
+    uint64_t start_us = now_us();
+    double a;
+    double b;
+    double t;
+    long n;
+    long m;
+    int levels = 0;
+    int threads;
+    int k;
+    expr_prog_t prog;
+    integral_fn_t fn;
+
+    if (task_wire_check(task_payload, task_payload_len) != 0 || result_payload_sz < result_wire_size()) {
+        return -1;
+    }
+    fn_wire = task_wire_tail(task_payload);
+    if (decode_fn(fn_wire, task_payload_len - (size_t)(fn_wire - task_payload), 1, &prog, &fn) != 0) {
+        return -1;
+    }
+    a = task_wire_get_a(task_payload);
+    b = task_wire_get_b(task_payload);
+    n = (long)task_wire_get_n(task_payload);
+    threads = clamp_threads(task_wire_get_threads(task_payload), wcfg);
+    while (levels < INTEGRAL_PROG_MAX_LEVELS && (n >> (levels + 1)) >= INTEGRAL_PROG_MIN_N) {
+        ++levels;
+    }
+    m = n >> levels;
+    t = integrate_trapz(&fn, a, b, m, threads);
+    partial_wire_init(part, WIRE_PARTIAL);
+    partial_wire_set_id(part, task_wire_get_id(task_payload));
+    for (k = 0; k < levels && distr_task_cancelled() == 0; ++k) {
+        partial_wire_set_level(part, (uint32_t)k);
+        partial_wire_set_value(part, t);
+        (void)distr_emit_partial(part, sizeof(part));
+        t = 0.5 * (t + integrate_midpoint(&fn, a, b, m, threads));
+        m *= 2L;
+    }
+    if (distr_task_cancelled() != 0) {
+        return -1;
+    }
+
+    *result_payload_len = put_result(result_payload, task_wire_get_id(task_payload), t, start_us);
+    return 0;
+}
+
+static int exec_sweep_task(const uint8_t *task_payload,
+                           size_t task_payload_len,
+                           uint8_t *result_payload,
+                           size_t result_payload_sz,
+                           size_t *result_payload_len,
+                           const worker_cfg_t *wcfg) {
+    double copy[INTEGRAL_SWEEP_MAX];
+    double vals[INTEGRAL_SWEEP_MAX];
+    const double *params;
+    const uint8_t *raw;
+    size_t fn_off;
+    size_t out_off = vec_result_wire_size();
+    expr_prog_t prog;
+    integral_fn_t fn;
+    int count;
+    int q;
+
+    if (sweep_task_wire_check(task_payload, task_payload_len) != 0) {
+        return -1;
+    }
+    count = (int)sweep_task_wire_get_count(task_payload);
+    if (count < 1 || count > INTEGRAL_SWEEP_MAX) {
+        return -1;
+    }
+    raw = sweep_task_wire_tail(task_payload);
+    fn_off = (size_t)(raw - task_payload) + (size_t)count * sizeof(double);
+    if (task_payload_len < fn_off || result_payload_sz < out_off + (size_t)count * sizeof(double)) {
+        return -1;
+    }
+    if (decode_fn(task_payload + fn_off, task_payload_len - fn_off, 1, &prog, &fn) != 0) {
+        return -1;
+    }
+    params = distr_wire_f64_view(raw);
+    if (params == NULL) {
+        for (q = 0; q < count; ++q) {
+            copy[q] = distr_wire_load_f64(raw + (size_t)q * sizeof(double));
+        }
+        params = copy;
+    }
+    if (integrate_trapz_sweep(&fn,
+                              sweep_task_wire_get_a(task_payload),
+                              sweep_task_wire_get_b(task_payload),
+                              (long)sweep_task_wire_get_n(task_payload),
+                              clamp_threads(sweep_task_wire_get_threads(task_payload), wcfg),
+                              params,
+                              count,
+                              vals) != 0) {
+        return -1;
+    }
+    vec_result_wire_init(result_payload, WIRE_VEC_RESULT);
+    vec_result_wire_set_id(result_payload, sweep_task_wire_get_id(task_payload));
+    vec_result_wire_set_count(result_payload, (uint32_t)count);
+    for (q = 0; q < count; ++q) {
+        distr_wire_store_f64(result_payload + out_off + (size_t)q * sizeof(double), vals[q]);
+    }
+    *result_payload_len = out_off + (size_t)count * sizeof(double);
+    return 0;
+}
+
+static int exec_gk15_task(const uint8_t *task_payload,
+                          size_t task_payload_len,
+                          uint8_t *result_payload,
+                          size_t result_payload_sz,
+                          size_t *result_payload_len) {
+    const uint8_t *iv;
+    uint8_t *est = result_payload + vec_result_wire_size();
+    uint32_t count;
+    uint32_t k;
+    size_t fn_off;
+    expr_prog_t prog;
+    integral_fn_t fn;
+
+    if (gk_task_wire_check(task_payload, task_payload_len) != 0) {
+        return -1;
+    }
+    count = gk_task_wire_get_count(task_payload);
+    iv = gk_task_wire_tail(task_payload);
+    fn_off = (size_t)(iv - task_payload) + (size_t)count * 2U * sizeof(double);
+    if (count > INTEGRAL_ADAPT_BATCH || task_payload_len < fn_off ||
+        result_payload_sz < vec_result_wire_size() + count * 2U * sizeof(double)) {
+        return -1;
+    }
+    if (decode_fn(task_payload + fn_off, task_payload_len - fn_off, 1, &prog, &fn) != 0) {
+        return -1;
+    }
+    for (k = 0; k < count; ++k) {
+        double err = 0.0;
+        double val = integrate_gk15(&fn,
+                                    distr_wire_load_f64(iv + (size_t)(2U * k) * sizeof(double)),
+                                    distr_wire_load_f64(iv + (size_t)(2U * k + 1U) * sizeof(double)),
+                                    &err);
+        distr_wire_store_f64(est + (size_t)(2U * k) * sizeof(double), val);
+        distr_wire_store_f64(est + (size_t)(2U * k + 1U) * sizeof(double), err);
+    }
+    vec_result_wire_init(result_payload, WIRE_VEC_RESULT);
+    vec_result_wire_set_id(result_payload, gk_task_wire_get_id(task_payload));
+    vec_result_wire_set_count(result_payload, count);
+    *result_payload_len = vec_result_wire_size() + count * 2U * sizeof(double);
+    return 0;
+}
+
+static int exec_mc_task(const uint8_t *task_payload,
+                        size_t task_payload_len,
+                        uint8_t *result_payload,
+                        size_t result_payload_sz,
+                        size_t *result_payload_len,
+                        const worker_cfg_t *wcfg) {
+    integral_moments_t mom;
+    double lo[INTEGRAL_MAX_DIMS];
+    double hi[INTEGRAL_MAX_DIMS];
+    expr_prog_t prog;
+    integral_fn_t fn;
+    size_t off;
+    int dims;
+    int d;
+
+    if (mc_task_wire_check(task_payload, task_payload_len) != 0 || result_payload_sz < mc_result_wire_size()) {
+        return -1;
+    }
+    off = (size_t)(mc_task_wire_tail(task_payload) - task_payload);
+    dims = (int)mc_task_wire_get_dims(task_payload);
+    if (dims < 1 || dims > INTEGRAL_MAX_DIMS || task_payload_len < off + (size_t)dims * 2U * sizeof(double)) {
+        return -1;
+    }
+    for (d = 0; d < dims; ++d) {
+        lo[d] = distr_wire_load_f64(task_payload + off);
+        hi[d] = distr_wire_load_f64(task_payload + off + sizeof(double));
+        off += 2U * sizeof(double);
+    }
+    if (decode_fn(task_payload + off, task_payload_len - off, dims, &prog, &fn) != 0) {
+        return -1;
+    }
+    if (integrate_mc(&fn,
+                     dims,
+                     lo,
+                     hi,
+                     (distr_wire_tag(task_payload) == TASK_KIND_QMC) ? INTEGRAL_SAMPLER_QMC : INTEGRAL_SAMPLER_MC,
+                     mc_task_wire_get_seed(task_payload),
+                     mc_task_wire_get_id(task_payload),
+                     mc_task_wire_get_n(task_payload),
+                     clamp_threads(mc_task_wire_get_threads(task_payload), wcfg),
+                     &mom) != 0) {
+        return -1;
+    }
+    mc_result_wire_init(result_payload, WIRE_MC_RESULT);
+    mc_result_wire_set_id(result_payload, mc_task_wire_get_id(task_payload));
+    mc_result_wire_set_count(result_payload, mom.count);
+    mc_result_wire_set_sum(result_payload, mom.sum);
+    mc_result_wire_set_sumsq(result_payload, mom.sumsq);
+    *result_payload_len = mc_result_wire_size();
+    return 0;
+}
+
+static int exec_kernel_task(const uint8_t *task_payload,
+                            size_t task_payload_len,
+                            uint8_t *result_payload,
+                            size_t result_payload_sz,
+                            size_t *result_payload_len,
+                            uint8_t *error_payload,
+                            size_t error_payload_sz,
+                            size_t *error_payload_len,
+                            const worker_cfg_t *wcfg) {
+    double copy[EXPR_MAX_PARAMS];
+    const double *params;
+    const integral_kernel_t *kernel;
+    const uint8_t *hdr;
+    const char *name;
+    uint64_t start_us = now_us();
+    size_t hdr_len;
+    size_t name_len;
+    int nparams;
+    int k;
+
+    if (task_wire_check(task_payload, task_payload_len) != 0 || result_payload_sz < result_wire_size()) {
+        return -1;
+    }
+    hdr = task_wire_tail(task_payload);
+    hdr_len = task_payload_len - (size_t)(hdr - task_payload);
+    if (hdr_len < DISTR_WIRE_HDR_SZ || distr_wire_tag(hdr) != WIRE_FN_KERNEL || fn_kernel_wire_check(hdr, hdr_len) != 0) {
+        return -1;
+    }
+    name = (const char *)fn_kernel_wire_tail(hdr);
+    name_len = fn_kernel_wire_get_name_len(hdr);
+    nparams = (int)fn_kernel_wire_get_nparams(hdr);
+    if (nparams > EXPR_MAX_PARAMS || (size_t)((const uint8_t *)name - hdr) + name_len != hdr_len) {
+        return -1;
+    }
+    kernel = find_kernel(name, name_len);
+    if (kernel == NULL) {
+        int len = snprintf((char *)error_payload, error_payload_sz, "kernel %.*s is not loaded", (int)name_len, name);
+        *error_payload_len = (len > 0 && (size_t)len < error_payload_sz) ? (size_t)len : 0U;
+        return 1;
+    }
+    params = fn_kernel_wire_params_view(hdr);
+    if (params == NULL) {
+        for (k = 0; k < nparams; ++k) {
+            copy[k] = fn_kernel_wire_get_params(hdr, (size_t)k);
+        }
+        params = copy;
+    }
+    *result_payload_len = put_result(result_payload,
+                                     task_wire_get_id(task_payload),
+                                     kernel->integrate(task_wire_get_a(task_payload),
+                                                       task_wire_get_b(task_payload),
+                                                       (long)task_wire_get_n(task_payload),
+                                                       clamp_threads(task_wire_get_threads(task_payload), wcfg),
+                                                       params,
+                                                       nparams),
+                                     start_us);
+    return 0;
+}
+
+static int cb_execute_task(const uint8_t *task_payload,
+                           size_t task_payload_len,
+                           uint8_t *result_payload,
+                           size_t result_payload_sz,
+                           size_t *result_payload_len,
+                           uint8_t *error_payload,
+                           size_t error_payload_sz,
+                           size_t *error_payload_len,
+                           void *user_ctx) {
+    const worker_cfg_t *wcfg = (const worker_cfg_t *)user_ctx;
+
+    if (task_payload == NULL || task_payload_len < DISTR_WIRE_HDR_SZ || result_payload == NULL ||
+        result_payload_len == NULL || error_payload == NULL || error_payload_len == NULL || wcfg == NULL) {
+        return -1;
+    }
+    *error_payload_len = 0U;
+    switch (distr_wire_tag(task_payload)) {
+    case TASK_KIND_TRAPZ:
+        return exec_trapz_task(task_payload, task_payload_len, result_payload, result_payload_sz,
+                               result_payload_len, wcfg);
+    case TASK_KIND_TRAPZ_PROG:
+        return exec_prog_task(task_payload, task_payload_len, result_payload, result_payload_sz,
+                              result_payload_len, wcfg);
+    case TASK_KIND_SWEEP:
+        return exec_sweep_task(task_payload, task_payload_len, result_payload, result_payload_sz,
+                               result_payload_len, wcfg);
+    case TASK_KIND_KERNEL:
+        return exec_kernel_task(task_payload, task_payload_len, result_payload, result_payload_sz,
+                                result_payload_len, error_payload, error_payload_sz, error_payload_len, wcfg);
+    case TASK_KIND_GK15:
+        return exec_gk15_task(task_payload, task_payload_len, result_payload, result_payload_sz,
+                              result_payload_len);
+    case TASK_KIND_MC:
+    case TASK_KIND_QMC:
+        return exec_mc_task(task_payload, task_payload_len, result_payload, result_payload_sz,
+                            result_payload_len, wcfg);
+    default:
+        return -1;
+    }
+}
+
+static int cb_plan_task(const uint8_t *task_payload,
+                        size_t task_payload_len,
+                        distr_task_plan_t *plan,
+                        void *user_ctx) {
+    const worker_cfg_t *wcfg = (const worker_cfg_t *)user_ctx;
+
+    if (task_payload == NULL || task_payload_len < DISTR_WIRE_HDR_SZ || plan == NULL || wcfg == NULL) {
+        return -1;
+    }
+    switch (distr_wire_tag(task_payload)) {
+    case TASK_KIND_TRAPZ:
+        return plan_trapz_task(task_payload, task_payload_len, plan, wcfg);
+    case TASK_KIND_HIST:
+        return plan_hist_task(task_payload, task_payload_len, plan, wcfg);
+    default:
+        return 1;
     }
-    val = integrate_trapz(a, b, n, threads);
-
-    out.id_be = htonl((uint32_t)id);
-    out.value_be = double_to_be64(val);
-    memcpy(result_payload, &out, sizeof(out));
-    *result_payload_len = sizeof(out);
-    *error_payload_len = 0U;
-    (void)error_payload;
-    (void)error_payload_sz;
-    return 0;
 }
 
 worker_ops_t integral_worker_ops(void) {
     worker_ops_t ops;
     ops.build_hello = cb_build_hello;
     ops.execute_task = cb_execute_task;
+    ops.plan_task = cb_plan_task;
     ops.user_ctx = NULL;
     return ops;
 }
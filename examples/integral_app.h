@@ -2,34 +2,214 @@
 #define INTEGRAL_APP_H
 
 #include "distr.h"
+#include "integral_expr.h"
+#include "integral_kernel.h"
+#include "integral_profile.h"
 
 #include <stdint.h>
+#include <stdio.h>
+
+#define INTEGRAL_ADAPT_BATCH 32
+#define INTEGRAL_FN_WIRE_MAX 768
+#define INTEGRAL_MAX_DIMS EXPR_MAX_VARS
+#define INTEGRAL_MC_TASKS_PER_WORKER 4
+#define INTEGRAL_BATCH_CHUNK 262144L
+#define INTEGRAL_SWEEP_MAX 1024
+#define INTEGRAL_KERNELS_MAX 32
+#define INTEGRAL_PROG_MIN_N 64L
+#define INTEGRAL_PROG_MAX_LEVELS 24
+#define INTEGRAL_HIST_GROUP 4
+
+typedef enum {
+    INTEGRAL_MODE_FIXED = 0,
+    INTEGRAL_MODE_ADAPTIVE = 1,
+    INTEGRAL_MODE_MC = 2,
+    INTEGRAL_MODE_QMC = 3,
+    INTEGRAL_MODE_HIST = 4
+} integral_mode_t;
 
 typedef struct {
     double a;
     double b;
     long n;
+    integral_mode_t mode;
+    double tol;
+    const char *expr;
+    double params[EXPR_MAX_PARAMS];
+    int dims;
+    double lo[INTEGRAL_MAX_DIMS];
+    double hi[INTEGRAL_MAX_DIMS];
+    uint64_t seed;
+    const double *sweep;
+    int sweep_len;
+    const char *kernel;
+    int progressive;
+    int use_table;
+    int table_blob;
+    double table_lo;
+    double table_hi;
+    double hist_lo;
+    double hist_hi;
+    int hist_bins;
+    int precision;
+    double precision_tol;
 } integral_job_t;
 
+typedef struct {
+    const expr_prog_t *prog;
+    double params[EXPR_MAX_PARAMS];
+    const double *table;
+    long table_len;
+    double table_lo;
+    double table_hi;
+} integral_fn_t;
+
+typedef struct {
+    double a;
+    double b;
+    double value;
+    double error;
+    int evaluated;
+} integral_segment_t;
+
+typedef struct {
+    integral_segment_t *heap;
+    long heap_len;
+    long heap_cap;
+    long unevaluated;
+    double heap_err;
+    integral_segment_t *pending;
+    int *pending_count;
+    double *pending_err;
+    double pending_err_sum;
+    long pending_segments;
+    int pending_tasks;
+    int seeded;
+} integral_adapt_t;
+
+typedef struct {
+    int tasks_total;
+    int next_task;
+    int tasks_done;
+    uint64_t assigned;
+    uint64_t count;
+    double sum;
+    double sumsq;
+    double mean_sum;
+    double mean_sumsq;
+} integral_mc_state_t;
+
+typedef struct {
+    double *hist;
+    int *levels;
+    double *est;
+    double *err;
+    int ready;
+    double err_sum;
+    int stopped;
+} integral_prog_t;
+
 typedef struct {
     integral_job_t job;
     int required_workers;
     int *worker_cores;
     int total_cores;
-    int prefix_cores;
+    double *worker_weight;
+    double total_weight;
+    double prefix_weight;
+    char (*worker_host)[INTEGRAL_HOST_ID_MAX];
+    uint64_t *worker_task_us;
+    long *worker_task_n;
+    integral_profile_t *profile;
+    int tasks_built;
+    int tasks_done;
     long assigned_n;
     double next_left;
     double total;
+    double error;
+    double variance;
+    double *sweep_totals;
+    expr_prog_t prog;
+    int has_prog;
+    uint8_t fn_wire[INTEGRAL_FN_WIRE_MAX];
+    size_t fn_wire_len;
+    integral_adapt_t adapt;
+    integral_mc_state_t mc;
+    integral_prog_t prog_state;
+    distr_moments_t moments;
+    distr_hist_t hist;
+    double rounding_bound;
+    int f32_tasks;
 } integral_manager_ctx_t;
 
+typedef struct {
+    int active;
+    long line_no;
+    double a;
+    double b;
+    long n;
+    long next_i;
+    int tasks_out;
+    double total;
+    uint64_t arrival_ms;
+    uint64_t deadline_ms;
+    int at_risk;
+    uint8_t fn_wire[INTEGRAL_FN_WIRE_MAX];
+    size_t fn_wire_len;
+} integral_batch_slot_t;
+
+typedef struct {
+    FILE *in;
+    FILE *out;
+    const char *default_expr;
+    int required_workers;
+    int *worker_cores;
+    int total_cores;
+    long chunk_n;
+    long deadline_ms;
+    double *worker_rate;
+    uint64_t *worker_task_us;
+    long *worker_task_span;
+    long *worker_min_span;
+    char (*worker_host)[INTEGRAL_HOST_ID_MAX];
+    integral_profile_t *profile;
+    integral_batch_slot_t *slots;
+    int slot_count;
+    long line_no;
+    int eof;
+    long jobs_done;
+    long jobs_failed;
+    long deadline_jobs;
+    long deadline_missed;
+    uint64_t max_late_ms;
+} integral_batch_ctx_t;
+
 int integral_manager_ctx_init(integral_manager_ctx_t *ctx, int required_workers, integral_job_t job);
 void integral_manager_ctx_free(integral_manager_ctx_t *ctx);
 
 manager_ops_t integral_manager_ops(integral_manager_ctx_t *ctx);
+
+int integral_batch_ctx_init(integral_batch_ctx_t *ctx, int required_workers, FILE *in, FILE *out, long chunk_n);
+void integral_batch_ctx_free(integral_batch_ctx_t *ctx);
+manager_ops_t integral_batch_manager_ops(integral_batch_ctx_t *ctx);
 worker_ops_t integral_worker_ops(void);
+int integral_kernels_load(const char *dir);
+int integral_set_host_id(const char *host);
+void integral_kernels_unload(void);
 
 uint64_t integral_now_ms(void);
-double integrate_trapz(double a, double b, long n, int threads);
+void integral_fn_eval(const integral_fn_t *fn, const double *const *vars, double *y, int count);
+double integrate_trapz(const integral_fn_t *fn, double a, double b, long n, int threads);
+double integrate_midpoint(const integral_fn_t *fn, double a, double b, long n, int threads);
+int integrate_trapz_sweep(const integral_fn_t *fn,
+                          double a,
+                          double b,
+                          long n,
+                          int threads,
+                          const double *params,
+                          int count,
+                          double *out);
+double integrate_gk15(const integral_fn_t *fn, double a, double b, double *abserr);
 
 #endif
 
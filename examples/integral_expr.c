@@ -0,0 +1,476 @@
+#define _POSIX_C_SOURCE 200809L
+#include "integral_expr.h"
+#include "distr_wire.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPR_PI 3.14159265358979323846
+#define EXPR_E 2.71828182845904523536
+
+typedef struct {
+    const char *src;
+    const char *p;
+    expr_prog_t *prog;
+    int depth;
+    char *err;
+    size_t err_sz;
+    int failed;
+} parser_t;
+
+typedef struct {
+    const char *name;
+    expr_op_t op;
+    int arity;
+} func_def_t;
+
+static const func_def_t g_funcs[] = {
+    {"exp", EXPR_OP_EXP, 1},
+    {"log", EXPR_OP_LOG, 1},
+    {"sin", EXPR_OP_SIN, 1},
+    {"cos", EXPR_OP_COS, 1},
+    {"tan", EXPR_OP_TAN, 1},
+    {"sqrt", EXPR_OP_SQRT, 1},
+    {"abs", EXPR_OP_ABS, 1},
+    {"atan", EXPR_OP_ATAN, 1},
+    {"pow", EXPR_OP_POW, 2}
+};
+
+static int op_is_load(uint8_t op) {
+    return op == EXPR_OP_VAR || op == EXPR_OP_PARAM || op == EXPR_OP_CONST;
+}
+
+static int op_is_binary(uint8_t op) {
+    return op == EXPR_OP_ADD || op == EXPR_OP_SUB || op == EXPR_OP_MUL || op == EXPR_OP_DIV || op == EXPR_OP_POW;
+}
+
+static int op_is_unary(uint8_t op) {
+    return op >= EXPR_OP_NEG && op <= EXPR_OP_ATAN;
+}
+
+static double apply_scalar(uint8_t op, double l, double r) {
+    switch (op) {
+    case EXPR_OP_ADD:
+        return l + r;
+    case EXPR_OP_SUB:
+        return l - r;
+    case EXPR_OP_MUL:
+        return l * r;
+    case EXPR_OP_DIV:
+        return l / r;
+    case EXPR_OP_POW:
+        return pow(l, r);
+    case EXPR_OP_NEG:
+        return -l;
+    case EXPR_OP_EXP:
+        return exp(l);
+    case EXPR_OP_LOG:
+        return log(l);
+    case EXPR_OP_SIN:
+        return sin(l);
+    case EXPR_OP_COS:
+        return cos(l);
+    case EXPR_OP_TAN:
+        return tan(l);
+    case EXPR_OP_SQRT:
+        return sqrt(l);
+    case EXPR_OP_ABS:
+        return fabs(l);
+    case EXPR_OP_ATAN:
+        return atan(l);
+    default:
+        return NAN;
+    }
+}
+
+static void parse_fail(parser_t *ps, const char *what) {
+    if (ps->failed != 0) {
+        return;
+    }
+    ps->failed = 1;
+    if (ps->err != NULL && ps->err_sz > 0U) {
+        (void)snprintf(ps->err, ps->err_sz, "%s at position %d", what, (int)(ps->p - ps->src));
+    }
+}
+
+static void emit(parser_t *ps, uint8_t op, uint8_t arg, double value) {
+    expr_prog_t *prog = ps->prog;
+    expr_insn_t *last = (prog->len > 0) ? &prog->insn[prog->len - 1] : NULL;
+
+    if (ps->failed != 0) {
+        return;
+    }
+    if (op_is_unary(op) && last != NULL && last->op == EXPR_OP_CONST) {
+        last->value = apply_scalar(op, last->value, 0.0);
+        return;
+    }
+    if (op_is_binary(op) && prog->len >= 2 && last->op == EXPR_OP_CONST &&
+        prog->insn[prog->len - 2].op == EXPR_OP_CONST) {
+        prog->insn[prog->len - 2].value = apply_scalar(op, prog->insn[prog->len - 2].value, last->value);
+        --prog->len;
+        --ps->depth;
+        return;
+    }
+    if (prog->len >= EXPR_MAX_INSN) {
+        parse_fail(ps, "expression too long");
+        return;
+    }
+    if (op_is_load(op)) {
+        ++ps->depth;
+        if (ps->depth > EXPR_MAX_STACK) {
+            parse_fail(ps, "expression too deep");
+            return;
+        }
+        if (ps->depth > prog->depth) {
+            prog->depth = ps->depth;
+        }
+    } else if (op_is_binary(op)) {
+        --ps->depth;
+    }
+    prog->insn[prog->len].op = op;
+    prog->insn[prog->len].arg = arg;
+    prog->insn[prog->len].value = value;
+    ++prog->len;
+}
+
+static void skip_ws(parser_t *ps) {
+    while (isspace((unsigned char)*ps->p)) {
+        ++ps->p;
+    }
+}
+
+static int accept_char(parser_t *ps, char c) {
+    skip_ws(ps);
+    if (*ps->p == c) {
+        ++ps->p;
+        return 1;
+    }
+    return 0;
+}
+
+static void parse_expr(parser_t *ps);
+static void parse_unary(parser_t *ps);
+
+static void parse_primary(parser_t *ps) {
+    skip_ws(ps);
+    if (ps->failed != 0) {
+        return;
+    }
+    if (isdigit((unsigned char)*ps->p) || *ps->p == '.') {
+        char *end = NULL;
+        double v = strtod(ps->p, &end);
+        if (end == ps->p) {
+            parse_fail(ps, "bad number");
+            return;
+        }
+        ps->p = end;
+        emit(ps, EXPR_OP_CONST, 0U, v);
+        return;
+    }
+    if (isalpha((unsigned char)*ps->p)) {
+        char name[16];
+        size_t len = 0U;
+        size_t k;
+        while (isalnum((unsigned char)*ps->p) || *ps->p == '_') {
+            if (len + 1U >= sizeof(name)) {
+                parse_fail(ps, "identifier too long");
+                return;
+            }
+            name[len++] = *ps->p++;
+        }
+        name[len] = '\0';
+        if (strcmp(name, "x") == 0 ||
+            (len == 2U && name[0] == 'x' && name[1] >= '0' && name[1] < '0' + EXPR_MAX_VARS)) {
+            int idx = (len == 2U) ? name[1] - '0' : 0;
+            if (idx + 1 > ps->prog->nvars) {
+                ps->prog->nvars = idx + 1;
+            }
+            emit(ps, EXPR_OP_VAR, (uint8_t)idx, 0.0);
+            return;
+        }
+        if (strcmp(name, "pi") == 0) {
+            emit(ps, EXPR_OP_CONST, 0U, EXPR_PI);
+            return;
+        }
+        if (strcmp(name, "e") == 0) {
+            emit(ps, EXPR_OP_CONST, 0U, EXPR_E);
+            return;
+        }
+        if (len == 2U && name[0] == 'p' && name[1] >= '0' && name[1] < '0' + EXPR_MAX_PARAMS) {
+            int idx = name[1] - '0';
+            if (idx + 1 > ps->prog->nparams) {
+                ps->prog->nparams = idx + 1;
+            }
+            emit(ps, EXPR_OP_PARAM, (uint8_t)idx, 0.0);
+            return;
+        }
+        for (k = 0U; k < sizeof(g_funcs) / sizeof(g_funcs[0]); ++k) {
+            if (strcmp(name, g_funcs[k].name) == 0) {
+                int a;
+                if (!accept_char(ps, '(')) {
+                    parse_fail(ps, "expected '('");
+                    return;
+                }
+                for (a = 0; a < g_funcs[k].arity; ++a) {
+                    if (a > 0 && !accept_char(ps, ',')) {
+                        parse_fail(ps, "expected ','");
+                        return;
+                    }
+                    parse_expr(ps);
+                }
+                if (!accept_char(ps, ')')) {
+                    parse_fail(ps, "expected ')'");
+                    return;
+                }
+                emit(ps, (uint8_t)g_funcs[k].op, 0U, 0.0);
+                return;
+            }
+        }
+        parse_fail(ps, "unknown identifier");
+        return;
+    }
+    if (accept_char(ps, '(')) {
+        parse_expr(ps);
+        if (!accept_char(ps, ')')) {
+            parse_fail(ps, "expected ')'");
+        }
+        return;
+    }
+    parse_fail(ps, "unexpected character");
+}
+
+static void parse_power(parser_t *ps) {
+    parse_primary(ps);
+    if (accept_char(ps, '^')) {
+        parse_unary(ps);
+        emit(ps, EXPR_OP_POW, 0U, 0.0);
+    }
+}
+
+static void parse_unary(parser_t *ps) {
+    if (accept_char(ps, '-')) {
+        parse_unary(ps);
+        emit(ps, EXPR_OP_NEG, 0U, 0.0);
+        return;
+    }
+    if (accept_char(ps, '+')) {
+        parse_unary(ps);
+        return;
+    }
+    parse_power(ps);
+}
+
+static void parse_term(parser_t *ps) {
+    parse_unary(ps);
+    while (ps->failed == 0) {
+        if (accept_char(ps, '*')) {
+            parse_unary(ps);
+            emit(ps, EXPR_OP_MUL, 0U, 0.0);
+        } else if (accept_char(ps, '/')) {
+            parse_unary(ps);
+            emit(ps, EXPR_OP_DIV, 0U, 0.0);
+        } else {
+            break;
+        }
+    }
+}
+
+static void parse_expr(parser_t *ps) {
+    parse_term(ps);
+    while (ps->failed == 0) {
+        if (accept_char(ps, '+')) {
+            parse_term(ps);
+            emit(ps, EXPR_OP_ADD, 0U, 0.0);
+        } else if (accept_char(ps, '-')) {
+            parse_term(ps);
+            emit(ps, EXPR_OP_SUB, 0U, 0.0);
+        } else {
+            break;
+        }
+    }
+}
+
+int expr_compile(const char *src, expr_prog_t *prog, char *err, size_t err_sz) {
+    parser_t ps;
+    if (src == NULL || prog == NULL) {
+        return -1;
+    }
+    memset(prog, 0, sizeof(*prog));
+    memset(&ps, 0, sizeof(ps));
+    ps.src = src;
+    ps.p = src;
+    ps.prog = prog;
+    ps.err = err;
+    ps.err_sz = err_sz;
+    parse_expr(&ps);
+    skip_ws(&ps);
+    if (ps.failed == 0 && *ps.p != '\0') {
+        parse_fail(&ps, "trailing input");
+    }
+    return (ps.failed != 0) ? -1 : 0;
+}
+
+size_t expr_encode(const expr_prog_t *prog, uint8_t *out, size_t out_sz) {
+    size_t off = 0U;
+    int i;
+    for (i = 0; i < prog->len; ++i) {
+        const expr_insn_t *in = &prog->insn[i];
+        size_t need = 1U + ((in->op == EXPR_OP_CONST) ? 8U : (op_is_load(in->op) ? 1U : 0U));
+        if (off + need > out_sz) {
+            return 0U;
+        }
+        out[off++] = in->op;
+        if (in->op == EXPR_OP_CONST) {
+            distr_wire_store_f64(out + off, in->value);
+            off += 8U;
+        } else if (op_is_load(in->op)) {
+            out[off++] = in->arg;
+        }
+    }
+    return off;
+}
+
+int expr_decode(const uint8_t *in, size_t in_len, expr_prog_t *prog) {
+    size_t off = 0U;
+    int depth = 0;
+    memset(prog, 0, sizeof(*prog));
+    while (off < in_len) {
+        expr_insn_t *insn;
+        uint8_t op = in[off++];
+        if (prog->len >= EXPR_MAX_INSN) {
+            return -1;
+        }
+        insn = &prog->insn[prog->len++];
+        insn->op = op;
+        if (op == EXPR_OP_CONST) {
+            if (off + 8U > in_len) {
+                return -1;
+            }
+            insn->value = distr_wire_load_f64(in + off);
+            off += 8U;
+        } else if (op == EXPR_OP_VAR || op == EXPR_OP_PARAM) {
+            if (off >= in_len) {
+                return -1;
+            }
+            insn->arg = in[off++];
+            if (op == EXPR_OP_VAR) {
+                if (insn->arg >= EXPR_MAX_VARS) {
+                    return -1;
+                }
+                if ((int)insn->arg + 1 > prog->nvars) {
+                    prog->nvars = (int)insn->arg + 1;
+                }
+            }
+            if (op == EXPR_OP_PARAM) {
+                if (insn->arg >= EXPR_MAX_PARAMS) {
+                    return -1;
+                }
+                if ((int)insn->arg + 1 > prog->nparams) {
+                    prog->nparams = (int)insn->arg + 1;
+                }
+            }
+        } else if (!op_is_binary(op) && !op_is_unary(op)) {
+            return -1;
+        }
+        if (op_is_load(op)) {
+            ++depth;
+        } else if (op_is_binary(op)) {
+            --depth;
+        }
+        if (depth < 1 || depth > EXPR_MAX_STACK) {
+            return -1;
+        }
+        if (depth > prog->depth) {
+            prog->depth = depth;
+        }
+    }
+    return (depth == 1) ? 0 : -1;
+}
+
+int expr_bind_param(expr_prog_t *prog, int param, int var) {
+    int i;
+    if (prog == NULL || param < 0 || param >= EXPR_MAX_PARAMS || var < 0 || var >= EXPR_MAX_VARS) {
+        return -1;
+    }
+    for (i = 0; i < prog->len; ++i) {
+        expr_insn_t *insn = &prog->insn[i];
+        if (insn->op == EXPR_OP_PARAM && (int)insn->arg == param) {
+            insn->op = EXPR_OP_VAR;
+            insn->arg = (uint8_t)var;
+        }
+    }
+    if (var + 1 > prog->nvars) {
+        prog->nvars = var + 1;
+    }
+    return 0;
+}
+
+#define EXPR_BINARY_(T, expr)     \
+    for (k = 0; k < count; ++k) { \
+        T *l = &stack[sp - 2][k]; \
+        *l = (expr);              \
+    }                             \
+    --sp;                         \
+    break;
+
+#define EXPR_UNARY_(fn)           \
+    for (k = 0; k < count; ++k) { \
+        top[k] = fn(top[k]);      \
+    }                             \
+    break;
+
+#define EXPR_EVAL_BLOCK_DEF(name, T, M)                                                                 \
+    void name(const expr_prog_t *prog, const T *const *vars, const double *params, T *out, int count) { \
+        T stack[EXPR_MAX_STACK][EXPR_BLOCK];                                                            \
+        int sp = 0;                                                                                     \
+        int i;                                                                                          \
+        int k;                                                                                          \
+                                                                                                        \
+        for (i = 0; i < prog->len; ++i) {                                                               \
+            const expr_insn_t *in = &prog->insn[i];                                                     \
+            T *top = stack[(sp > 0) ? sp - 1 : 0];                                                      \
+            T *nxt = stack[sp];                                                                         \
+            switch (in->op) {                                                                           \
+            case EXPR_OP_VAR:                                                                           \
+                memcpy(nxt, vars[in->arg], (size_t)count * sizeof(T));                                  \
+                ++sp;                                                                                   \
+                break;                                                                                  \
+            case EXPR_OP_PARAM:                                                                         \
+            case EXPR_OP_CONST: {                                                                       \
+                T v = (T)((in->op == EXPR_OP_PARAM) ? params[in->arg] : in->value);                     \
+                for (k = 0; k < count; ++k) {                                                           \
+                    nxt[k] = v;                                                                         \
+                }                                                                                       \
+                ++sp;                                                                                   \
+                break;                                                                                  \
+            }                                                                                           \
+            case EXPR_OP_ADD: EXPR_BINARY_(T, *l + top[k])                                              \
+            case EXPR_OP_SUB: EXPR_BINARY_(T, *l - top[k])                                              \
+            case EXPR_OP_MUL: EXPR_BINARY_(T, *l * top[k])                                              \
+            case EXPR_OP_DIV: EXPR_BINARY_(T, *l / top[k])                                              \
+            case EXPR_OP_POW: EXPR_BINARY_(T, pow##M(*l, top[k]))                                       \
+            case EXPR_OP_NEG: EXPR_UNARY_(-)                                                            \
+            case EXPR_OP_EXP: EXPR_UNARY_(exp##M)                                                       \
+            case EXPR_OP_LOG: EXPR_UNARY_(log##M)                                                       \
+            case EXPR_OP_SIN: EXPR_UNARY_(sin##M)                                                       \
+            case EXPR_OP_COS: EXPR_UNARY_(cos##M)                                                       \
+            case EXPR_OP_TAN: EXPR_UNARY_(tan##M)                                                       \
+            case EXPR_OP_SQRT: EXPR_UNARY_(sqrt##M)                                                     \
+            case EXPR_OP_ABS: EXPR_UNARY_(fabs##M)                                                      \
+            case EXPR_OP_ATAN: EXPR_UNARY_(atan##M)                                                     \
+            default:                                                                                    \
+                break;                                                                                  \
+            }                                                                                           \
+        }                                                                                               \
+        memcpy(out, stack[0], (size_t)count * sizeof(T));                                               \
+    }
+
+EXPR_EVAL_BLOCK_DEF(expr_eval_block, double, )
+EXPR_EVAL_BLOCK_DEF(expr_eval_block_f32, float, f)
+
+#undef EXPR_EVAL_BLOCK_DEF
+#undef EXPR_UNARY_
+#undef EXPR_BINARY_
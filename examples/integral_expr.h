@@ -0,0 +1,62 @@
+#ifndef INTEGRAL_EXPR_H
+#define INTEGRAL_EXPR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EXPR_MAX_INSN 64
+#define EXPR_MAX_STACK 16
+#define EXPR_MAX_PARAMS 8
+#define EXPR_MAX_VARS 8
+#define EXPR_BLOCK 256
+
+typedef enum {
+    EXPR_OP_VAR = 1,
+    EXPR_OP_PARAM = 2,
+    EXPR_OP_CONST = 3,
+    EXPR_OP_ADD = 4,
+    EXPR_OP_SUB = 5,
+    EXPR_OP_MUL = 6,
+    EXPR_OP_DIV = 7,
+    EXPR_OP_POW = 8,
+    EXPR_OP_NEG = 9,
+    EXPR_OP_EXP = 10,
+    EXPR_OP_LOG = 11,
+    EXPR_OP_SIN = 12,
+    EXPR_OP_COS = 13,
+    EXPR_OP_TAN = 14,
+    EXPR_OP_SQRT = 15,
+    EXPR_OP_ABS = 16,
+    EXPR_OP_ATAN = 17
+} expr_op_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t arg;
+    double value;
+} expr_insn_t;
+
+typedef struct {
+    expr_insn_t insn[EXPR_MAX_INSN];
+    int len;
+    int depth;
+    int nvars;
+    int nparams;
+} expr_prog_t;
+
+int expr_compile(const char *src, expr_prog_t *prog, char *err, size_t err_sz);
+size_t expr_encode(const expr_prog_t *prog, uint8_t *out, size_t out_sz);
+int expr_decode(const uint8_t *in, size_t in_len, expr_prog_t *prog);
+int expr_bind_param(expr_prog_t *prog, int param, int var);
+void expr_eval_block(const expr_prog_t *prog,
+                     const double *const *vars,
+                     const double *params,
+                     double *out,
+                     int count);
+void expr_eval_block_f32(const expr_prog_t *prog,
+                         const float *const *vars,
+                         const double *params,
+                         float *out,
+                         int count);
+
+#endif
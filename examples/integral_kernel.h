@@ -0,0 +1,16 @@
+#ifndef INTEGRAL_KERNEL_H
+#define INTEGRAL_KERNEL_H
+
+#include <stdint.h>
+
+#define INTEGRAL_KERNEL_ABI 1U
+#define INTEGRAL_KERNEL_NAME_MAX 32
+#define INTEGRAL_KERNEL_SYMBOL "integral_kernel"
+
+typedef struct {
+    uint32_t abi_version;
+    const char *name;
+    double (*integrate)(double a, double b, long n, int threads, const double *params, int nparams);
+} integral_kernel_t;
+
+#endif
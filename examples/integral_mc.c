@@ -0,0 +1,286 @@
+#define _POSIX_C_SOURCE 200809L
+#include "integral_mc.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+#define SOBOL_BITS 32
+
+typedef struct {
+    int s;
+    uint32_t a;
+    uint32_t m[5];
+} sobol_poly_t;
+
+static const sobol_poly_t g_sobol_polys[INTEGRAL_MAX_DIMS - 1] = {
+    {1, 0U, {1U}},
+    {2, 1U, {1U, 3U}},
+    {3, 1U, {1U, 3U, 1U}},
+    {3, 2U, {1U, 1U, 1U}},
+    {4, 1U, {1U, 1U, 3U, 3U}},
+    {4, 4U, {1U, 3U, 5U, 13U}},
+    {5, 2U, {1U, 1U, 5U, 5U, 17U}}
+};
+
+typedef struct {
+    const integral_fn_t *fn;
+    int dims;
+    const double *lo;
+    const double *hi;
+    integral_sampler_t sampler;
+    uint32_t key[2];
+    uint32_t stream;
+    const uint32_t (*dirs)[SOBOL_BITS];
+    const uint32_t *scramble;
+    uint64_t begin;
+    uint64_t end;
+    integral_moments_t part;
+    distr_task_local_t *task;
+} mc_thr_ctx_t;
+
+void philox4x32_10(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]) {
+    uint32_t c0 = ctr[0];
+    uint32_t c1 = ctr[1];
+    uint32_t c2 = ctr[2];
+    uint32_t c3 = ctr[3];
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+    int r;
+    for (r = 0; r < 10; ++r) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t)p1;
+        c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+static double u01_from_pair(uint32_t hi, uint32_t lo) {
+    uint64_t bits = ((uint64_t)(hi >> 5) << 26) | (uint64_t)(lo >> 6);
+    return ((double)bits + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static void sobol_init(uint32_t dirs[INTEGRAL_MAX_DIMS][SOBOL_BITS], int dims) {
+    int d;
+    int k;
+    for (k = 0; k < SOBOL_BITS; ++k) {
+        dirs[0][k] = 1U << (SOBOL_BITS - 1 - k);
+    }
+    for (d = 1; d < dims; ++d) {
+        const sobol_poly_t *poly = &g_sobol_polys[d - 1];
+        for (k = 0; k < SOBOL_BITS; ++k) {
+            if (k < poly->s) {
+                dirs[d][k] = poly->m[k] << (SOBOL_BITS - 1 - k);
+            } else {
+                int j;
+                uint32_t v = dirs[d][k - poly->s] ^ (dirs[d][k - poly->s] >> poly->s);
+                for (j = 1; j < poly->s; ++j) {
+                    if (((poly->a >> (poly->s - 1 - j)) & 1U) != 0U) {
+                        v ^= dirs[d][k - j];
+                    }
+                }
+                dirs[d][k] = v;
+            }
+        }
+    }
+}
+
+static uint32_t reverse_bits32(uint32_t x) {
+    x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+    x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+    x = ((x >> 4) & 0x0F0F0F0FU) | ((x & 0x0F0F0F0FU) << 4);
+    x = ((x >> 8) & 0x00FF00FFU) | ((x & 0x00FF00FFU) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+static uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+    x = reverse_bits32(x);
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return reverse_bits32(x);
+}
+
+static void *mc_thr_run(void *arg) {
+    mc_thr_ctx_t *ctx = (mc_thr_ctx_t *)arg;
+    double coords[INTEGRAL_MAX_DIMS][EXPR_BLOCK];
+    const double *vars[INTEGRAL_MAX_DIMS];
+    double ys[EXPR_BLOCK];
+    uint32_t qstate[INTEGRAL_MAX_DIMS];
+    uint64_t i;
+    int d;
+
+    distr_task_bind(ctx->task);
+    memset(&ctx->part, 0, sizeof(ctx->part));
+    for (d = 0; d < ctx->dims; ++d) {
+        vars[d] = coords[d];
+        qstate[d] = 0U;
+    }
+    if (ctx->sampler == INTEGRAL_SAMPLER_QMC) {
+        uint64_t gray = ctx->begin ^ (ctx->begin >> 1);
+        int k;
+        for (k = 0; k < SOBOL_BITS && (gray >> k) != 0U; ++k) {
+            if (((gray >> k) & 1U) != 0U) {
+                for (d = 0; d < ctx->dims; ++d) {
+                    qstate[d] ^= ctx->dirs[d][k];
+                }
+            }
+        }
+    }
+
+    for (i = ctx->begin; i < ctx->end && distr_task_cancelled() == 0;) {
+        int cnt = (ctx->end - i < (uint64_t)EXPR_BLOCK) ? (int)(ctx->end - i) : EXPR_BLOCK;
+        double s = 0.0;
+        double s2 = 0.0;
+        int k;
+        for (k = 0; k < cnt; ++k) {
+            uint64_t idx = i + (uint64_t)k;
+            if (ctx->sampler == INTEGRAL_SAMPLER_QMC) {
+                uint64_t next = idx + 1U;
+                int bit = 0;
+                for (d = 0; d < ctx->dims; ++d) {
+                    uint32_t u = owen_scramble(qstate[d], ctx->scramble[d]);
+                    coords[d][k] = ctx->lo[d] + (ctx->hi[d] - ctx->lo[d]) * (((double)u + 0.5) * (1.0 / 4294967296.0));
+                }
+                while ((next & 1U) == 0U && bit < SOBOL_BITS - 1) {
+                    next >>= 1;
+                    ++bit;
+                }
+                for (d = 0; d < ctx->dims; ++d) {
+                    qstate[d] ^= ctx->dirs[d][bit];
+                }
+            } else {
+                uint32_t ctr[4];
+                uint32_t rnd[4];
+                ctr[0] = (uint32_t)idx;
+                ctr[1] = (uint32_t)(idx >> 32);
+                ctr[2] = ctx->stream;
+                for (d = 0; d < ctx->dims; d += 2) {
+                    ctr[3] = (uint32_t)(d / 2);
+                    philox4x32_10(ctr, ctx->key, rnd);
+                    coords[d][k] = ctx->lo[d] + (ctx->hi[d] - ctx->lo[d]) * u01_from_pair(rnd[0], rnd[1]);
+                    if (d + 1 < ctx->dims) {
+                        coords[d + 1][k] =
+                            ctx->lo[d + 1] + (ctx->hi[d + 1] - ctx->lo[d + 1]) * u01_from_pair(rnd[2], rnd[3]);
+                    }
+                }
+            }
+        }
+        integral_fn_eval(ctx->fn, vars, ys, cnt);
+        for (k = 0; k < cnt; ++k) {
+            s += ys[k];
+            s2 += ys[k] * ys[k];
+        }
+        ctx->part.sum += s;
+        ctx->part.sumsq += s2;
+        ctx->part.count += (uint64_t)cnt;
+        i += (uint64_t)cnt;
+    }
+    return NULL;
+}
+
+int integrate_mc(const integral_fn_t *fn,
+                 int dims,
+                 const double *lo,
+                 const double *hi,
+                 integral_sampler_t sampler,
+                 uint64_t seed,
+                 uint32_t stream,
+                 uint64_t n,
+                 int threads,
+                 integral_moments_t *out) {
+    uint32_t dirs[INTEGRAL_MAX_DIMS][SOBOL_BITS];
+    uint32_t scramble[INTEGRAL_MAX_DIMS];
+    pthread_t *ths = NULL;
+    mc_thr_ctx_t *ctxs = NULL;
+    uint64_t base;
+    uint64_t rem;
+    uint64_t cursor = 0U;
+    int t;
+    int d;
+
+    if (out == NULL || lo == NULL || hi == NULL || dims < 1 || dims > INTEGRAL_MAX_DIMS ||
+        (sampler != INTEGRAL_SAMPLER_MC && sampler != INTEGRAL_SAMPLER_QMC)) {
+        return -1;
+    }
+    if (sampler == INTEGRAL_SAMPLER_QMC && n > 0xFFFFFFFFU) {
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+    if (n == 0U) {
+        return 0;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if ((uint64_t)threads > n) {
+        threads = (int)n;
+    }
+    if (sampler == INTEGRAL_SAMPLER_QMC) {
+        uint32_t key[2];
+        sobol_init(dirs, dims);
+        key[0] = (uint32_t)seed;
+        key[1] = (uint32_t)(seed >> 32);
+        for (d = 0; d < dims; ++d) {
+            uint32_t ctr[4];
+            uint32_t rnd[4];
+            ctr[0] = (uint32_t)d;
+            ctr[1] = 0U;
+            ctr[2] = stream;
+            ctr[3] = 0x80000000U;
+            philox4x32_10(ctr, key, rnd);
+            scramble[d] = rnd[0];
+        }
+    }
+
+    ths = (pthread_t *)calloc((size_t)threads, sizeof(*ths));
+    ctxs = (mc_thr_ctx_t *)calloc((size_t)threads, sizeof(*ctxs));
+    if (ths == NULL || ctxs == NULL) {
+        free(ths);
+        free(ctxs);
+        return -1;
+    }
+    base = n / (uint64_t)threads;
+    rem = n % (uint64_t)threads;
+    for (t = 0; t < threads; ++t) {
+        uint64_t span = base + (((uint64_t)t < rem) ? 1U : 0U);
+        ctxs[t].fn = fn;
+        ctxs[t].dims = dims;
+        ctxs[t].lo = lo;
+        ctxs[t].hi = hi;
+        ctxs[t].sampler = sampler;
+        ctxs[t].key[0] = (uint32_t)seed;
+        ctxs[t].key[1] = (uint32_t)(seed >> 32);
+        ctxs[t].stream = stream;
+        ctxs[t].dirs = (const uint32_t(*)[SOBOL_BITS])dirs;
+        ctxs[t].scramble = scramble;
+        ctxs[t].begin = cursor;
+        ctxs[t].end = cursor + span;
+        ctxs[t].task = distr_task_current();
+        cursor += span;
+        (void)pthread_create(&ths[t], NULL, mc_thr_run, &ctxs[t]);
+    }
+    for (t = 0; t < threads; ++t) {
+        (void)pthread_join(ths[t], NULL);
+        out->sum += ctxs[t].part.sum;
+        out->sumsq += ctxs[t].part.sumsq;
+        out->count += ctxs[t].part.count;
+    }
+    free(ths);
+    free(ctxs);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef INTEGRAL_MC_H
+#define INTEGRAL_MC_H
+
+#include "integral_app.h"
+
+#include <stdint.h>
+
+typedef enum {
+    INTEGRAL_SAMPLER_MC = 1,
+    INTEGRAL_SAMPLER_QMC = 2
+} integral_sampler_t;
+
+typedef struct {
+    uint64_t count;
+    double sum;
+    double sumsq;
+} integral_moments_t;
+
+void philox4x32_10(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]);
+int integrate_mc(const integral_fn_t *fn,
+                 int dims,
+                 const double *lo,
+                 const double *hi,
+                 integral_sampler_t sampler,
+                 uint64_t seed,
+                 uint32_t stream,
+                 uint64_t n,
+                 int threads,
+                 integral_moments_t *out);
+
+#endif
@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L
+#include "integral_profile.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int integral_profile_host_ok(const char *host) {
+    size_t k;
+    for (k = 0; host[k] != '\0'; ++k) {
+        if (k + 1U >= INTEGRAL_HOST_ID_MAX || !isgraph((unsigned char)host[k])) {
+            return 0;
+        }
+    }
+    return k > 0U;
+}
+
+static integral_profile_entry_t *profile_slot(integral_profile_t *p, const char *host) {
+    integral_profile_entry_t *e;
+    int k;
+    for (k = 0; k < p->count; ++k) {
+        if (strcmp(p->entries[k].host, host) == 0) {
+            return &p->entries[k];
+        }
+    }
+    if (p->count == p->cap) {
+        int cap = (p->cap > 0) ? 2 * p->cap : 16;
+        e = (integral_profile_entry_t *)realloc(p->entries, (size_t)cap * sizeof(*e));
+        if (e == NULL) {
+            return NULL;
+        }
+        p->entries = e;
+        p->cap = cap;
+    }
+    e = &p->entries[p->count++];
+    memset(e, 0, sizeof(*e));
+    (void)snprintf(e->host, sizeof(e->host), "%s", host);
+    return e;
+}
+
+int integral_profile_load(integral_profile_t *p, const char *path) {
+    char line[256];
+    FILE *f;
+    long line_no = 0;
+    int rc = 0;
+
+    memset(p, 0, sizeof(*p));
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return (errno == ENOENT) ? 0 : -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        integral_profile_entry_t e;
+        integral_profile_entry_t *slot;
+        char tail;
+        ++line_no;
+        if (strchr(line, '\n') == NULL && !feof(f)) {
+            int c;
+            while ((c = fgetc(f)) != EOF && c != '\n') {
+            }
+            fprintf(stderr, "[integral] %s:%ld: profile line too long, skipped\n", path, line_no);
+            continue;
+        }
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "%31s %lf %lf %ld %c", e.host, &e.rate, &e.overhead_us, &e.samples, &tail) != 4 ||
+            !integral_profile_host_ok(e.host) || e.rate <= 0.0 || e.overhead_us < 0.0 || e.samples < 1) {
+            fprintf(stderr, "[integral] %s:%ld: bad profile line, skipped\n", path, line_no);
+            continue;
+        }
+        slot = profile_slot(p, e.host);
+        if (slot == NULL) {
+            rc = -1;
+            break;
+        }
+        *slot = e;
+    }
+    fclose(f);
+    if (rc != 0) {
+        integral_profile_free(p);
+    }
+    return rc;
+}
+
+int integral_profile_save(const integral_profile_t *p, const char *path) {
+    char tmp[4096];
+    FILE *f;
+    int k;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        return -1;
+    }
+    f = fopen(tmp, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    for (k = 0; k < p->count; ++k) {
+        const integral_profile_entry_t *e = &p->entries[k];
+        fprintf(f, "%s %.6e %.1f %ld\n", e->host, e->rate, e->overhead_us, e->samples);
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        (void)remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void integral_profile_free(integral_profile_t *p) {
+    if (p == NULL) {
+        return;
+    }
+    free(p->entries);
+    memset(p, 0, sizeof(*p));
+}
+
+const integral_profile_entry_t *integral_profile_find(const integral_profile_t *p, const char *host) {
+    int k;
+    for (k = 0; p != NULL && host[0] != '\0' && k < p->count; ++k) {
+        if (strcmp(p->entries[k].host, host) == 0) {
+            return &p->entries[k];
+        }
+    }
+    return NULL;
+}
+
+int integral_profile_record(integral_profile_t *p, const char *host, double rate, double overhead_us) {
+    integral_profile_entry_t *e;
+    if (p == NULL || !integral_profile_host_ok(host) || !(rate > 0.0) || overhead_us < 0.0) {
+        return -1;
+    }
+    e = profile_slot(p, host);
+    if (e == NULL) {
+        return -1;
+    }
+    if (e->samples > 0) {
+        e->rate = 0.7 * e->rate + 0.3 * rate;
+        e->overhead_us = 0.7 * e->overhead_us + 0.3 * overhead_us;
+    } else {
+        e->rate = rate;
+        e->overhead_us = overhead_us;
+    }
+    ++e->samples;
+    return 0;
+}
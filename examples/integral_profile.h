@@ -0,0 +1,27 @@
+#ifndef INTEGRAL_PROFILE_H
+#define INTEGRAL_PROFILE_H
+
+#define INTEGRAL_HOST_ID_MAX 32
+#define INTEGRAL_PROFILE_GRAIN 20.0
+
+typedef struct {
+    char host[INTEGRAL_HOST_ID_MAX];
+    double rate;
+    double overhead_us;
+    long samples;
+} integral_profile_entry_t;
+
+typedef struct {
+    integral_profile_entry_t *entries;
+    int count;
+    int cap;
+} integral_profile_t;
+
+int integral_profile_host_ok(const char *host);
+int integral_profile_load(integral_profile_t *p, const char *path);
+int integral_profile_save(const integral_profile_t *p, const char *path);
+void integral_profile_free(integral_profile_t *p);
+const integral_profile_entry_t *integral_profile_find(const integral_profile_t *p, const char *host);
+int integral_profile_record(integral_profile_t *p, const char *host, double rate, double overhead_us);
+
+#endif
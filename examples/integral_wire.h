@@ -0,0 +1,155 @@
+#ifndef INTEGRAL_WIRE_H
+#define INTEGRAL_WIRE_H
+
+#include "distr.h"
+#include "distr_wire.h"
+#include "integral_expr.h"
+#include "integral_profile.h"
+
+enum {
+    TASK_KIND_TRAPZ = 1,
+    TASK_KIND_GK15 = 2,
+    TASK_KIND_MC = 3,
+    TASK_KIND_QMC = 4,
+    TASK_KIND_SWEEP = 5,
+    TASK_KIND_KERNEL = 6,
+    TASK_KIND_TRAPZ_PROG = 7,
+    TASK_KIND_HIST = 8
+};
+
+enum {
+    TASK_PRECISION_F64 = 0,
+    TASK_PRECISION_F32 = 1
+};
+
+enum {
+    WIRE_HELLO = 16,
+    WIRE_RESULT = 17,
+    WIRE_PARTIAL = 18,
+    WIRE_VEC_RESULT = 19,
+    WIRE_MC_RESULT = 20,
+    WIRE_FN_EXPR = 21,
+    WIRE_FN_TABLE = 22,
+    WIRE_FN_KERNEL = 23,
+    WIRE_HIST_RESULT = 24
+};
+
+#define HELLO_WIRE_FIELDS(F, A, M) \
+    F(M, u32, cores)               \
+    F(M, u32, kernel_count)        \
+    A(M, u8, host, INTEGRAL_HOST_ID_MAX)
+DISTR_WIRE_MESSAGE(hello_wire, 1, HELLO_WIRE_FIELDS)
+
+#define TASK_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                 \
+    F(M, u32, threads)            \
+    F(M, f64, a)                  \
+    F(M, f64, b)                  \
+    F(M, i64, n)                  \
+    F(M, u32, precision)          \
+    F(M, u32, reserved)           \
+    F(M, f64, tol)
+DISTR_WIRE_MESSAGE(task_wire, 1, TASK_WIRE_FIELDS)
+
+#define SWEEP_TASK_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                       \
+    F(M, u32, threads)                  \
+    F(M, u32, count)                    \
+    F(M, u32, reserved)                 \
+    F(M, f64, a)                        \
+    F(M, f64, b)                        \
+    F(M, i64, n)
+DISTR_WIRE_MESSAGE(sweep_task_wire, 1, SWEEP_TASK_WIRE_FIELDS)
+
+#define GK_TASK_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                    \
+    F(M, u32, threads)               \
+    F(M, u32, count)                 \
+    F(M, u32, reserved)
+DISTR_WIRE_MESSAGE(gk_task_wire, 1, GK_TASK_WIRE_FIELDS)
+
+#define MC_TASK_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                    \
+    F(M, u32, threads)               \
+    F(M, u32, dims)                  \
+    F(M, u32, reserved)              \
+    F(M, u64, n)                     \
+    F(M, u64, seed)
+DISTR_WIRE_MESSAGE(mc_task_wire, 1, MC_TASK_WIRE_FIELDS)
+
+#define HIST_TASK_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                      \
+    F(M, u32, threads)                 \
+    F(M, u32, bins)                    \
+    F(M, u32, reserved)                \
+    F(M, f64, a)                       \
+    F(M, f64, b)                       \
+    F(M, i64, n)                       \
+    F(M, f64, lo)                      \
+    F(M, f64, hi)
+DISTR_WIRE_MESSAGE(hist_task_wire, 1, HIST_TASK_WIRE_FIELDS)
+
+#define RESULT_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                   \
+    F(M, u32, precision)            \
+    F(M, f64, value)                \
+    F(M, f64, error_bound)          \
+    F(M, u64, exec_us)
+DISTR_WIRE_MESSAGE(result_wire, 1, RESULT_WIRE_FIELDS)
+
+#define PARTIAL_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                    \
+    F(M, u32, level)                 \
+    F(M, f64, value)
+DISTR_WIRE_MESSAGE(partial_wire, 1, PARTIAL_WIRE_FIELDS)
+
+#define VEC_RESULT_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                       \
+    F(M, u32, count)
+DISTR_WIRE_MESSAGE(vec_result_wire, 1, VEC_RESULT_WIRE_FIELDS)
+
+#define MC_RESULT_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                      \
+    F(M, u32, reserved)                \
+    F(M, u64, count)                   \
+    F(M, f64, sum)                     \
+    F(M, f64, sumsq)
+DISTR_WIRE_MESSAGE(mc_result_wire, 1, MC_RESULT_WIRE_FIELDS)
+
+#define HIST_RESULT_WIRE_FIELDS(F, A, M) \
+    F(M, u32, id)                        \
+    F(M, u32, bins)                      \
+    F(M, u64, count)                     \
+    F(M, f64, min)                       \
+    F(M, f64, max)                       \
+    F(M, f64, mean)                      \
+    F(M, f64, m2)                        \
+    F(M, u64, under)                     \
+    F(M, u64, over)                      \
+    A(M, u64, counts, DISTR_HIST_MAX_BINS)
+DISTR_WIRE_MESSAGE(hist_result_wire, 1, HIST_RESULT_WIRE_FIELDS)
+
+#define FN_EXPR_WIRE_FIELDS(F, A, M) \
+    F(M, u16, code_len)              \
+    F(M, u8, nparams)                \
+    F(M, u8, reserved8)              \
+    F(M, u32, reserved)              \
+    A(M, f64, params, EXPR_MAX_PARAMS)
+DISTR_WIRE_MESSAGE(fn_expr_wire, 1, FN_EXPR_WIRE_FIELDS)
+
+#define FN_TABLE_WIRE_FIELDS(F, A, M) \
+    F(M, u32, blob)                   \
+    F(M, u32, reserved)               \
+    F(M, f64, lo)                     \
+    F(M, f64, hi)
+DISTR_WIRE_MESSAGE(fn_table_wire, 1, FN_TABLE_WIRE_FIELDS)
+
+#define FN_KERNEL_WIRE_FIELDS(F, A, M) \
+    F(M, u8, name_len)                 \
+    F(M, u8, nparams)                  \
+    F(M, u16, reserved16)              \
+    F(M, u32, reserved)                \
+    A(M, f64, params, EXPR_MAX_PARAMS)
+DISTR_WIRE_MESSAGE(fn_kernel_wire, 1, FN_KERNEL_WIRE_FIELDS)
+
+#endif
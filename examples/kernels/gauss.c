@@ -0,0 +1,25 @@
+#include "integral_kernel.h"
+
+#include <math.h>
+
+extern const integral_kernel_t integral_kernel;
+
+static double gauss_integrate(double a, double b, long n, int threads, const double *params, int nparams) {
+    double k = (nparams > 0 && params[0] > 0.0) ? params[0] : 1.0;
+    double h;
+    double sum;
+    long i;
+    (void)threads;
+    if (n < 1) {
+        return 0.0;
+    }
+    h = (b - a) / (double)n;
+    sum = 0.5 * (exp(-k * a * a) + exp(-k * b * b));
+    for (i = 1; i < n; ++i) {
+        double x = a + h * (double)i;
+        sum += exp(-k * x * x);
+    }
+    return sum * h;
+}
+
+const integral_kernel_t integral_kernel = {INTEGRAL_KERNEL_ABI, "gauss", gauss_integrate};
@@ -1,12 +1,224 @@
 #include "distr.h"
 #include "integral_app.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 static void usage(const char *argv0) {
-    fprintf(stderr, "Usage: %s <workers> <host> <port> --a <A> --b <B> --n <N> [--timeout <sec>]\n", argv0);
+    fprintf(stderr,
+            "Usage: %s <workers> <host> <port> --a <A> --b <B> --n <N> [--mode fixed|adaptive|mc|qmc|hist] [--tol <T>]\n"
+            "       [--box <a0:b0,a1:b1,...>] [--seed <S>] [--expr <f(x)>] [--param <v>]... [--sweep <from:to:count>]\n"
+            "       [--hist <lo:hi:bins>] [--precision f64|f32[:tol]] [--kernel <name>] [--table <file:lo:hi>] [--timeout <sec>] [--inproc <cores>] [--trace <file.json>]\n"
+            "       [--control <socket>] [--profile <file>] [--local-cores <N>] [--announce <udp-port>]\n"
+            "       [--announce-addr <addr>] [--speculate]\n"
+            "       %s <workers> <host> <port> --batch <file|-> [--out <file|->] [--chunk <N>] [--expr <f(x)>]\n"
+            "       [--deadline <ms>] [--timeout <sec>] [--inproc <cores>] [--control <socket>] [--profile <file>]\n"
+            "       [--local-cores <N>] [--announce <udp-port>] [--announce-addr <addr>] [--speculate]\n",
+            argv0,
+            argv0);
+}
+
+static int run_job(const manager_cfg_t *mcfg, const manager_ops_t *ops, int inproc_cores) {
+    manager_cfg_t cfg = *mcfg;
+    worker_cfg_t wcfg;
+    worker_ops_t wops;
+    memset(&wcfg, 0, sizeof(wcfg));
+    wcfg.max_cores = (inproc_cores > 0) ? inproc_cores : mcfg->local_cores;
+    wcfg.max_time_sec = mcfg->max_time_sec;
+    wops = integral_worker_ops();
+    wops.user_ctx = &wcfg;
+    if (inproc_cores < 1) {
+        cfg.local_ops = (cfg.local_cores > 0) ? &wops : NULL;
+        return run_manager(&cfg, ops);
+    }
+    return run_local(ops, &wops, mcfg->required_workers, inproc_cores);
+}
+
+static int profile_open(const char *path, integral_profile_t *profile) {
+    if (path == NULL) {
+        memset(profile, 0, sizeof(*profile));
+        return 0;
+    }
+    if (integral_profile_load(profile, path) != 0) {
+        fprintf(stderr, "[integral] cannot read profile %s\n", path);
+        return -1;
+    }
+    fprintf(stderr, "[integral] profile %s: %d host(s)\n", path, profile->count);
+    return 0;
+}
+
+static int profile_close(const char *path, integral_profile_t *profile, int rc) {
+    if (path != NULL && integral_profile_save(profile, path) != 0) {
+        fprintf(stderr, "[integral] cannot save profile %s\n", path);
+        rc = (rc == 0) ? 3 : rc;
+    }
+    integral_profile_free(profile);
+    return rc;
+}
+
+static int run_batch(const manager_cfg_t *mcfg, const char *in_path, const char *out_path, long chunk_n,
+                     long deadline_ms, const char *expr, int inproc_cores, const char *profile_path) {
+    integral_batch_ctx_t batch;
+    integral_profile_t profile;
+    manager_ops_t ops;
+    FILE *in = stdin;
+    FILE *out = stdout;
+    uint64_t t0;
+    uint64_t t1;
+    int rc;
+
+    if (profile_open(profile_path, &profile) != 0) {
+        return 2;
+    }
+    if (strcmp(in_path, "-") != 0) {
+        in = fopen(in_path, "r");
+        if (in == NULL) {
+            perror(in_path);
+            integral_profile_free(&profile);
+            return 2;
+        }
+    }
+    if (out_path != NULL && strcmp(out_path, "-") != 0) {
+        out = fopen(out_path, "w");
+        if (out == NULL) {
+            perror(out_path);
+            if (in != stdin) {
+                fclose(in);
+            }
+            integral_profile_free(&profile);
+            return 2;
+        }
+    }
+    if (integral_batch_ctx_init(&batch, mcfg->required_workers, in, out, chunk_n) != 0) {
+        integral_profile_free(&profile);
+        rc = 2;
+        goto done;
+    }
+    batch.default_expr = expr;
+    batch.deadline_ms = deadline_ms;
+    batch.profile = (profile_path != NULL) ? &profile : NULL;
+    ops = integral_batch_manager_ops(&batch);
+    t0 = integral_now_ms();
+    rc = run_job(mcfg, &ops, inproc_cores);
+    t1 = integral_now_ms();
+    fprintf(stderr, "BATCH_JOBS=%ld\n", batch.jobs_done);
+    fprintf(stderr, "BATCH_FAILED=%ld\n", batch.jobs_failed);
+    if (batch.deadline_jobs > 0) {
+        fprintf(stderr, "BATCH_DEADLINE_JOBS=%ld\n", batch.deadline_jobs);
+        fprintf(stderr, "BATCH_DEADLINE_MISSED=%ld\n", batch.deadline_missed);
+        fprintf(stderr, "BATCH_MAX_LATE_MS=%llu\n", (unsigned long long)batch.max_late_ms);
+    }
+    fprintf(stderr, "TOTAL_TIME_SEC=%.6f\n", (double)(t1 - t0) / 1000.0);
+    integral_batch_ctx_free(&batch);
+    rc = profile_close(profile_path, &profile, rc);
+done:
+    if (in != stdin) {
+        fclose(in);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    return rc;
+}
+
+static int parse_sweep(const char *s, double *values, int *count) {
+    char *end = NULL;
+    double from;
+    double to;
+    long cnt;
+    int q;
+    from = strtod(s, &end);
+    if (end == s || *end != ':') {
+        return -1;
+    }
+    s = end + 1;
+    to = strtod(s, &end);
+    if (end == s || *end != ':') {
+        return -1;
+    }
+    s = end + 1;
+    cnt = strtol(s, &end, 10);
+    if (end == s || *end != '\0' || cnt < 1 || cnt > INTEGRAL_SWEEP_MAX) {
+        return -1;
+    }
+    for (q = 0; q < (int)cnt; ++q) {
+        values[q] = (cnt == 1) ? from : from + (to - from) * ((double)q / (double)(cnt - 1));
+    }
+    *count = (int)cnt;
+    return 0;
+}
+
+static int parse_table(const char *s, char *path, size_t path_sz, integral_job_t *job) {
+    const char *hi = strrchr(s, ':');
+    const char *lo;
+    char *end = NULL;
+    if (hi == NULL || hi == s) {
+        return -1;
+    }
+    for (lo = hi - 1; lo > s && *lo != ':'; --lo) {
+    }
+    if (lo == s || (size_t)(lo - s) >= path_sz) {
+        return -1;
+    }
+    memcpy(path, s, (size_t)(lo - s));
+    path[lo - s] = '\0';
+    job->table_lo = strtod(lo + 1, &end);
+    if (end != hi) {
+        return -1;
+    }
+    job->table_hi = strtod(hi + 1, &end);
+    if (end == hi + 1 || *end != '\0' || job->table_hi <= job->table_lo) {
+        return -1;
+    }
+    job->use_table = 1;
+    job->table_blob = 0;
+    return 0;
+}
+
+static int parse_hist(const char *s, integral_job_t *job) {
+    char *end = NULL;
+    long bins;
+    job->hist_lo = strtod(s, &end);
+    if (end == s || *end != ':') {
+        return -1;
+    }
+    s = end + 1;
+    job->hist_hi = strtod(s, &end);
+    if (end == s || *end != ':') {
+        return -1;
+    }
+    s = end + 1;
+    bins = strtol(s, &end, 10);
+    if (end == s || *end != '\0' || bins < 1 || bins > DISTR_HIST_MAX_BINS || job->hist_hi <= job->hist_lo) {
+        return -1;
+    }
+    job->hist_bins = (int)bins;
+    return 0;
+}
+
+static int parse_box(const char *s, integral_job_t *job) {
+    int dims = 0;
+    while (*s != '\0') {
+        char *end = NULL;
+        if (dims >= INTEGRAL_MAX_DIMS) {
+            return -1;
+        }
+        job->lo[dims] = strtod(s, &end);
+        if (end == s || *end != ':') {
+            return -1;
+        }
+        s = end + 1;
+        job->hi[dims] = strtod(s, &end);
+        if (end == s || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        ++dims;
+        s = (*end == ',') ? end + 1 : end;
+    }
+    job->dims = dims;
+    return (dims > 0) ? 0 : -1;
 }
 
 int main(int argc, char **argv) {
@@ -14,22 +226,56 @@ int main(int argc, char **argv) {
     integral_job_t job;
     integral_manager_ctx_t app_ctx;
     manager_ops_t ops;
+    static double sweep[INTEGRAL_SWEEP_MAX];
+    static char table_path[4096];
+    const char *blob_paths[1];
     uint64_t t0;
     uint64_t t1;
+    const char *batch_path = NULL;
+    const char *out_path = NULL;
+    const char *profile_path = NULL;
+    integral_profile_t profile;
+    long chunk_n = INTEGRAL_BATCH_CHUNK;
+    long deadline_ms = -1;
+    int nparams = 0;
+    int inproc_cores = 0;
     int rc;
     int i;
 
-    if (argc < 8) {
+    if (argc < 6) {
         usage(argv[0]);
         return 1;
     }
+    memset(&mcfg, 0, sizeof(mcfg));
     mcfg.required_workers = atoi(argv[1]);
     mcfg.host = argv[2];
     mcfg.port = argv[3];
     mcfg.max_time_sec = 30;
+    mcfg.announce_host = "255.255.255.255";
     job.a = 0.0;
     job.b = 1.0;
     job.n = 100000;
+    job.mode = INTEGRAL_MODE_FIXED;
+    job.tol = 1e-10;
+    job.expr = NULL;
+    memset(job.params, 0, sizeof(job.params));
+    job.dims = 1;
+    job.lo[0] = 0.0;
+    job.hi[0] = 1.0;
+    job.seed = 1U;
+    job.sweep = NULL;
+    job.sweep_len = 0;
+    job.kernel = NULL;
+    job.progressive = 0;
+    job.use_table = 0;
+    job.table_blob = -1;
+    job.table_lo = 0.0;
+    job.table_hi = 0.0;
+    job.hist_lo = 0.0;
+    job.hist_hi = 1.0;
+    job.hist_bins = 10;
+    job.precision = 0;
+    job.precision_tol = 0.0;
 
     for (i = 4; i < argc; ++i) {
         if (strcmp(argv[i], "--a") == 0 && i + 1 < argc) {
@@ -38,25 +284,191 @@ int main(int argc, char **argv) {
             job.b = atof(argv[++i]);
         } else if (strcmp(argv[i], "--n") == 0 && i + 1 < argc) {
             job.n = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            ++i;
+            if (strcmp(argv[i], "fixed") == 0) {
+                job.mode = INTEGRAL_MODE_FIXED;
+            } else if (strcmp(argv[i], "adaptive") == 0) {
+                job.mode = INTEGRAL_MODE_ADAPTIVE;
+            } else if (strcmp(argv[i], "mc") == 0) {
+                job.mode = INTEGRAL_MODE_MC;
+            } else if (strcmp(argv[i], "qmc") == 0) {
+                job.mode = INTEGRAL_MODE_QMC;
+            } else if (strcmp(argv[i], "hist") == 0) {
+                job.mode = INTEGRAL_MODE_HIST;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--tol") == 0 && i + 1 < argc) {
+            job.tol = atof(argv[++i]);
+            job.progressive = 1;
+        } else if (strcmp(argv[i], "--box") == 0 && i + 1 < argc) {
+            if (parse_box(argv[++i], &job) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            job.seed = (uint64_t)strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--expr") == 0 && i + 1 < argc) {
+            job.expr = argv[++i];
+        } else if (strcmp(argv[i], "--param") == 0 && i + 1 < argc && nparams < EXPR_MAX_PARAMS) {
+            job.params[nparams++] = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            ++i;
+            if (strcmp(argv[i], "f64") == 0) {
+                job.precision = 0;
+            } else if (strncmp(argv[i], "f32", 3) == 0 && (argv[i][3] == '\0' || argv[i][3] == ':')) {
+                job.precision = 1;
+                job.precision_tol = (argv[i][3] == ':') ? atof(argv[i] + 4) : 0.0;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--hist") == 0 && i + 1 < argc) {
+            if (parse_hist(argv[++i], &job) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            if (parse_sweep(argv[++i], sweep, &job.sweep_len) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            job.sweep = sweep;
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            job.kernel = argv[++i];
+        } else if (strcmp(argv[i], "--table") == 0 && i + 1 < argc) {
+            if (parse_table(argv[++i], table_path, sizeof(table_path), &job) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            blob_paths[0] = table_path;
+            mcfg.blob_paths = blob_paths;
+            mcfg.blob_count = 1;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_path = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+            chunk_n = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--deadline") == 0 && i + 1 < argc) {
+            deadline_ms = atol(argv[++i]);
+            if (deadline_ms < 0) {
+                usage(argv[0]);
+                return 1;
+            }
         } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
             mcfg.max_time_sec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            mcfg.trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--control") == 0 && i + 1 < argc) {
+            mcfg.control_path = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (strcmp(argv[i], "--speculate") == 0) {
+            mcfg.speculate = 1;
+        } else if (strcmp(argv[i], "--announce") == 0 && i + 1 < argc) {
+            mcfg.announce_port = argv[++i];
+        } else if (strcmp(argv[i], "--announce-addr") == 0 && i + 1 < argc) {
+            mcfg.announce_host = argv[++i];
+        } else if (strcmp(argv[i], "--local-cores") == 0 && i + 1 < argc) {
+            mcfg.local_cores = atoi(argv[++i]);
+            if (mcfg.local_cores < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--inproc") == 0 && i + 1 < argc) {
+            inproc_cores = atoi(argv[++i]);
+            if (inproc_cores < 1) {
+                usage(argv[0]);
+                return 1;
+            }
         } else {
             usage(argv[0]);
             return 1;
         }
     }
+    if (mcfg.local_cores > 0) {
+        if (inproc_cores > 0 || job.use_table != 0) {
+            fprintf(stderr, "--local-cores excludes --inproc/--table\n");
+            return 1;
+        }
+        ++mcfg.required_workers;
+    }
+    if (batch_path != NULL) {
+        return run_batch(&mcfg, batch_path, out_path, chunk_n, deadline_ms, job.expr, inproc_cores, profile_path);
+    }
+    if (job.sweep_len > 0 && (job.expr == NULL || job.mode != INTEGRAL_MODE_FIXED)) {
+        fprintf(stderr, "--sweep requires --expr and --mode fixed\n");
+        return 1;
+    }
+    if (job.use_table != 0 &&
+        (job.expr != NULL || job.kernel != NULL || job.sweep_len > 0 || job.dims != 1 || inproc_cores > 0)) {
+        fprintf(stderr, "--table excludes --expr/--kernel/--sweep/--box/--inproc\n");
+        return 1;
+    }
+    if (job.mode != INTEGRAL_MODE_FIXED || job.kernel != NULL || job.sweep_len > 0) {
+        job.progressive = 0;
+    }
+    if (job.kernel != NULL && (job.expr != NULL || job.sweep_len > 0 || job.mode != INTEGRAL_MODE_FIXED)) {
+        fprintf(stderr, "--kernel requires --mode fixed and excludes --expr/--sweep\n");
+        return 1;
+    }
+    if (profile_open(profile_path, &profile) != 0) {
+        return 2;
+    }
     if (integral_manager_ctx_init(&app_ctx, mcfg.required_workers, job) != 0) {
+        integral_profile_free(&profile);
         return 2;
     }
+    app_ctx.profile = (profile_path != NULL) ? &profile : NULL;
     ops = integral_manager_ops(&app_ctx);
     t0 = integral_now_ms();
-    rc = run_manager(&mcfg, &ops);
+    rc = run_job(&mcfg, &ops, inproc_cores);
     t1 = integral_now_ms();
     if (rc == 0) {
-        printf("INTEGRAL=%.12f\n", app_ctx.total);
+        if (job.sweep_len > 0) {
+            for (i = 0; i < job.sweep_len; ++i) {
+                printf("SWEEP p0=%.12g INTEGRAL=%.12f\n", job.sweep[i], app_ctx.sweep_totals[i]);
+            }
+        } else if (job.mode == INTEGRAL_MODE_HIST) {
+            double w = (job.hist_hi - job.hist_lo) / (double)job.hist_bins;
+            printf("HIST_COUNT=%llu\n", (unsigned long long)app_ctx.moments.count);
+            printf("HIST_MIN=%.12g\n", app_ctx.moments.min);
+            printf("HIST_MAX=%.12g\n", app_ctx.moments.max);
+            printf("HIST_MEAN=%.12g\n", app_ctx.moments.mean);
+            printf("HIST_STDDEV=%.12g\n", sqrt(distr_moments_variance(&app_ctx.moments)));
+            printf("HIST_UNDER=%llu\n", (unsigned long long)app_ctx.hist.under);
+            printf("HIST_OVER=%llu\n", (unsigned long long)app_ctx.hist.over);
+            for (i = 0; i < job.hist_bins; ++i) {
+                printf("HIST_BIN %.12g %.12g %llu\n", job.hist_lo + w * (double)i, job.hist_lo + w * (double)(i + 1),
+                       (unsigned long long)app_ctx.hist.count[i]);
+            }
+        } else {
+            printf("INTEGRAL=%.12f\n", app_ctx.total);
+        }
+        if (job.precision != 0) {
+            printf("ROUNDING_BOUND=%.3e\n", app_ctx.rounding_bound);
+            printf("F32_TASKS=%d/%d\n", app_ctx.f32_tasks, app_ctx.tasks_done);
+        }
+        if (job.progressive != 0) {
+            printf("ERROR_EST=%.3e\n", app_ctx.error);
+            printf("EARLY_STOP=%d\n", app_ctx.prog_state.stopped);
+        }
+        if (job.mode == INTEGRAL_MODE_ADAPTIVE) {
+            printf("ERROR_EST=%.3e\n", app_ctx.error);
+            printf("INTERVALS=%ld\n", app_ctx.adapt.heap_len);
+        }
+        if (job.mode == INTEGRAL_MODE_MC || job.mode == INTEGRAL_MODE_QMC) {
+            printf("STDERR=%.3e\n", app_ctx.error);
+            printf("VARIANCE=%.6e\n", app_ctx.variance);
+            printf("SAMPLES=%llu\n", (unsigned long long)app_ctx.mc.count);
+        }
         printf("TOTAL_TIME_SEC=%.6f\n", (double)(t1 - t0) / 1000.0);
         printf("TOTAL_CORES=%d\n", app_ctx.total_cores);
     }
+    rc = profile_close(profile_path, &profile, rc);
     integral_manager_ctx_free(&app_ctx);
     return rc;
 }
@@ -0,0 +1,160 @@
+#define _POSIX_C_SOURCE 200809L
+#include "distr.h"
+#include "integral_app.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MULTI_MAX_JOBS 64
+
+typedef struct {
+    integral_manager_ctx_t app;
+    distr_manager_t *m;
+    char port[16];
+    double a;
+    double b;
+    int status;
+} multi_job_t;
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "Usage: %s <workers> <host> <base_port> <jobs> [--a <A>] [--b <B>] [--n <N>] [--expr <f(x)>]\n"
+            "       [--timeout <sec>]\n"
+            "Job k listens on base_port+k and integrates over [A+k*(B-A), B+k*(B-A)].\n",
+            argv0);
+}
+
+static void on_job_done(distr_manager_t *m, int status, void *done_ctx) {
+    multi_job_t *j = (multi_job_t *)done_ctx;
+    (void)m;
+    j->status = status;
+}
+
+int main(int argc, char **argv) {
+    static multi_job_t jobs[MULTI_MAX_JOBS];
+    struct pollfd pfds[MULTI_MAX_JOBS];
+    integral_job_t job;
+    manager_cfg_t mcfg;
+    uint64_t t0;
+    uint64_t t1;
+    int njobs;
+    int base_port;
+    int running = 0;
+    int rc = 0;
+    int i;
+    int k;
+
+    if (argc < 5) {
+        usage(argv[0]);
+        return 1;
+    }
+    memset(&mcfg, 0, sizeof(mcfg));
+    mcfg.required_workers = atoi(argv[1]);
+    mcfg.host = argv[2];
+    base_port = atoi(argv[3]);
+    njobs = atoi(argv[4]);
+    mcfg.max_time_sec = 30;
+    if (njobs < 1 || njobs > MULTI_MAX_JOBS || base_port < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    memset(&job, 0, sizeof(job));
+    job.a = 0.0;
+    job.b = 1.0;
+    job.n = 100000;
+    job.mode = INTEGRAL_MODE_FIXED;
+    job.tol = 1e-10;
+    job.dims = 1;
+    job.lo[0] = 0.0;
+    job.hi[0] = 1.0;
+    job.seed = 1U;
+
+    for (i = 5; i < argc; ++i) {
+        if (strcmp(argv[i], "--a") == 0 && i + 1 < argc) {
+            job.a = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--b") == 0 && i + 1 < argc) {
+            job.b = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--n") == 0 && i + 1 < argc) {
+            job.n = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--expr") == 0 && i + 1 < argc) {
+            job.expr = argv[++i];
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            mcfg.max_time_sec = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    t0 = integral_now_ms();
+    for (k = 0; k < njobs; ++k) {
+        multi_job_t *j = &jobs[k];
+        integral_job_t jk = job;
+        manager_ops_t ops;
+        jk.a = job.a + (double)k * (job.b - job.a);
+        jk.b = job.b + (double)k * (job.b - job.a);
+        j->a = jk.a;
+        j->b = jk.b;
+        j->status = -1;
+        (void)snprintf(j->port, sizeof(j->port), "%d", base_port + k);
+        if (integral_manager_ctx_init(&j->app, mcfg.required_workers, jk) != 0) {
+            rc = 2;
+            njobs = k;
+            break;
+        }
+        ops = integral_manager_ops(&j->app);
+        mcfg.port = j->port;
+        j->m = distr_manager_start(&mcfg, &ops, on_job_done, j);
+        if (j->m == NULL) {
+            integral_manager_ctx_free(&j->app);
+            rc = 2;
+            njobs = k;
+            break;
+        }
+        ++running;
+    }
+    if (rc != 0) {
+        for (k = 0; k < njobs; ++k) {
+            distr_manager_free(jobs[k].m);
+            integral_manager_ctx_free(&jobs[k].app);
+        }
+        return rc;
+    }
+
+    while (running > 0) {
+        int prc;
+        for (k = 0; k < njobs; ++k) {
+            pfds[k].fd = (jobs[k].status < 0) ? distr_manager_fd(jobs[k].m) : -1;
+            pfds[k].events = POLLIN;
+            pfds[k].revents = 0;
+        }
+        prc = poll(pfds, (nfds_t)njobs, 1000);
+        if (prc < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        for (k = 0; prc > 0 && k < njobs; ++k) {
+            if (pfds[k].revents != 0 && distr_manager_step(jobs[k].m, 0) == 0) {
+                --running;
+            }
+        }
+    }
+    t1 = integral_now_ms();
+
+    for (k = 0; k < njobs; ++k) {
+        multi_job_t *j = &jobs[k];
+        if (j->status == 0) {
+            printf("JOB %d A=%.12g B=%.12g INTEGRAL=%.12f\n", k, j->a, j->b, j->app.total);
+        } else {
+            printf("JOB %d A=%.12g B=%.12g STATUS=%d\n", k, j->a, j->b, j->status);
+            rc = 3;
+        }
+        distr_manager_free(j->m);
+        integral_manager_ctx_free(&j->app);
+    }
+    printf("TOTAL_TIME_SEC=%.6f\n", (double)(t1 - t0) / 1000.0);
+    return rc;
+}
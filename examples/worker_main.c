@@ -6,35 +6,65 @@
 #include <string.h>
 
 static void usage(const char *argv0) {
-    fprintf(stderr, "Usage: %s --host <host> --port <port> [--cores N] [--timeout S]\n", argv0);
+    fprintf(stderr,
+            "Usage: %s --host <host> --port <port> [--cores N] [--timeout S] [--kernels DIR]\n"
+            "       [--cache DIR] [--cache-max MB] [--host-id NAME] [--discover <udp-port>]\n",
+            argv0);
 }
 
 int main(int argc, char **argv) {
     worker_cfg_t wcfg;
     worker_ops_t ops;
+    const char *kernel_dir = NULL;
+    int rc;
     int i;
 
+    memset(&wcfg, 0, sizeof(wcfg));
     wcfg.host = "127.0.0.1";
     wcfg.port = "5555";
     wcfg.max_cores = 1;
     wcfg.max_time_sec = 30;
+    wcfg.cache_max_mb = 1024;
 
     for (i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
             wcfg.host = argv[++i];
         } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
             wcfg.port = argv[++i];
+        } else if (strcmp(argv[i], "--discover") == 0 && i + 1 < argc) {
+            wcfg.discover_port = argv[++i];
         } else if (strcmp(argv[i], "--cores") == 0 && i + 1 < argc) {
             wcfg.max_cores = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
             wcfg.max_time_sec = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) {
+            kernel_dir = argv[++i];
+        } else if (strcmp(argv[i], "--host-id") == 0 && i + 1 < argc) {
+            if (integral_set_host_id(argv[++i]) != 0) {
+                fprintf(stderr, "[worker] --host-id must be 1..%d printable characters without spaces\n",
+                        INTEGRAL_HOST_ID_MAX - 1);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            wcfg.cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-max") == 0 && i + 1 < argc) {
+            wcfg.cache_max_mb = atol(argv[++i]);
+            if (wcfg.cache_max_mb < 0) {
+                usage(argv[0]);
+                return 1;
+            }
         } else {
             usage(argv[0]);
             return 1;
         }
     }
+    if (kernel_dir != NULL && integral_kernels_load(kernel_dir) < 0) {
+        return 2;
+    }
     ops = integral_worker_ops();
     ops.user_ctx = &wcfg;
-    return run_worker(&wcfg, &ops);
+    rc = run_worker(&wcfg, &ops);
+    integral_kernels_unload();
+    return rc;
 }
 
@@ -13,14 +13,38 @@ typedef struct {
     const char *port;    
     int max_cores;         
     int max_time_sec;      
+    const char *cache_dir;
+    long cache_max_mb;
+    const char *discover_port;
 } worker_cfg_t;
 
+#define DISTR_PLAN_STATE_SZ 2048
+#define DISTR_HIST_MAX_BINS 64
+
 typedef struct {
-    const char *host;         
-    const char *port;          
-    int required_workers;      
-    int max_time_sec;        
-} manager_cfg_t;
+    size_t acc_size;
+    void (*init)(void *acc, void *user_ctx);
+    void (*map)(long begin, long end, void *acc, void *user_ctx);
+    void (*combine)(void *acc, const void *other, void *user_ctx);
+    void *user_ctx;
+} distr_reduce_t;
+
+typedef struct {
+    distr_reduce_t reduce;
+    long items;
+    int threads;
+    int (*finalize)(const void *acc,
+                    uint8_t *result_payload,
+                    size_t result_payload_sz,
+                    size_t *result_payload_len,
+                    void *user_ctx);
+    union {
+        uint8_t bytes[DISTR_PLAN_STATE_SZ];
+        double align_f64;
+        uint64_t align_u64;
+        void *align_ptr;
+    } state;
+} distr_task_plan_t;
 
 typedef struct {
     int (*build_hello)(uint8_t *out,
@@ -37,24 +61,129 @@ typedef struct {
                         size_t error_payload_sz,
                         size_t *error_payload_len,
                         void *user_ctx);
+    int (*plan_task)(const uint8_t *task_payload, size_t task_payload_len, distr_task_plan_t *plan, void *user_ctx);
     void *user_ctx;
 } worker_ops_t;
 
+typedef struct {
+    const char *host;         
+    const char *port;          
+    int required_workers;      
+    int max_time_sec;        
+    const char *trace_path;
+    const char *const *blob_paths;
+    int blob_count;
+    const char *control_path;
+    int local_cores;
+    const worker_ops_t *local_ops;
+    const char *announce_host;
+    const char *announce_port;
+    int speculate;
+} manager_cfg_t;
+
+#define DISTR_BUILD_WAIT 1
+#define DISTR_BUILD_DONE 2
+
 typedef struct {
     int (*on_worker_hello)(int worker_index, const uint8_t *hello_payload, size_t hello_payload_len, void *user_ctx);
+    /* 0: task written to task_payload; DISTR_BUILD_WAIT: no work right now, keep the worker idle
+       and ask again after the next result; DISTR_BUILD_DONE: idle, and no further task will ever
+       be built (only then may the manager speculate); <0: fatal. */
     int (*build_task)(int worker_index,
                       uint8_t *task_payload,
                       size_t task_payload_sz,
                       size_t *task_payload_len,
                       void *user_ctx);
     int (*on_worker_result)(int worker_index, const uint8_t *result_payload, size_t result_payload_len, void *user_ctx);
+    int (*on_worker_partial)(int worker_index,
+                             const uint8_t *partial_payload,
+                             size_t partial_payload_len,
+                             void *user_ctx);
+    double (*progress)(void *user_ctx);
+    int (*on_control)(const char *command, char *reply, size_t reply_sz, void *user_ctx);
     void *user_ctx;
 } manager_ops_t;
 
 int run_manager(const manager_cfg_t *mcfg, const manager_ops_t *ops);
 
+#define DISTR_MANAGER_CANCELLED 4
+
+typedef struct distr_manager distr_manager_t;
+
+typedef void (*distr_manager_done_fn)(distr_manager_t *m, int status, void *done_ctx);
+
+distr_manager_t *distr_manager_start(const manager_cfg_t *mcfg,
+                                     const manager_ops_t *ops,
+                                     distr_manager_done_fn on_done,
+                                     void *done_ctx);
+int distr_manager_fd(const distr_manager_t *m);
+int distr_manager_step(distr_manager_t *m, int timeout_ms);
+int distr_manager_status(const distr_manager_t *m);
+void distr_manager_cancel(distr_manager_t *m);
+void distr_manager_free(distr_manager_t *m);
+
 int run_worker(const worker_cfg_t *wcfg, const worker_ops_t *ops);
 
+int distr_emit_partial(const uint8_t *payload, size_t payload_len);
+int distr_task_cancelled(void);
+
+typedef struct distr_task_local distr_task_local_t;
+
+distr_task_local_t *distr_task_current(void);
+void distr_task_bind(distr_task_local_t *task);
+int distr_blob_get(int index, const uint8_t **data, size_t *size);
+
+typedef struct {
+    size_t buf_size;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t in_use;
+    uint64_t high_water;
+} distr_pool_stats_t;
+
+int distr_pool_stats(distr_pool_stats_t *stats, int max_classes);
+
+int run_local(const manager_ops_t *mops, const worker_ops_t *wops, int workers, int cores);
+
+int distr_map_reduce(const distr_reduce_t *r, long items, int threads, void *acc);
+
+typedef struct {
+    double sum;
+    double comp;
+} distr_sum_t;
+
+typedef struct {
+    uint64_t count;
+    double min;
+    double max;
+    double mean;
+    double m2;
+} distr_moments_t;
+
+typedef struct {
+    double lo;
+    double hi;
+    uint32_t bins;
+    uint32_t reserved;
+    uint64_t under;
+    uint64_t over;
+    uint64_t count[DISTR_HIST_MAX_BINS];
+} distr_hist_t;
+
+void distr_sum_init(distr_sum_t *s);
+void distr_sum_add(distr_sum_t *s, double x);
+void distr_sum_merge(distr_sum_t *s, const distr_sum_t *o);
+double distr_sum_value(const distr_sum_t *s);
+
+void distr_moments_init(distr_moments_t *m);
+void distr_moments_add(distr_moments_t *m, double x);
+void distr_moments_merge(distr_moments_t *m, const distr_moments_t *o);
+double distr_moments_variance(const distr_moments_t *m);
+
+int distr_hist_init(distr_hist_t *h, double lo, double hi, int bins);
+void distr_hist_add(distr_hist_t *h, double x);
+void distr_hist_merge(distr_hist_t *h, const distr_hist_t *o);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,224 @@
+#ifndef DISTR_WIRE_H
+#define DISTR_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define DISTR_WIRE_NATIVE_LE 1
+#else
+#define DISTR_WIRE_NATIVE_LE 0
+#endif
+
+#define DISTR_WIRE_HDR_SZ 8U
+
+typedef uint8_t distr_wire_u8;
+typedef uint16_t distr_wire_u16;
+typedef uint32_t distr_wire_u32;
+typedef uint64_t distr_wire_u64;
+typedef int64_t distr_wire_i64;
+typedef double distr_wire_f64;
+
+static inline uint64_t distr_wire_load_le(const uint8_t *p, int n) {
+    uint64_t v = 0U;
+#if DISTR_WIRE_NATIVE_LE
+    memcpy(&v, p, (size_t)n);
+#else
+    int k;
+    for (k = n - 1; k >= 0; --k) {
+        v = (v << 8) | p[k];
+    }
+#endif
+    return v;
+}
+
+static inline void distr_wire_store_le(uint8_t *p, uint64_t v, int n) {
+#if DISTR_WIRE_NATIVE_LE
+    memcpy(p, &v, (size_t)n);
+#else
+    int k;
+    for (k = 0; k < n; ++k) {
+        p[k] = (uint8_t)(v & 0xffU);
+        v >>= 8;
+    }
+#endif
+}
+
+static inline uint8_t distr_wire_load_u8(const uint8_t *p) {
+    return p[0];
+}
+
+static inline void distr_wire_store_u8(uint8_t *p, uint8_t v) {
+    p[0] = v;
+}
+
+static inline uint16_t distr_wire_load_u16(const uint8_t *p) {
+    return (uint16_t)distr_wire_load_le(p, 2);
+}
+
+static inline void distr_wire_store_u16(uint8_t *p, uint16_t v) {
+    distr_wire_store_le(p, v, 2);
+}
+
+static inline uint32_t distr_wire_load_u32(const uint8_t *p) {
+    return (uint32_t)distr_wire_load_le(p, 4);
+}
+
+static inline void distr_wire_store_u32(uint8_t *p, uint32_t v) {
+    distr_wire_store_le(p, v, 4);
+}
+
+static inline uint64_t distr_wire_load_u64(const uint8_t *p) {
+    return distr_wire_load_le(p, 8);
+}
+
+static inline void distr_wire_store_u64(uint8_t *p, uint64_t v) {
+    distr_wire_store_le(p, v, 8);
+}
+
+static inline int64_t distr_wire_load_i64(const uint8_t *p) {
+    return (int64_t)distr_wire_load_le(p, 8);
+}
+
+static inline void distr_wire_store_i64(uint8_t *p, int64_t v) {
+    distr_wire_store_le(p, (uint64_t)v, 8);
+}
+
+static inline double distr_wire_load_f64(const uint8_t *p) {
+    uint64_t u = distr_wire_load_le(p, 8);
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+static inline void distr_wire_store_f64(uint8_t *p, double v) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    distr_wire_store_le(p, u, 8);
+}
+
+static inline const double *distr_wire_f64_view(const uint8_t *p) {
+#if DISTR_WIRE_NATIVE_LE
+    if (((uintptr_t)p % _Alignof(double)) == 0U) {
+        return (const double *)(const void *)p;
+    }
+#endif
+    (void)p;
+    return NULL;
+}
+
+static inline uint32_t distr_wire_tag(const uint8_t *p) {
+    return distr_wire_load_u32(p);
+}
+
+#define DISTR_WIRE_MEMBER_(M, T, name) distr_wire_##T name;
+#define DISTR_WIRE_ARRAY_MEMBER_(M, T, name, n) distr_wire_##T name[n];
+#define DISTR_WIRE_PACKED_(M, T, name) +sizeof(distr_wire_##T)
+#define DISTR_WIRE_ARRAY_PACKED_(M, T, name, n) +(n) * sizeof(distr_wire_##T)
+
+#define DISTR_WIRE_ACCESS_(M, T, name)                                                   \
+    static inline distr_wire_##T M##_get_##name(const uint8_t *b) {                     \
+        return distr_wire_load_##T(b + offsetof(M##_layout_t, name));                    \
+    }                                                                                    \
+    static inline void M##_set_##name(uint8_t *b, distr_wire_##T v) {                   \
+        distr_wire_store_##T(b + offsetof(M##_layout_t, name), v);                       \
+    }
+
+#define DISTR_WIRE_ARRAY_ACCESS_(M, T, name, n)                                          \
+    static inline distr_wire_##T M##_get_##name(const uint8_t *b, size_t i) {           \
+        return distr_wire_load_##T(b + offsetof(M##_layout_t, name) + i * sizeof(distr_wire_##T)); \
+    }                                                                                    \
+    static inline void M##_set_##name(uint8_t *b, size_t i, distr_wire_##T v) {         \
+        distr_wire_store_##T(b + offsetof(M##_layout_t, name) + i * sizeof(distr_wire_##T), v); \
+    }                                                                                    \
+    static inline const distr_wire_##T *M##_##name##_view(const uint8_t *b) {           \
+        return (sizeof(distr_wire_##T) == 1U || DISTR_WIRE_NATIVE_LE) &&                \
+                       ((uintptr_t)(b + offsetof(M##_layout_t, name)) % _Alignof(distr_wire_##T)) == 0U \
+                   ? (const distr_wire_##T *)(const void *)(b + offsetof(M##_layout_t, name)) \
+                   : NULL;                                                               \
+    }
+
+#define DISTR_WIRE_MESSAGE(M, VERSION, FIELDS)                                           \
+    typedef struct {                                                                     \
+        uint32_t wire_tag;                                                               \
+        uint16_t wire_version;                                                           \
+        uint16_t wire_size;                                                              \
+        FIELDS(DISTR_WIRE_MEMBER_, DISTR_WIRE_ARRAY_MEMBER_, M)                          \
+    } M##_layout_t;                                                                      \
+    _Static_assert(sizeof(M##_layout_t) ==                                               \
+                       DISTR_WIRE_HDR_SZ FIELDS(DISTR_WIRE_PACKED_, DISTR_WIRE_ARRAY_PACKED_, M), \
+                   #M " has implicit padding");                                          \
+    _Static_assert(sizeof(M##_layout_t) % 8U == 0U, #M " size is not a multiple of 8");  \
+    static inline size_t M##_size(void) {                                                \
+        return sizeof(M##_layout_t);                                                     \
+    }                                                                                    \
+    static inline void M##_init(uint8_t *b, uint32_t tag) {                              \
+        memset(b, 0, sizeof(M##_layout_t));                                              \
+        distr_wire_store_u32(b, tag);                                                    \
+        distr_wire_store_u16(b + 4, (uint16_t)(VERSION));                               \
+        distr_wire_store_u16(b + 6, (uint16_t)sizeof(M##_layout_t));                    \
+    }                                                                                    \
+    static inline int M##_check(const uint8_t *b, size_t len) {                          \
+        size_t size;                                                                     \
+        if (b == NULL || len < sizeof(M##_layout_t) || distr_wire_load_u16(b + 4) != (VERSION)) { \
+            return -1;                                                                   \
+        }                                                                                \
+        size = distr_wire_load_u16(b + 6);                                               \
+        return (size >= sizeof(M##_layout_t) && size <= len && size % 8U == 0U) ? 0 : -1; \
+    }                                                                                    \
+    static inline const uint8_t *M##_tail(const uint8_t *b) {                            \
+        return b + distr_wire_load_u16(b + 6);                                           \
+    }                                                                                    \
+    FIELDS(DISTR_WIRE_ACCESS_, DISTR_WIRE_ARRAY_ACCESS_, M)
+
+#define DISTR_WIRE_GROUP 0xffff0001U
+#define DISTR_WIRE_GROUP_ENTRY_SZ 8U
+
+#define DISTR_GROUP_WIRE_FIELDS(F, A, M) \
+    F(M, u32, count)                     \
+    F(M, u32, reserved)
+DISTR_WIRE_MESSAGE(distr_group_wire, 1, DISTR_GROUP_WIRE_FIELDS)
+
+static inline uint8_t *distr_wire_group_add(uint8_t *b, size_t b_sz, size_t *len, size_t task_len) {
+    size_t off = *len;
+    size_t padded = (task_len + 7U) & ~(size_t)7U;
+    if (off < distr_group_wire_size() || off > b_sz || task_len > UINT32_MAX ||
+        b_sz - off < DISTR_WIRE_GROUP_ENTRY_SZ + padded) {
+        return NULL;
+    }
+    distr_wire_store_u32(b + off, (uint32_t)task_len);
+    distr_wire_store_u32(b + off + 4, 0U);
+    memset(b + off + DISTR_WIRE_GROUP_ENTRY_SZ + task_len, 0, padded - task_len);
+    distr_group_wire_set_count(b, distr_group_wire_get_count(b) + 1U);
+    *len = off + DISTR_WIRE_GROUP_ENTRY_SZ + padded;
+    return b + off + DISTR_WIRE_GROUP_ENTRY_SZ;
+}
+
+static inline const uint8_t *distr_wire_group_next(const uint8_t *b, size_t len, size_t *off, size_t *task_len) {
+    const uint8_t *p;
+    size_t n;
+    size_t padded;
+    if (*off > len || len - *off < DISTR_WIRE_GROUP_ENTRY_SZ) {
+        return NULL;
+    }
+    n = distr_wire_load_u32(b + *off);
+    padded = (n + 7U) & ~(size_t)7U;
+    if (len - *off - DISTR_WIRE_GROUP_ENTRY_SZ < padded) {
+        return NULL;
+    }
+    p = b + *off + DISTR_WIRE_GROUP_ENTRY_SZ;
+    *task_len = n;
+    *off += DISTR_WIRE_GROUP_ENTRY_SZ + padded;
+    return p;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,6 +8,7 @@ MANAGER="$ROOT/bin/manager"
 WORKER="$ROOT/bin/worker"
 HOST="127.0.0.1"
 BASE_PORT=7100
+DISCOVER_PORT=7199
 CSV="$OUT/results.csv"
 N=1000000
 TIMEOUT=30
@@ -19,13 +20,12 @@ run_case() {
   local cores="$2"
   local port="$3"
   local log="$OUT/w${workers}_c${cores}.txt"
-  "$MANAGER" "$workers" "$HOST" "$port" --a 0 --b 1 --n "$N" --timeout "$TIMEOUT" >"$log" 2>"$OUT/w${workers}_c${cores}.err" &
-  local mpid=$!
-  sleep 0.2
   for ((i=1;i<=workers;i++)); do
-    "$WORKER" --host "$HOST" --port "$port" --cores "$cores" --timeout "$TIMEOUT" >/dev/null 2>&1 &
+    "$WORKER" --discover "$DISCOVER_PORT" --cores "$cores" --timeout "$TIMEOUT" >/dev/null 2>&1 &
   done
-  wait "$mpid" || true
+  "$MANAGER" "$workers" "$HOST" "$port" --a 0 --b 1 --n "$N" --timeout "$TIMEOUT" \
+    --announce "$DISCOVER_PORT" --announce-addr 127.255.255.255 >"$log" 2>"$OUT/w${workers}_c${cores}.err" || true
+  wait
 
   local t
   local val
@@ -34,6 +34,19 @@ run_case() {
   echo "$workers,$cores,$((workers*cores)),$t,$val" >> "$CSV"
 }
 
+run_inproc_case() {
+  local workers="$1"
+  local cores="$2"
+  local log="$OUT/inproc_w${workers}_c${cores}.txt"
+  "$MANAGER" "$workers" - - --a 0 --b 1 --n "$N" --inproc "$cores" >"$log" 2>"$OUT/inproc_w${workers}_c${cores}.err" || true
+
+  local t
+  local val
+  t=$(awk -F= '/^TOTAL_TIME_SEC=/{print $2; f=1} END{if(!f)print "NA"}' "$log")
+  val=$(awk -F= '/^INTEGRAL=/{print $2; f=1} END{if(!f)print "NA"}' "$log")
+  echo "inproc:$workers,$cores,$((workers*cores)),$t,$val" >> "$CSV"
+}
+
 p="$BASE_PORT"
 for w in 1 2 4; do
   for c in 1 2; do
@@ -43,5 +56,10 @@ for w in 1 2 4; do
   done
 done
 
+for w in 1 2 4; do
+  echo "[BENCH] in-process workers=$w cores=2"
+  run_inproc_case "$w" 2
+done
+
 column -t -s, "$CSV" || cat "$CSV"
 
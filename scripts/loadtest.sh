@@ -0,0 +1,31 @@
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+OUT="$ROOT/tests/loadtest"
+mkdir -p "$OUT"
+
+MANAGER="$ROOT/bin/manager"
+LOADGEN="$ROOT/bin/loadgen"
+HOST="127.0.0.1"
+BASE_PORT=7200
+DELAY="${DELAY:-exp:2}"
+TIMEOUT=120
+
+echo "workers,join_sec,accept_rate,dispatch_p50_us,dispatch_p99_us,collect_per_sec" > "$OUT/results.csv"
+
+p="$BASE_PORT"
+for w in ${WORKERS:-100 500 1000 2000 4000}; do
+  echo "[LOAD] simulated workers=$w delay=$DELAY"
+  "$MANAGER" "$w" "$HOST" "$p" --n 4000000 --mode mc --timeout "$TIMEOUT" >"$OUT/m${w}.txt" 2>"$OUT/m${w}.err" &
+  mpid=$!
+  sleep 0.2
+  "$LOADGEN" --host "$HOST" --port "$p" --workers "$w" --delay "$DELAY" --timeout "$TIMEOUT" >"$OUT/lg${w}.txt" 2>"$OUT/lg${w}.err" || true
+  wait "$mpid" || true
+  awk -F= -v w="$w" '
+    {v[$1]=$2}
+    END {print w "," v["JOIN_SEC"] "," v["ACCEPT_RATE"] "," v["DISPATCH_LAT_US_P50"] "," v["DISPATCH_LAT_US_P99"] "," v["COLLECT_THROUGHPUT"]}
+  ' "$OUT/lg${w}.txt" >> "$OUT/results.csv"
+  p=$((p+1))
+done
+
+column -t -s, "$OUT/results.csv" || cat "$OUT/results.csv"
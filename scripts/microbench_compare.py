@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as fh:
+        doc = json.load(fh)
+    return {r["name"]: r for r in doc.get("results", [])}
+
+
+def main():
+    ap = argparse.ArgumentParser(description="compare microbench JSON against a baseline")
+    ap.add_argument("baseline")
+    ap.add_argument("current")
+    ap.add_argument("--threshold", type=float, default=0.10, help="allowed relative slowdown (default 0.10)")
+    ap.add_argument("--stat", default="p50", help="statistic to compare (default p50)")
+    args = ap.parse_args()
+
+    base = load(args.baseline)
+    cur = load(args.current)
+    regressions = 0
+    print(f"{'benchmark':32} {'unit':8} {'baseline':>12} {'current':>12} {'change':>8}  status")
+    for name, c in cur.items():
+        b = base.get(name)
+        if b is None:
+            print(f"{name:32} {c['unit']:8} {'-':>12} {c[args.stat]:12.4g} {'':>8}  new")
+            continue
+        bv = b[args.stat]
+        cv = c[args.stat]
+        if bv == 0:
+            change = 0.0
+        elif c["better"] == "higher":
+            change = (bv - cv) / bv
+        else:
+            change = (cv - bv) / bv
+        status = "ok"
+        if change > args.threshold:
+            status = "REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            status = "improved"
+        print(f"{name:32} {c['unit']:8} {bv:12.4g} {cv:12.4g} {-change * 100.0:+7.1f}%  {status}")
+    for name in base:
+        if name not in cur:
+            print(f"{name:32} {base[name]['unit']:8} {base[name][args.stat]:12.4g} {'-':>12} {'':>8}  missing")
+    if regressions > 0:
+        print(f"[microbench] {regressions} regression(s) beyond {args.threshold * 100.0:.0f}%")
+        return 1
+    print("[microbench] no regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -5,13 +5,16 @@ OUT="$ROOT/tests/out"
 mkdir -p "$OUT"
 
 MANAGER="$ROOT/bin/manager"
+MULTI="$ROOT/bin/multi_manager"
 WORKER="$ROOT/bin/worker"
+LOADGEN="$ROOT/bin/loadgen"
 HOST="127.0.0.1"
 BASE_PORT=7000
 STEPS=200000
 
 cleanup() {
   pkill -f "$MANAGER" >/dev/null 2>&1 || true
+  pkill -f "$MULTI" >/dev/null 2>&1 || true
   pkill -f "$WORKER" >/dev/null 2>&1 || true
 }
 trap cleanup EXIT
@@ -21,7 +24,8 @@ run_manager_workers() {
   local cores="$2"
   local port="$3"
   local prefix="$4"
-  "$MANAGER" "$workers" "$HOST" "$port" --a 0 --b 1 --n "$STEPS" --timeout 20 >"$OUT/${prefix}.txt" 2>"$OUT/${prefix}.err" &
+  shift 4
+  "$MANAGER" "$workers" "$HOST" "$port" --a 0 --b 1 --n "$STEPS" --timeout 20 "$@" >"$OUT/${prefix}.txt" 2>"$OUT/${prefix}.err" &
   local mpid=$!
   sleep 0.2
   for ((i=1;i<=workers;i++)); do
@@ -39,6 +43,10 @@ echo "[TEST] non-basic 2 workers x 2 cores"
 run_manager_workers 2 2 "$((BASE_PORT + 1))" run2
 VAL2=$(awk -F= '/^INTEGRAL=/{print $2}' "$OUT/run2.txt")
 T2=$(awk -F= '/^TOTAL_TIME_SEC=/{print $2}' "$OUT/run2.txt")
+for w in 0 1; do
+  grep -Eq "^\[manager\] worker#${w} tasks=[1-9][0-9]* user=[0-9.]+s .* max_rss=[1-9][0-9]*KB .* ipc=" "$OUT/run2.err"
+done
+echo "[ASSERT] per-worker task stats: OK"
 
 VAL1="$VAL1" VAL2="$VAL2" python3 - <<'PY'
 import math, os, sys
@@ -55,6 +63,389 @@ t1=float(os.environ["T1"]); t2=float(os.environ["T2"])
 print(f"[CHECK] speedup: t1={t1:.4f}s t2={t2:.4f}s -> {'OK' if t2 < t1 else 'WARN'}")
 PY
 
+echo "[TEST] adaptive GK15 2 workers x 1 core"
+run_manager_workers 2 1 "$((BASE_PORT + 3))" adapt --a -50 --b 50 --n 20000 --mode adaptive --tol 1e-10 \
+  --trace "$OUT/adapt_trace.json"
+VAL3=$(awk -F= '/^INTEGRAL=/{print $2}' "$OUT/adapt.txt")
+
+echo "[TEST] expression integrand 2 workers x 2 cores"
+run_manager_workers 2 2 "$((BASE_PORT + 4))" expr --a 0 --b 2 --expr "p0*sin(x)^2 + exp(-x)" --param 3
+VAL4=$(awk -F= '/^INTEGRAL=/{print $2}' "$OUT/expr.txt")
+
+echo "[TEST] scrambled Sobol QMC in 3-D 2 workers x 2 cores"
+run_manager_workers 2 2 "$((BASE_PORT + 5))" qmc --n 1000000 --mode qmc --box 0:1,0:2,0:1 --expr "x0*x1*x2"
+VAL5=$(awk -F= '/^INTEGRAL=/{print $2}' "$OUT/qmc.txt")
+
+echo "[TEST] batch of 200 jobs through 2 workers x 1 core"
+for ((j=1;j<=200;j++)); do
+  echo "0 $j 20000 x^2"
+done >"$OUT/batch_in.txt"
+echo "not a job" >>"$OUT/batch_in.txt"
+run_manager_workers 2 1 "$((BASE_PORT + 6))" batch --batch "$OUT/batch_in.txt" --out "$OUT/batch_out.txt" --chunk 5000
+grep -Eq "^\[manager\] buffer pool [0-9]+B: hits=[0-9]{3,} misses=1 " "$OUT/batch.err"
+echo "[ASSERT] buffer pool reuse: OK"
+
+echo "[TEST] parameter sweep of 300 values 2 workers x 2 cores"
+run_manager_workers 2 2 "$((BASE_PORT + 7))" sweep --a 0 --b 1 --n 200000 --expr "x^p0" --sweep 1:4:300
+
+echo "[TEST] map-reduce histogram over grouped sub-tasks 2 workers x 2 cores"
+run_manager_workers 2 2 "$((BASE_PORT + 16))" hist --n 200000 --mode hist --expr x --hist 0:1:5
+grep -q '^HIST_COUNT=200000$' "$OUT/hist.txt"
+[ "$(grep -c '^HIST_BIN .* 40000$' "$OUT/hist.txt")" -eq 5 ]
+awk -F= '/^HIST_MEAN=/{m=$2} /^HIST_STDDEV=/{s=$2} END{exit !((m-0.5)^2 < 1e-18 && (s-0.288675)^2 < 1e-10)}' "$OUT/hist.txt"
+echo "[ASSERT] map-reduce histogram: OK"
+
+echo "[TEST] per-host profile seeds shares and is updated after the run, 2 workers x 1 core"
+printf 'fast 3e7 0 1\nbad host 5e7 0 1\nslow 1e7 0 1\n' >"$OUT/profile.txt"
+if "$WORKER" --host "$HOST" --port "$((BASE_PORT + 17))" --host-id "bad host" >/dev/null 2>&1; then
+  echo "[ASSERT] host id with a space accepted"
+  exit 1
+fi
+"$MANAGER" 2 "$HOST" "$((BASE_PORT + 17))" --a 0 --b 1 --n "$STEPS" --timeout 20 --profile "$OUT/profile.txt" >"$OUT/profile_m.txt" 2>"$OUT/profile_m.err" &
+PROF_MPID=$!
+sleep 0.2
+"$WORKER" --host "$HOST" --port "$((BASE_PORT + 17))" --cores 1 --timeout 20 --host-id fast >/dev/null 2>&1 &
+"$WORKER" --host "$HOST" --port "$((BASE_PORT + 17))" --cores 1 --timeout 20 --host-id slow >/dev/null 2>&1 &
+wait "$PROF_MPID"
+grep -Eq '^\[integral\] worker#[01] host fast share 75\.0%$' "$OUT/profile_m.err"
+grep -Eq '^\[integral\] worker#[01] host slow share 25\.0%$' "$OUT/profile_m.err"
+grep -q "profile.txt:2: bad profile line, skipped" "$OUT/profile_m.err"
+awk -F= '/^INTEGRAL=/{d=$2-3.141592653589793; exit !(d*d < 1e-8)}' "$OUT/profile_m.txt"
+[ "$(grep -Ec '^(fast|slow) [0-9.e+]+ [0-9.]+ 2$' "$OUT/profile.txt")" -eq 2 ]
+echo "[ASSERT] host profile: OK"
+
+echo "[TEST] manager host contributes 2 local cores next to 1 remote worker"
+"$MANAGER" 1 "$HOST" "$((BASE_PORT + 18))" --a 0 --b 1 --n "$STEPS" --local-cores 2 --timeout 20 >"$OUT/local_m.txt" 2>"$OUT/local_m.err" &
+LOCAL_MPID=$!
+sleep 0.2
+"$WORKER" --host "$HOST" --port "$((BASE_PORT + 18))" --cores 2 --timeout 20 >/dev/null 2>&1
+wait "$LOCAL_MPID"
+"$MANAGER" 0 "$HOST" "$((BASE_PORT + 18))" --a 0 --b 1 --n "$STEPS" --local-cores 2 --timeout 20 >"$OUT/local_only.txt" 2>/dev/null
+grep -q '^\[manager\] worker#1 joined (local, 2 cores)$' "$OUT/local_m.err"
+grep -q '^TOTAL_CORES=4$' "$OUT/local_m.txt"
+grep -q '^TOTAL_CORES=2$' "$OUT/local_only.txt"
+for f in local_m local_only; do
+  awk -F= '/^INTEGRAL=/{d=$2-3.141592653589793; exit !(d*d < 1e-8)}' "$OUT/$f.txt"
+done
+echo "[ASSERT] local cores on the manager host: OK"
+
+echo "[TEST] local share stops early on --tol and is bounded by --timeout"
+"$MANAGER" 0 "$HOST" "$((BASE_PORT + 18))" --a 0 --b 1 --n 4000000000 --local-cores 2 --tol 1e-10 --timeout 20 \
+  >"$OUT/local_tol.txt" 2>/dev/null
+grep -q '^EARLY_STOP=1$' "$OUT/local_tol.txt"
+awk -F= '/^TOTAL_TIME_SEC=/{exit !($2 < 5)}' "$OUT/local_tol.txt"
+awk -F= '/^INTEGRAL=/{d=$2-3.141592653589793; exit !(d*d < 1e-16)}' "$OUT/local_tol.txt"
+LOCAL_T0=$(date +%s)
+if timeout 10 "$MANAGER" 0 "$HOST" "$((BASE_PORT + 18))" --n 20000000000 --local-cores 1 --timeout 1 \
+  >/dev/null 2>"$OUT/local_timeout.err"; then
+  echo "[ASSERT] expected non-zero manager exit on local task timeout"
+  exit 1
+fi
+[ $(($(date +%s) - LOCAL_T0)) -lt 5 ]
+grep -Eq 'task timeout after 1 s|timeout during collect' "$OUT/local_timeout.err"
+echo "[ASSERT] local share early stop and timeout: OK"
+
+echo "[TEST] workers discover the manager over UDP broadcast, started before it"
+"$WORKER" --discover "$((BASE_PORT + 20))" --cores 2 --timeout 20 >/dev/null 2>"$OUT/discover_w1.err" &
+DISC_W1=$!
+"$WORKER" --discover "$((BASE_PORT + 20))" --cores 2 --timeout 20 >/dev/null 2>"$OUT/discover_w2.err" &
+DISC_W2=$!
+"$MANAGER" 2 "$HOST" "$((BASE_PORT + 19))" --a 0 --b 1 --n "$STEPS" --timeout 20 \
+  --announce "$((BASE_PORT + 20))" --announce-addr 127.255.255.255 >"$OUT/discover_m.txt" 2>"$OUT/discover_m.err"
+wait "$DISC_W1" "$DISC_W2"
+JOB_ID=$(sed -n 's/^\[manager\] announcing job \([0-9a-f]*\) .*/\1/p' "$OUT/discover_m.err")
+[ -n "$JOB_ID" ]
+for w in 1 2; do
+  grep -q "^\[worker\] discovered job $JOB_ID at $HOST:$((BASE_PORT + 19)) " "$OUT/discover_w$w.err"
+done
+grep -q '^TOTAL_CORES=4$' "$OUT/discover_m.txt"
+awk -F= '/^INTEGRAL=/{d=$2-3.141592653589793; exit !(d*d < 1e-8)}' "$OUT/discover_m.txt"
+echo "[ASSERT] UDP discovery: OK"
+
+echo "[TEST] early stop cancels running tasks cooperatively, workers exit cleanly"
+"$MANAGER" 2 "$HOST" "$((BASE_PORT + 22))" --a 0 --b 1 --n 400000000 --tol 1e-10 --timeout 20 \
+  >"$OUT/cancel_m.txt" 2>"$OUT/cancel_m.err" &
+CANCEL_MPID=$!
+sleep 0.2
+"$WORKER" --host "$HOST" --port "$((BASE_PORT + 22))" --cores 2 --timeout 20 >/dev/null 2>"$OUT/cancel_w1.err" &
+CANCEL_W1=$!
+"$WORKER" --host "$HOST" --port "$((BASE_PORT + 22))" --cores 2 --timeout 20 >/dev/null 2>"$OUT/cancel_w2.err" &
+CANCEL_W2=$!
+wait "$CANCEL_MPID"
+wait "$CANCEL_W1"
+wait "$CANCEL_W2"
+grep -q '^EARLY_STOP=1$' "$OUT/cancel_m.txt"
+grep -q '^\[manager\] cancelling the task on worker#[01]$' "$OUT/cancel_m.err"
+cat "$OUT/cancel_w1.err" "$OUT/cancel_w2.err" | grep -Eq '^\[worker\] task cancelled in [0-9.]+ ms \(stopped\)$'
+echo "[ASSERT] cooperative cancel: OK"
+
+echo "[TEST] ABORT reaches the worker before the manager closes on timeout"
+"$MANAGER" 1 "$HOST" "$((BASE_PORT + 24))" --n 20000000000 --timeout 1 >/dev/null 2>"$OUT/abort_m.err" &
+ABORT_MPID=$!
+sleep 0.2
+set +e
+"$WORKER" --host "$HOST" --port "$((BASE_PORT + 24))" --cores 2 --timeout 20 >/dev/null 2>"$OUT/abort_w.err"
+RC=$?
+set -e
+if wait "$ABORT_MPID"; then
+  echo "[ASSERT] expected non-zero manager exit on timeout"
+  exit 1
+fi
+[ "$RC" -eq 3 ]
+grep -q '^\[worker\] task cancelled in ' "$OUT/abort_w.err"
+echo "[ASSERT] final frames flushed: OK"
+
+echo "[TEST] straggler duplicated with --speculate, the slow copy cancelled"
+printf '0 1 2000000 x^2\n' >"$OUT/spec_in.txt"
+"$MANAGER" 2 "$HOST" "$((BASE_PORT + 21))" --batch "$OUT/spec_in.txt" --out "$OUT/spec_out.txt" --chunk 10000000 \
+  --speculate --timeout 20 >"$OUT/spec_m.txt" 2>"$OUT/spec_m.err" &
+SPEC_MPID=$!
+sleep 0.2
+"$LOADGEN" --host "$HOST" --port "$((BASE_PORT + 21))" --workers 1 --delay fixed:5000 --timeout 20 \
+  >"$OUT/spec_lg.txt" 2>/dev/null &
+SPEC_LPID=$!
+for _ in $(seq 100); do
+  grep -q 'worker#1 joined' "$OUT/spec_m.err" && break
+  sleep 0.05
+done
+"$WORKER" --host "$HOST" --port "$((BASE_PORT + 21))" --cores 2 --timeout 20 >/dev/null 2>&1
+wait "$SPEC_MPID"
+wait "$SPEC_LPID"
+grep -q '^\[manager\] worker#1 duplicates the task of straggler worker#0$' "$OUT/spec_m.err"
+grep -q '^CANCELS=1$' "$OUT/spec_lg.txt"
+grep -q '^RESULTS=0$' "$OUT/spec_lg.txt"
+awk '{exit !($5 > 0.3333333 && $5 < 0.3333334)}' "$OUT/spec_out.txt"
+awk -F= '/^TOTAL_TIME_SEC=/{exit !($2 < 5)}' "$OUT/spec_m.txt"
+echo "[ASSERT] speculative duplicate and cancel: OK"
+
+echo "[TEST] no speculation mid-job while adaptive splits may still come, 1 slow simulated + 1 real worker"
+"$MANAGER" 2 "$HOST" "$((BASE_PORT + 23))" --a 0 --b 1 --mode adaptive --tol 1e-10 --speculate --timeout 20 \
+  >"$OUT/spec_adapt_m.txt" 2>"$OUT/spec_adapt_m.err" &
+SPEC_MPID=$!
+sleep 0.2
+"$LOADGEN" --host "$HOST" --port "$((BASE_PORT + 23))" --workers 1 --delay fixed:200 --timeout 20 \
+  >"$OUT/spec_adapt_lg.txt" 2>/dev/null &
+SPEC_LPID=$!
+for _ in $(seq 100); do
+  grep -q 'worker#1 joined' "$OUT/spec_adapt_m.err" && break
+  sleep 0.05
+done
+"$WORKER" --host "$HOST" --port "$((BASE_PORT + 23))" --cores 2 --timeout 20 >/dev/null 2>&1
+wait "$SPEC_MPID"
+wait "$SPEC_LPID"
+if grep -q 'duplicates the task' "$OUT/spec_adapt_m.err"; then
+  echo "[ASSERT] adaptive job speculated before the app ran out of tasks"
+  exit 1
+fi
+grep -q '^CANCELS=0$' "$OUT/spec_adapt_lg.txt"
+awk -F= '/^INTEGRAL=/{d=$2-3.141592653589793; exit !(d*d < 1e-16)}' "$OUT/spec_adapt_m.txt"
+echo "[ASSERT] adaptive speculation gate: OK"
+
+echo "[TEST] 300 simulated workers from the load generator"
+"$MANAGER" 300 "$HOST" "$((BASE_PORT + 8))" --n 600000 --mode mc --timeout 20 >"$OUT/loadgen_m.txt" 2>"$OUT/loadgen_m.err" &
+LG_MPID=$!
+sleep 0.2
+"$LOADGEN" --host "$HOST" --port "$((BASE_PORT + 8))" --workers 300 --delay uniform:0:2 --timeout 20 >"$OUT/loadgen.txt" 2>"$OUT/loadgen.err"
+wait "$LG_MPID"
+grep -q '^SHUTDOWNS=300$' "$OUT/loadgen.txt"
+grep -q '^RESULTS=1200$' "$OUT/loadgen.txt"
+echo "[ASSERT] load generator: OK"
+
+echo "[TEST] in-process run_local 2 workers x 2 cores (no sockets)"
+"$MANAGER" 2 - - --a 0 --b 1 --n "$STEPS" --inproc 2 >"$OUT/inproc.txt" 2>"$OUT/inproc.err"
+"$MANAGER" 2 - - --batch "$OUT/batch_in.txt" --out "$OUT/inproc_batch.txt" --chunk 5000 --inproc 1 2>"$OUT/inproc_batch.err" || true
+VAL8=$(awk -F= '/^INTEGRAL=/{print $2}' "$OUT/inproc.txt")
+
+echo "[TEST] float32 fast path with rounding bound and double fallback, in-process 2 workers x 2 cores"
+"$MANAGER" 2 - - --a 0 --b 1 --n 2000000 --expr "sin(x)*exp(x)" --precision f32:1e-5 --inproc 2 >"$OUT/f32.txt"
+"$MANAGER" 2 - - --a 0 --b 1 --n 2000000 --expr "sin(x)*exp(x)" --precision f32:1e-13 --inproc 2 >"$OUT/f32_fallback.txt"
+grep -q '^F32_TASKS=2/2$' "$OUT/f32.txt"
+grep -q '^F32_TASKS=0/2$' "$OUT/f32_fallback.txt"
+for f in f32 f32_fallback; do
+  awk -F= '/^INTEGRAL=/{v=$2} /^ROUNDING_BOUND=/{e=$2}
+           END{x=(exp(1)*(sin(1)-cos(1))+1)/2; d=v-x; if (d<0) d=-d; exit !(e>0 && d<=e+1e-12)}' "$OUT/$f.txt"
+done
+echo "[ASSERT] mixed precision: OK"
+
+echo "[TEST] adaptive GK15 with an interval budget smaller than the staged split, in-process 2 workers x 2 cores"
+"$MANAGER" 2 - - --a -50 --b 50 --n 40 --mode adaptive --tol 1e-15 --inproc 2 >"$OUT/adapt_small.txt" 2>"$OUT/adapt_small.err"
+grep -q '^INTEGRAL=' "$OUT/adapt_small.txt"
+awk -F= '/^INTERVALS=/{exit !($2 <= 40)}' "$OUT/adapt_small.txt"
+if grep -q 'AddressSanitizer' "$OUT/adapt_small.err"; then
+  exit 1
+fi
+echo "[ASSERT] adaptive interval budget: OK"
+
+echo "[TEST] batch deadlines scheduled earliest-deadline-first, in-process 2 workers x 1 core"
+printf '0 1 20000000 x^2\n0 2 20000000 x^2\n@20000 0 3 200000 x^2\n@0 0 1 2000000 x\n' >"$OUT/deadline_in.txt"
+"$MANAGER" 2 - - --batch "$OUT/deadline_in.txt" --out "$OUT/deadline_out.txt" --chunk 100000 --inproc 1 2>"$OUT/deadline.err"
+[ "$(cut -d' ' -f1 "$OUT/deadline_out.txt" | head -2 | tr '\n' ' ')" = "4 3 " ]
+grep -Eq '^4 .* MISSED [0-9]+$' "$OUT/deadline_out.txt"
+if grep -q ' MISSED' <(grep '^3 ' "$OUT/deadline_out.txt"); then
+  echo "[ASSERT] job with a 20s deadline reported as missed"
+  exit 1
+fi
+grep -q '^BATCH_DEADLINE_JOBS=2$' "$OUT/deadline.err"
+grep -q '^BATCH_DEADLINE_MISSED=1$' "$OUT/deadline.err"
+echo "[ASSERT] deadline scheduling: OK"
+
+echo "[TEST] batch line longer than the read buffer is rejected whole, in-process 1 worker x 1 core"
+python3 -c 'print("0 1 1000 x"); print("0 1 1000 " + "+".join(["x"] * 600)); print("0 2 1000 x")' >"$OUT/long_in.txt"
+"$MANAGER" 1 - - --batch "$OUT/long_in.txt" --out "$OUT/long_out.txt" --inproc 1 2>"$OUT/long.err" || true
+[ "$(sort -n "$OUT/long_out.txt" | cut -d' ' -f1-3 | tr '\n' ';')" = "1 0 1;2 ERROR bad_job;3 0 2;" ]
+echo "[ASSERT] overlong batch line: OK"
+
+echo "[TEST] two async manager jobs from one thread, 1 worker x 1 core each"
+"$MULTI" 1 "$HOST" "$((BASE_PORT + 9))" 2 --a 0 --b 1 --n "$STEPS" --timeout 20 >"$OUT/multi.txt" 2>"$OUT/multi.err" &
+MULTI_PID=$!
+sleep 0.2
+for k in 0 1; do
+  "$WORKER" --host "$HOST" --port "$((BASE_PORT + 9 + k))" --cores 1 --timeout 20 >"$OUT/multi_w${k}.txt" 2>"$OUT/multi_w${k}.err" &
+done
+wait "$MULTI_PID"
+
+echo "[TEST] progressive trapezoid with early stop 2 workers x 2 cores"
+run_manager_workers 2 2 "$((BASE_PORT + 12))" prog --n 400000000 --tol 1e-10
+VAL12=$(awk -F= '/^INTEGRAL=/{print $2}' "$OUT/prog.txt")
+grep -q '^EARLY_STOP=1$' "$OUT/prog.txt"
+
+echo "[TEST] dlopen kernel plugin on 2 workers x 2 cores"
+"$MANAGER" 2 "$HOST" "$((BASE_PORT + 11))" --a -3 --b 3 --n "$STEPS" --kernel gauss --timeout 20 >"$OUT/kernel.txt" 2>"$OUT/kernel.err" &
+KERNEL_PID=$!
+sleep 0.2
+for i in 1 2; do
+  "$WORKER" --host "$HOST" --port "$((BASE_PORT + 11))" --cores 2 --timeout 20 --kernels "$ROOT/bin/kernels" \
+    >"$OUT/kernel_w${i}.txt" 2>"$OUT/kernel_w${i}.err" &
+done
+wait "$KERNEL_PID"
+VAL11=$(awk -F= '/^INTEGRAL=/{print $2}' "$OUT/kernel.txt")
+
+echo "[TEST] bulk table input on 2 workers x 2 cores"
+python3 -c 'import array, sys; array.array("d", [(2.0*k/1000000)**2 for k in range(1000001)]).tofile(open(sys.argv[1], "wb"))' \
+  "$OUT/table.bin"
+"$MANAGER" 2 "$HOST" "$((BASE_PORT + 13))" --a 0 --b 2 --n "$STEPS" --table "$OUT/table.bin:0:2" --timeout 20 \
+  >"$OUT/table.txt" 2>"$OUT/table.err" &
+TABLE_PID=$!
+sleep 0.2
+rm -rf "$OUT/blob_cache"
+for i in 1 2; do
+  "$WORKER" --host "$HOST" --port "$((BASE_PORT + 13))" --cores 2 --timeout 20 --cache "$OUT/blob_cache" \
+    >"$OUT/table_w${i}.txt" 2>"$OUT/table_w${i}.err" &
+done
+wait "$TABLE_PID"
+VAL13=$(awk -F= '/^INTEGRAL=/{print $2}' "$OUT/table.txt")
+
+echo "[TEST] repeated table job served from the worker blob cache, f32 requested but tables stay in double"
+"$MANAGER" 1 "$HOST" "$((BASE_PORT + 14))" --a 0 --b 2 --n "$STEPS" --table "$OUT/table.bin:0:2" --precision f32:1e-5 \
+  --timeout 20 >"$OUT/cached.txt" 2>"$OUT/cached.err" &
+CACHED_PID=$!
+sleep 0.2
+"$WORKER" --host "$HOST" --port "$((BASE_PORT + 14))" --cores 2 --timeout 20 --cache "$OUT/blob_cache" --cache-max 64 \
+  >"$OUT/cached_w.txt" 2>"$OUT/cached_w.err"
+wait "$CACHED_PID"
+VAL14=$(awk -F= '/^INTEGRAL=/{print $2}' "$OUT/cached.txt")
+grep -q '^F32_TASKS=0/' "$OUT/cached.txt"
+awk -F= '/^ROUNDING_BOUND=/{e=$2} END{exit !(e > 0 && e < 1e-9)}' "$OUT/cached.txt"
+
+echo "[TEST] control socket on a running batch 2 workers x 1 core"
+for ((j=1;j<=4;j++)); do
+  echo "0 $j 10000000 x^2"
+done >"$OUT/ctl_in.txt"
+rm -f "$OUT/ctl.sock" "$OUT/ctl_replies.txt"
+"$MANAGER" 2 "$HOST" "$((BASE_PORT + 15))" --batch "$OUT/ctl_in.txt" --out "$OUT/ctl_out.txt" --chunk 2000 \
+  --timeout 20 --control "$OUT/ctl.sock" >"$OUT/ctl.txt" 2>"$OUT/ctl.err" &
+CTL_PID=$!
+ctl_query() {
+  python3 - "$OUT/ctl.sock" "$@" >>"$OUT/ctl_replies.txt" <<'PY'
+import json, os, socket, sys, time
+path = sys.argv[1]
+def ask(cmd):
+    s = socket.socket(socket.AF_UNIX)
+    s.connect(path)
+    s.sendall(cmd.encode() + b"\n")
+    data = b""
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+    s.close()
+    return data.decode().strip()
+deadline = time.time() + 10
+while not os.path.exists(path) and time.time() < deadline:
+    time.sleep(0.02)
+if sys.argv[2] == "wait-running":
+    while json.loads(ask("status"))["state"] != "running" and time.time() < deadline:
+        time.sleep(0.02)
+for cmd in sys.argv[2:]:
+    print(ask("status" if cmd == "wait-running" else cmd))
+PY
+}
+ctl_query status
+for ((i=1;i<=2;i++)); do
+  "$WORKER" --host "$HOST" --port "$((BASE_PORT + 15))" --cores 1 --timeout 20 >"$OUT/ctl_w${i}.txt" 2>"$OUT/ctl_w${i}.err" &
+done
+ctl_query wait-running "chunk 1000000" "drain 1" "drain 0"
+wait "$CTL_PID"
+grep -q "worker#1 drained" "$OUT/ctl.err"
+
+VAL3="$VAL3" VAL4="$VAL4" VAL5="$VAL5" VAL8="$VAL8" VAL11="$VAL11" VAL12="$VAL12" VAL13="$VAL13" VAL14="$VAL14" CTL_REPLIES="$OUT/ctl_replies.txt" CTL_OUT="$OUT/ctl_out.txt" CACHE_DIR="$OUT/blob_cache" TABLE_BIN="$OUT/table.bin" CACHED_W="$OUT/cached_w.err" MULTI_OUT="$OUT/multi.txt" BATCH_OUT="$OUT/batch_out.txt" SWEEP_OUT="$OUT/sweep.txt" \
+INPROC_BATCH="$OUT/inproc_batch.txt" TRACE="$OUT/adapt_trace.json" python3 - <<'PY'
+import json
+import hashlib, math, os, sys
+v3=float(os.environ["VAL3"])
+v4=float(os.environ["VAL4"])
+v5=float(os.environ["VAL5"])
+ok3 = abs(v3-8.0*math.atan(50.0))<1e-8
+ok4 = abs(v4-(3.0*(1.0-math.sin(4.0)/4.0)+1.0-math.exp(-2.0)))<1e-6
+ok5 = abs(v5-0.5)<1e-4
+rows = [l.split() for l in open(os.environ["BATCH_OUT"])]
+good = [r for r in rows if r[1] != "ERROR"]
+ok6 = len(good) == 200 and len(rows) == 201
+ok6 = ok6 and all(abs(float(r[4]) - float(r[2])**3/3.0) < 1e-6*float(r[2])**3 for r in good)
+sweep = [dict(kv.split("=") for kv in l.split()[1:]) for l in open(os.environ["SWEEP_OUT"]) if l.startswith("SWEEP ")]
+ok7 = len(sweep) == 300
+ok7 = ok7 and all(abs(float(r["INTEGRAL"]) - 1.0/(float(r["p0"])+1.0)) < 1e-6 for r in sweep)
+v8=float(os.environ["VAL8"])
+ok8 = abs(v8-math.pi)<1e-6
+inproc = {r[0]: r for r in (l.split() for l in open(os.environ["INPROC_BATCH"]))}
+ok8 = ok8 and len(inproc) == len(rows) and all(r[0] in inproc and (r[1] == "ERROR" or abs(float(inproc[r[0]][4]) - float(r[4])) < 1e-9*float(r[4])) for r in rows)
+events = json.load(open(os.environ["TRACE"]))["traceEvents"]
+spans = {(e["pid"], e["name"]) for e in events if e["ph"] == "X"}
+ok9 = all((p, n) in spans for p in (1, 2) for n in ("net.task", "process.start", "compute", "net.result"))
+ok9 = ok9 and ((0, "build") in spans and (0, "reduce") in spans)
+multi = [dict(kv.split("=") for kv in l.split()[2:]) for l in open(os.environ["MULTI_OUT"]) if l.startswith("JOB ")]
+ok10 = len(multi) == 2 and all("INTEGRAL" in r for r in multi)
+ok10 = ok10 and abs(float(multi[0]["INTEGRAL"])-math.pi)<1e-4
+ok10 = ok10 and abs(sum(float(r["INTEGRAL"]) for r in multi)-4.0*math.atan(2.0))<1e-4
+ok11 = abs(float(os.environ["VAL11"])-math.sqrt(math.pi)*math.erf(3.0))<1e-8
+ok12 = abs(float(os.environ["VAL12"])-math.pi)<1e-9
+ok13 = abs(float(os.environ["VAL13"])-8.0/3.0)<1e-6
+digest = hashlib.sha256(open(os.environ["TABLE_BIN"], "rb").read()).hexdigest()
+ok14 = os.listdir(os.environ["CACHE_DIR"]) == [digest] and "inputs cached: 1/1" in open(os.environ["CACHED_W"]).read()
+ok14 = ok14 and float(os.environ["VAL14"]) == float(os.environ["VAL13"])
+ctl = [json.loads(line) for line in open(os.environ["CTL_REPLIES"])]
+ok15 = len(ctl) == 5 and ctl[0]["state"] == "joining" and ctl[1]["state"] == "running" and ctl[1]["connected"] == 2
+ok15 = ok15 and ctl[1]["bytes_in"] > 0 and len(ctl[1]["worker"]) == 2
+ok15 = ok15 and ctl[2] == {"ok": True, "chunk": 1000000} and ctl[3]["ok"] and not ctl[4]["ok"]
+ctl_rows = [l.split() for l in open(os.environ["CTL_OUT"])]
+ok15 = ok15 and len(ctl_rows) == 4 and all(abs(float(r[4])-float(r[2])**3/3.0)<1e-6*float(r[2])**3 for r in ctl_rows)
+print("[ASSERT] adaptive correctness:", "OK" if ok3 else "FAIL")
+print("[ASSERT] expression correctness:", "OK" if ok4 else "FAIL")
+print("[ASSERT] qmc correctness:", "OK" if ok5 else "FAIL")
+print("[ASSERT] batch results:", "OK" if ok6 else "FAIL")
+print("[ASSERT] sweep results:", "OK" if ok7 else "FAIL")
+print("[ASSERT] in-process results:", "OK" if ok8 else "FAIL")
+print("[ASSERT] trace spans:", "OK" if ok9 else "FAIL")
+print("[ASSERT] async multi-job:", "OK" if ok10 else "FAIL")
+print("[ASSERT] kernel plugin:", "OK" if ok11 else "FAIL")
+print("[ASSERT] progressive early stop:", "OK" if ok12 else "FAIL")
+print("[ASSERT] bulk table input:", "OK" if ok13 else "FAIL")
+print("[ASSERT] blob cache reuse:", "OK" if ok14 else "FAIL")
+print("[ASSERT] control socket:", "OK" if ok15 else "FAIL")
+sys.exit(0 if ok3 and ok4 and ok5 and ok6 and ok7 and ok8 and ok9 and ok10 and ok11 and ok12 and ok13 and ok14 and ok15 else 1)
+PY
+
 echo "[TEST] failure detection (no workers)"
 set +e
 "$MANAGER" 1 "$HOST" "$((BASE_PORT + 2))" --a 0 --b 1 --n "$STEPS" --timeout 2 >"$OUT/fail.txt" 2>"$OUT/fail.err"
@@ -1,8 +1,29 @@
 #ifndef INTERNAL_H
 #define INTERNAL_H
 
+#include "distr.h"
+#include "distr_wire.h"
+
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
+
+#define PAYLOAD_BUF_SZ 16384
+#define TRACE_TASK_HDR_SZ 8U
+#define TRACE_RESULT_HDR_SZ 48U
+#define BLOB_HDR_SZ 16U
+#define DISTR_MAX_BLOBS 16
+#define SHA256_LEN 32U
+#define BLOB_OFFER_ENTRY_SZ (8U + SHA256_LEN)
+#define TASK_STATS_FIELDS 10
+#define TASK_STATS_SZ (8U * TASK_STATS_FIELDS)
+#define TASK_STATS_NA UINT64_MAX
+#define TASK_PERF_COUNTERS 3
+#define POOL_CLASSES 3
+#define POOL_BUF_MAX (TRACE_RESULT_HDR_SZ + PAYLOAD_BUF_SZ)
+#define DISTR_WIRE_ANNOUNCE 0xffff0002U
+#define ANNOUNCE_HOST_MAX 64
 
 enum {
     NET_MSG_HELLO = 1,
@@ -10,15 +31,174 @@ enum {
     NET_MSG_RESULT = 3,
     NET_MSG_ERROR = 4,
     NET_MSG_ABORT = 5,
-    NET_MSG_SHUTDOWN = 6
+    NET_MSG_SHUTDOWN = 6,
+    NET_MSG_TRACE_TASK = 7,
+    NET_MSG_TRACE_RESULT = 8,
+    NET_MSG_PARTIAL = 9,
+    NET_MSG_BLOB = 10,
+    NET_MSG_BLOB_OFFER = 11,
+    NET_MSG_BLOB_NEED = 12,
+    NET_MSG_TASK_STATS = 13,
+    NET_MSG_CANCEL = 14,
+    NET_MSG_CANCELLED = 15
+};
+
+enum {
+    TASK_STAT_UTIME_US = 0,
+    TASK_STAT_STIME_US = 1,
+    TASK_STAT_MAXRSS_KB = 2,
+    TASK_STAT_MINFLT = 3,
+    TASK_STAT_MAJFLT = 4,
+    TASK_STAT_NVCSW = 5,
+    TASK_STAT_NIVCSW = 6,
+    TASK_STAT_CYCLES = 7,
+    TASK_STAT_INSTRUCTIONS = 8,
+    TASK_STAT_CACHE_MISSES = 9
+};
+
+#define ANNOUNCE_WIRE_FIELDS(F, A, M) \
+    F(M, u64, job_id)                 \
+    F(M, u32, free_slots)             \
+    F(M, u16, port)                   \
+    F(M, u16, reserved)               \
+    A(M, u8, host, ANNOUNCE_HOST_MAX)
+DISTR_WIRE_MESSAGE(announce_wire, 1, ANNOUNCE_WIRE_FIELDS)
+
+typedef struct {
+    uint32_t h[8];
+    uint64_t len;
+    uint8_t buf[64];
+    size_t buf_len;
+} sha256_ctx_t;
+
+typedef struct {
+    uint64_t fork_ns;
+    uint64_t kernel_begin_ns;
+    uint64_t kernel_end_ns;
+    uint64_t stats[TASK_STATS_FIELDS];
+} task_exec_times_t;
+
+typedef struct {
+    int fds[TASK_PERF_COUNTERS];
+} task_perf_t;
+
+typedef struct pool_buf {
+    struct pool_buf *next;
+    atomic_int refs;
+    int cls;
+    size_t cap;
+    size_t len;
+    uint8_t *data;
+} pool_buf_t;
+
+typedef struct {
+    int cancel_fd;
+    int cancelled;
+    int killed;
+    uint64_t stop_ns;
+    void (*on_partial)(const uint8_t *payload, size_t payload_len, void *ctx);
+    void *ctx;
+} task_exec_io_t;
+
+struct distr_task_local {
+    atomic_int cancel;
+    uint64_t deadline_ms;
+    int (*on_partial)(const uint8_t *payload, size_t payload_len, void *ctx);
+    void *ctx;
 };
 
+typedef struct {
+    uint64_t trace_id;
+    int worker;
+    uint64_t build_begin_ns;
+    uint64_t build_end_ns;
+    uint64_t send_end_ns;
+    uint64_t recv_ns;
+    uint64_t reduce_begin_ns;
+    uint64_t reduce_end_ns;
+    uint64_t w_recv_ns;
+    uint64_t w_fork_ns;
+    uint64_t w_kernel_begin_ns;
+    uint64_t w_kernel_end_ns;
+    uint64_t w_send_ns;
+} trace_span_t;
+
+typedef struct {
+    const char *path;
+    trace_span_t *spans;
+    size_t len;
+    size_t cap;
+    int workers;
+    uint64_t origin_ns;
+} trace_log_t;
+
 int net_listen(const char *host, const char *port);
 int net_accept_timeout(int listen_fd, int timeout_sec);
+int net_accept_nowait(int listen_fd, int timeout_sec);
 int net_connect_timeout(const char *host, const char *port, int timeout_sec);
 int net_send_packet(int fd, uint8_t type, const void *payload, uint32_t payload_len, int timeout_sec);
 int net_recv_packet(int fd, uint8_t *type, void *payload, size_t payload_cap, uint32_t *payload_len, int timeout_sec);
+int net_recv_raw(int fd, void *buf, size_t n, int timeout_sec);
+int net_announce_open(const char *host, const char *port);
+int net_discover_open(const char *port);
+int net_recv_datagram(int fd, void *buf, size_t cap, int timeout_ms, char *from, size_t from_sz);
+uint16_t net_local_port(int fd);
 uint64_t now_ms(void);
+uint64_t now_ns(void);
+
+int run_task_with_timeout(const worker_ops_t *ops,
+                          const uint8_t *payload,
+                          size_t payload_len,
+                          int timeout_sec,
+                          uint8_t *result_payload,
+                          size_t result_payload_sz,
+                          size_t *result_payload_len,
+                          uint8_t *error_payload,
+                          size_t error_payload_sz,
+                          size_t *error_payload_len,
+                          int *timed_out,
+                          task_exec_times_t *times,
+                          task_exec_io_t *io);
+int task_execute(const worker_ops_t *ops,
+                 const uint8_t *payload,
+                 size_t payload_len,
+                 uint8_t *result_payload,
+                 size_t result_payload_sz,
+                 size_t *result_payload_len,
+                 uint8_t *error_payload,
+                 size_t error_payload_sz,
+                 size_t *error_payload_len);
+
+typedef struct local_pool local_pool_t;
+
+local_pool_t *local_pool_start(const worker_ops_t *wops, int workers, int notify_fd, int timeout_sec);
+uint8_t *local_pool_task(local_pool_t *pool, int i);
+void local_pool_submit(local_pool_t *pool, int i, size_t task_len);
+void local_pool_cancel(local_pool_t *pool, int i);
+int local_pool_take_partial(local_pool_t *pool, int i, uint8_t *out, size_t *len);
+int local_pool_next_done(local_pool_t *pool, int wait);
+const uint8_t *local_pool_result(const local_pool_t *pool, int i, size_t *len, int *rc);
+void local_pool_free(local_pool_t *pool);
+
+void trace_put_u64(uint8_t *out, uint64_t v);
+uint64_t trace_get_u64(const uint8_t *in);
+int trace_log_init(trace_log_t *log, const char *path, int workers);
+void trace_log_free(trace_log_t *log);
+long trace_log_add(trace_log_t *log, int worker);
+int trace_log_write(const trace_log_t *log);
+
+void sha256_init(sha256_ctx_t *c);
+void sha256_update(sha256_ctx_t *c, const void *data, size_t n);
+void sha256_final(sha256_ctx_t *c, uint8_t out[SHA256_LEN]);
+int sha256_fd(int fd, uint8_t out[SHA256_LEN]);
+
+void task_perf_begin(task_perf_t *p);
+void task_perf_end(task_perf_t *p, uint64_t *stats);
+int task_perf_wait(pid_t pid, int *status, uint64_t *stats);
+
+pool_buf_t *pool_get(size_t size);
+pool_buf_t *pool_ref(pool_buf_t *b);
+void pool_put(pool_buf_t *b);
 
 #endif
 
@@ -0,0 +1,388 @@
+#define _POSIX_C_SOURCE 200809L
+#include "distr.h"
+#include "internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOCAL_CANCEL_GRACE_MS 200
+
+enum {
+    LOCAL_SLOT_IDLE = 0,
+    LOCAL_SLOT_TASK = 1,
+    LOCAL_SLOT_DONE = 2
+};
+
+typedef struct {
+    local_pool_t *pool;
+    int index;
+    int state;
+    int busy;
+    int rc;
+    pthread_t th;
+    int started;
+    distr_task_local_t task;
+    int partial_ready;
+    size_t partial_len;
+    uint8_t partial_payload[PAYLOAD_BUF_SZ];
+    _Alignas(8) uint8_t task_payload[PAYLOAD_BUF_SZ];
+    size_t task_len;
+    uint8_t result_payload[PAYLOAD_BUF_SZ];
+    size_t result_len;
+    uint8_t error_payload[PAYLOAD_BUF_SZ];
+    size_t error_len;
+} local_slot_t;
+
+struct local_pool {
+    const worker_ops_t *wops;
+    pthread_mutex_t mu;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    pthread_cond_t partial_cv;
+    local_slot_t *slots;
+    int *done_queue;
+    int done_head;
+    int done_count;
+    int workers;
+    int stop;
+    int notify_fd;
+    int timeout_sec;
+    int running;
+    int orphaned;
+};
+
+static void local_pool_destroy(local_pool_t *pool) {
+    (void)pthread_cond_destroy(&pool->partial_cv);
+    (void)pthread_cond_destroy(&pool->done_cv);
+    (void)pthread_cond_destroy(&pool->work_cv);
+    (void)pthread_mutex_destroy(&pool->mu);
+    free(pool->slots);
+    free(pool->done_queue);
+    free(pool);
+}
+
+static void local_notify(int fd) {
+    uint64_t one = 1U;
+    if (fd < 0) {
+        return;
+    }
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+static int local_emit_partial(const uint8_t *payload, size_t payload_len, void *ctx) {
+    local_slot_t *slot = (local_slot_t *)ctx;
+    local_pool_t *pool = slot->pool;
+    int fd;
+
+    (void)pthread_mutex_lock(&pool->mu);
+    while (slot->partial_ready != 0 && pool->stop == 0 && atomic_load(&slot->task.cancel) == 0) {
+        (void)pthread_cond_wait(&pool->partial_cv, &pool->mu);
+    }
+    fd = pool->notify_fd;
+    if (fd < 0 || pool->stop != 0 || atomic_load(&slot->task.cancel) != 0) {
+        (void)pthread_mutex_unlock(&pool->mu);
+        return -1;
+    }
+    if (payload_len > 0U) {
+        memcpy(slot->partial_payload, payload, payload_len);
+    }
+    slot->partial_len = payload_len;
+    slot->partial_ready = 1;
+    (void)pthread_mutex_unlock(&pool->mu);
+    local_notify(fd);
+    return 0;
+}
+
+static void *local_worker_run(void *arg) {
+    local_slot_t *slot = (local_slot_t *)arg;
+    local_pool_t *pool = slot->pool;
+
+    slot->task.on_partial = local_emit_partial;
+    slot->task.ctx = slot;
+    distr_task_bind(&slot->task);
+    for (;;) {
+        int fd;
+        int rc;
+        (void)pthread_mutex_lock(&pool->mu);
+        while (pool->stop == 0 && slot->state != LOCAL_SLOT_TASK) {
+            (void)pthread_cond_wait(&pool->work_cv, &pool->mu);
+        }
+        if (pool->stop != 0) {
+            int last;
+            --pool->running;
+            last = pool->orphaned != 0 && pool->running == 0;
+            (void)pthread_cond_broadcast(&pool->done_cv);
+            (void)pthread_mutex_unlock(&pool->mu);
+            if (last) {
+                local_pool_destroy(pool);
+            }
+            return NULL;
+        }
+        (void)pthread_mutex_unlock(&pool->mu);
+
+        slot->result_len = 0U;
+        slot->error_len = 0U;
+        rc = task_execute(pool->wops,
+                          slot->task_payload,
+                          slot->task_len,
+                          slot->result_payload,
+                          sizeof(slot->result_payload),
+                          &slot->result_len,
+                          slot->error_payload,
+                          sizeof(slot->error_payload),
+                          &slot->error_len);
+        if (atomic_load(&slot->task.cancel) == 0 && distr_task_cancelled() != 0) {
+            rc = -1;
+            slot->error_len = (size_t)snprintf((char *)slot->error_payload, sizeof(slot->error_payload),
+                                               "task timeout after %d s", pool->timeout_sec);
+        }
+
+        (void)pthread_mutex_lock(&pool->mu);
+        slot->rc = rc;
+        slot->partial_ready = 0;
+        slot->state = LOCAL_SLOT_DONE;
+        pool->done_queue[(pool->done_head + pool->done_count) % pool->workers] = slot->index;
+        ++pool->done_count;
+        fd = pool->notify_fd;
+        (void)pthread_cond_broadcast(&pool->done_cv);
+        (void)pthread_mutex_unlock(&pool->mu);
+        local_notify(fd);
+    }
+}
+
+local_pool_t *local_pool_start(const worker_ops_t *wops, int workers, int notify_fd, int timeout_sec) {
+    local_pool_t *pool = (local_pool_t *)calloc(1U, sizeof(*pool));
+    int i;
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->wops = wops;
+    pool->workers = workers;
+    pool->notify_fd = notify_fd;
+    pool->timeout_sec = timeout_sec;
+    pool->slots = (local_slot_t *)calloc((size_t)workers, sizeof(*pool->slots));
+    pool->done_queue = (int *)calloc((size_t)workers, sizeof(*pool->done_queue));
+    if (pool->slots == NULL || pool->done_queue == NULL) {
+        free(pool->slots);
+        free(pool->done_queue);
+        free(pool);
+        return NULL;
+    }
+    (void)pthread_mutex_init(&pool->mu, NULL);
+    (void)pthread_cond_init(&pool->work_cv, NULL);
+    (void)pthread_cond_init(&pool->done_cv, NULL);
+    (void)pthread_cond_init(&pool->partial_cv, NULL);
+    for (i = 0; i < workers; ++i) {
+        local_slot_t *slot = &pool->slots[i];
+        slot->pool = pool;
+        slot->index = i;
+        slot->state = LOCAL_SLOT_IDLE;
+        if (pthread_create(&slot->th, NULL, local_worker_run, slot) != 0) {
+            local_pool_free(pool);
+            return NULL;
+        }
+        slot->started = 1;
+        ++pool->running;
+    }
+    return pool;
+}
+
+uint8_t *local_pool_task(local_pool_t *pool, int i) {
+    return pool->slots[i].task_payload;
+}
+
+void local_pool_submit(local_pool_t *pool, int i, size_t task_len) {
+    local_slot_t *slot = &pool->slots[i];
+    (void)pthread_mutex_lock(&pool->mu);
+    slot->task_len = task_len;
+    atomic_store(&slot->task.cancel, 0);
+    slot->task.deadline_ms = (pool->timeout_sec > 0) ? now_ms() + (uint64_t)pool->timeout_sec * 1000U : 0U;
+    slot->partial_ready = 0;
+    slot->state = LOCAL_SLOT_TASK;
+    (void)pthread_cond_broadcast(&pool->work_cv);
+    (void)pthread_mutex_unlock(&pool->mu);
+}
+
+void local_pool_cancel(local_pool_t *pool, int i) {
+    (void)pthread_mutex_lock(&pool->mu);
+    atomic_store(&pool->slots[i].task.cancel, 1);
+    (void)pthread_cond_broadcast(&pool->partial_cv);
+    (void)pthread_mutex_unlock(&pool->mu);
+}
+
+int local_pool_take_partial(local_pool_t *pool, int i, uint8_t *out, size_t *len) {
+    local_slot_t *slot = &pool->slots[i];
+    int got = 0;
+    (void)pthread_mutex_lock(&pool->mu);
+    if (slot->partial_ready != 0) {
+        memcpy(out, slot->partial_payload, slot->partial_len);
+        *len = slot->partial_len;
+        slot->partial_ready = 0;
+        got = 1;
+        (void)pthread_cond_broadcast(&pool->partial_cv);
+    }
+    (void)pthread_mutex_unlock(&pool->mu);
+    return got;
+}
+
+int local_pool_next_done(local_pool_t *pool, int wait) {
+    int i = -1;
+    (void)pthread_mutex_lock(&pool->mu);
+    while (wait != 0 && pool->done_count == 0) {
+        (void)pthread_cond_wait(&pool->done_cv, &pool->mu);
+    }
+    if (pool->done_count > 0) {
+        i = pool->done_queue[pool->done_head];
+        pool->done_head = (pool->done_head + 1) % pool->workers;
+        --pool->done_count;
+        pool->slots[i].state = LOCAL_SLOT_IDLE;
+    }
+    (void)pthread_mutex_unlock(&pool->mu);
+    return i;
+}
+
+const uint8_t *local_pool_result(const local_pool_t *pool, int i, size_t *len, int *rc) {
+    const local_slot_t *slot = &pool->slots[i];
+    *rc = slot->rc;
+    if (slot->rc != 0) {
+        *len = slot->error_len;
+        return slot->error_payload;
+    }
+    *len = slot->result_len;
+    return slot->result_payload;
+}
+
+static int local_dispatch_idle(local_pool_t *pool, const manager_ops_t *ops) {
+    int i;
+    int sent = 0;
+    for (i = 0; i < pool->workers; ++i) {
+        local_slot_t *slot = &pool->slots[i];
+        int rc;
+        if (slot->busy != 0) {
+            continue;
+        }
+        slot->task_len = 0U;
+        rc = ops->build_task(i, slot->task_payload, sizeof(slot->task_payload), &slot->task_len, ops->user_ctx);
+        if (rc > 0) {
+            continue;
+        }
+        if (rc < 0) {
+            fprintf(stderr, "[local] build TASK failed\n");
+            return -1;
+        }
+        local_pool_submit(pool, i, slot->task_len);
+        slot->busy = 1;
+        ++sent;
+    }
+    return sent;
+}
+
+void local_pool_free(local_pool_t *pool) {
+    struct timespec deadline;
+    int i;
+    if (pool == NULL) {
+        return;
+    }
+    (void)clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += LOCAL_CANCEL_GRACE_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    (void)pthread_mutex_lock(&pool->mu);
+    pool->stop = 1;
+    for (i = 0; i < pool->workers; ++i) {
+        atomic_store(&pool->slots[i].task.cancel, 1);
+    }
+    (void)pthread_cond_broadcast(&pool->work_cv);
+    (void)pthread_cond_broadcast(&pool->partial_cv);
+    while (pool->running > 0 && pthread_cond_timedwait(&pool->done_cv, &pool->mu, &deadline) == 0) {
+    }
+    if (pool->running > 0) {
+        fprintf(stderr, "[local] %d task(s) ignored cancellation, left running\n", pool->running);
+        for (i = 0; i < pool->workers; ++i) {
+            if (pool->slots[i].started != 0) {
+                (void)pthread_detach(pool->slots[i].th);
+            }
+        }
+        pool->orphaned = 1;
+        pool->notify_fd = -1;
+        (void)pthread_mutex_unlock(&pool->mu);
+        return;
+    }
+    (void)pthread_mutex_unlock(&pool->mu);
+    for (i = 0; i < pool->workers; ++i) {
+        if (pool->slots[i].started != 0) {
+            (void)pthread_join(pool->slots[i].th, NULL);
+        }
+    }
+    local_pool_destroy(pool);
+}
+
+int run_local(const manager_ops_t *mops, const worker_ops_t *wops, int workers, int cores) {
+    local_pool_t *pool = NULL;
+    worker_cfg_t wcfg;
+    int in_flight;
+    int rc = 3;
+    int i;
+
+    if (mops == NULL || wops == NULL || mops->on_worker_hello == NULL || mops->build_task == NULL ||
+        mops->on_worker_result == NULL || wops->build_hello == NULL || wops->execute_task == NULL ||
+        workers < 1 || cores < 1) {
+        return 2;
+    }
+    memset(&wcfg, 0, sizeof(wcfg));
+    wcfg.max_cores = cores;
+    for (i = 0; i < workers; ++i) {
+        uint8_t hello_payload[PAYLOAD_BUF_SZ];
+        size_t hello_len = 0U;
+        if (wops->build_hello(hello_payload, sizeof(hello_payload), &hello_len, &wcfg, wops->user_ctx) != 0 ||
+            mops->on_worker_hello(i, hello_payload, hello_len, mops->user_ctx) != 0) {
+            fprintf(stderr, "[local] worker#%d HELLO rejected\n", i + 1);
+            return 3;
+        }
+    }
+    pool = local_pool_start(wops, workers, -1, 0);
+    if (pool == NULL) {
+        return 2;
+    }
+
+    in_flight = local_dispatch_idle(pool, mops);
+    if (in_flight < 0) {
+        goto done;
+    }
+    while (in_flight > 0) {
+        local_slot_t *slot = &pool->slots[local_pool_next_done(pool, 1)];
+        int more;
+
+        --in_flight;
+        if (slot->rc != 0) {
+            if (slot->error_len > 0U) {
+                fprintf(stderr, "[local] worker error: %.*s\n", (int)slot->error_len,
+                        (const char *)slot->error_payload);
+            } else {
+                fprintf(stderr, "[local] worker#%d task failed\n", slot->index + 1);
+            }
+            goto done;
+        }
+        slot->busy = 0;
+        if (mops->on_worker_result(slot->index, slot->result_payload, slot->result_len, mops->user_ctx) != 0) {
+            fprintf(stderr, "[local] bad RESULT payload from worker#%d\n", slot->index + 1);
+            goto done;
+        }
+        more = local_dispatch_idle(pool, mops);
+        if (more < 0) {
+            goto done;
+        }
+        in_flight += more;
+    }
+    rc = 0;
+
+done:
+    local_pool_free(pool);
+    return rc;
+}
@@ -3,201 +3,1672 @@
 #include "internal.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
-#define PAYLOAD_BUF_SZ 900
+#define MGR_FRAME_MAX (TRACE_RESULT_HDR_SZ + PAYLOAD_BUF_SZ)
+#define MGR_EVENTS 64
+#define MGR_CTL_CLIENTS 8
+#define MGR_CTL_LINE 256
+#define MGR_ANNOUNCE_MS 100
+#define MGR_FLUSH_MS 1000
+
+enum {
+    MGR_JOINING = 0,
+    MGR_RUNNING = 1,
+    MGR_DONE = 2
+};
+
+enum {
+    MGR_TAG_LISTEN = 0,
+    MGR_TAG_TIMER = 1,
+    MGR_TAG_PENDING = 2,
+    MGR_TAG_WORKER = 3,
+    MGR_TAG_CONTROL = 4,
+    MGR_TAG_CTL_CLIENT = 5,
+    MGR_TAG_LOCAL = 6,
+    MGR_TAG_ANNOUNCE = 7
+};
 
 typedef struct {
     int fd;
+    uint8_t hdr[5];
+    uint32_t hdr_got;
+    pool_buf_t *buf;
+    uint32_t payload_len;
+    uint32_t payload_got;
+    uint64_t bytes_in;
+} mgr_conn_t;
+
+typedef struct {
+    int fd;
+    size_t len;
+    char line[MGR_CTL_LINE];
+} mgr_ctl_t;
+
+typedef struct {
+    mgr_conn_t conn;
     int alive;
+    int local;
+    int busy;
+    int draining;
+    int cancelling;
+    int spec_of;
+    int spec_by;
+    uint64_t task_ns;
+    long tasks_done;
+    uint64_t bytes_out;
+    pool_buf_t *task;
+    long trace_idx;
+    int uploading;
+    int up_blob;
+    uint32_t up_need;
+    uint64_t up_off;
+    uint8_t up_hdr[5U + BLOB_HDR_SZ];
+    uint32_t up_hdr_sent;
+    pool_buf_t *out_head;
+    pool_buf_t *out_tail;
+    size_t out_off;
+    int out_watch;
+    long stat_tasks;
+    uint64_t stats[TASK_STATS_FIELDS];
 } worker_info_t;
 
+struct distr_manager {
+    manager_cfg_t cfg;
+    manager_ops_t ops;
+    distr_manager_done_fn on_done;
+    void *done_ctx;
+    int epfd;
+    int listen_fd;
+    int timer_fd;
+    int state;
+    int status;
+    worker_info_t *ws;
+    int connected;
+    int *idle;
+    int idle_len;
+    int in_flight;
+    int build_done;
+    mgr_conn_t *pending;
+    int pending_cap;
+    trace_log_t trace_store;
+    trace_log_t *trace;
+    int blob_fds[DISTR_MAX_BLOBS];
+    uint64_t blob_sizes[DISTR_MAX_BLOBS];
+    uint8_t offer[4U + DISTR_MAX_BLOBS * BLOB_OFFER_ENTRY_SZ];
+    uint32_t offer_len;
+    int blob_count;
+    int uploads_pending;
+    int ctl_fd;
+    mgr_ctl_t ctl[MGR_CTL_CLIENTS];
+    local_pool_t *local;
+    int local_fd;
+    int announce_fd;
+    int announce_timer_fd;
+    uint64_t job_id;
+    uint8_t announce[sizeof(announce_wire_layout_t)];
+    uint64_t begin_ns;
+};
+
 static volatile sig_atomic_t g_stop = 0;
-static volatile sig_atomic_t g_timeout = 0;
 
 static void on_sigint(int sig) {
     (void)sig;
     g_stop = 1;
 }
 
-static void on_sigalrm(int sig) {
-    (void)sig;
-    g_timeout = 1;
+static uint64_t mgr_tag(int tag, int idx) {
+    return ((uint64_t)(uint32_t)tag << 32) | (uint32_t)idx;
+}
+
+static int mgr_watch(distr_manager_t *m, int op, int fd, int tag, int idx, uint32_t events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.u64 = mgr_tag(tag, idx);
+    return epoll_ctl(m->epfd, op, fd, &ev);
+}
+
+static void conn_reset(mgr_conn_t *c) {
+    c->hdr_got = 0U;
+    c->payload_len = 0U;
+    c->payload_got = 0U;
 }
 
-static void broadcast(worker_info_t *ws, int n, const char *msg) {
+static void conn_close(mgr_conn_t *c) {
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    pool_put(c->buf);
+    c->buf = NULL;
+    conn_reset(c);
+}
+
+static pool_buf_t *conn_take(mgr_conn_t *c) {
+    pool_buf_t *b = c->buf;
+    b->len = c->payload_len;
+    c->buf = NULL;
+    conn_reset(c);
+    return b;
+}
+
+static int conn_read(mgr_conn_t *c) {
+    for (;;) {
+        ssize_t r;
+        if (c->hdr_got < sizeof(c->hdr)) {
+            r = recv(c->fd, c->hdr + c->hdr_got, sizeof(c->hdr) - c->hdr_got, MSG_DONTWAIT);
+        } else if (c->payload_got < c->payload_len) {
+            r = recv(c->fd, c->buf->data + c->payload_got, c->payload_len - c->payload_got, MSG_DONTWAIT);
+        } else {
+            return 1;
+        }
+        if (r == 0) {
+            return -1;
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        c->bytes_in += (uint64_t)r;
+        if (c->hdr_got >= sizeof(c->hdr)) {
+            c->payload_got += (uint32_t)r;
+            continue;
+        }
+        c->hdr_got += (uint32_t)r;
+        if (c->hdr_got == sizeof(c->hdr)) {
+            uint32_t len = ((uint32_t)c->hdr[1] << 24) | ((uint32_t)c->hdr[2] << 16) |
+                           ((uint32_t)c->hdr[3] << 8) | (uint32_t)c->hdr[4];
+            if (len > MGR_FRAME_MAX) {
+                return -1;
+            }
+            pool_put(c->buf);
+            c->buf = pool_get(len);
+            if (c->buf == NULL) {
+                return -1;
+            }
+            c->payload_len = len;
+            c->payload_got = 0U;
+        }
+    }
+}
+
+static int set_fd_nonblock(int fd, int on) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    flags = (on != 0) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return (fcntl(fd, F_SETFL, flags) < 0) ? -1 : 0;
+}
+
+static void out_clear(worker_info_t *w) {
+    while (w->out_head != NULL) {
+        pool_buf_t *b = w->out_head;
+        w->out_head = b->next;
+        pool_put(b);
+    }
+    w->out_tail = NULL;
+    w->out_off = 0U;
+}
+
+static int out_flush(worker_info_t *w) {
+    while (w->out_head != NULL) {
+        pool_buf_t *b = w->out_head;
+        ssize_t r = send(w->conn.fd, b->data + w->out_off, b->len - w->out_off, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        w->out_off += (size_t)r;
+        if (w->out_off == b->len) {
+            w->out_head = b->next;
+            if (w->out_head == NULL) {
+                w->out_tail = NULL;
+            }
+            w->out_off = 0U;
+            pool_put(b);
+        }
+    }
+    return 1;
+}
+
+static void out_drain(worker_info_t *w, uint64_t deadline) {
+    while (w->conn.fd >= 0 && out_flush(w) == 0) {
+        struct pollfd pfd;
+        uint64_t now = now_ms();
+        if (now >= deadline) {
+            return;
+        }
+        pfd.fd = w->conn.fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, (int)(deadline - now)) < 0 && errno != EINTR) {
+            return;
+        }
+    }
+}
+
+static int mgr_update_watch(distr_manager_t *m, int i) {
+    worker_info_t *w = &m->ws[i];
+    int want = w->out_head != NULL || (w->uploading != 0 && w->up_blob >= 0 && w->up_blob < m->blob_count);
+    if (want == w->out_watch) {
+        return 0;
+    }
+    w->out_watch = want;
+    return mgr_watch(m, EPOLL_CTL_MOD, w->conn.fd, MGR_TAG_WORKER, i, (want != 0) ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+}
+
+static int mgr_send(distr_manager_t *m, int i, uint8_t type, const void *payload, uint32_t len) {
+    worker_info_t *w = &m->ws[i];
+    pool_buf_t *b = pool_get(5U + (size_t)len);
+    if (b == NULL) {
+        return -1;
+    }
+    b->data[0] = type;
+    b->data[1] = (uint8_t)(len >> 24);
+    b->data[2] = (uint8_t)(len >> 16);
+    b->data[3] = (uint8_t)(len >> 8);
+    b->data[4] = (uint8_t)len;
+    if (len > 0U) {
+        memcpy(b->data + 5, payload, len);
+    }
+    b->len = 5U + (size_t)len;
+    b->next = NULL;
+    if (w->out_tail != NULL) {
+        w->out_tail->next = b;
+    } else {
+        w->out_head = b;
+    }
+    w->out_tail = b;
+    w->bytes_out += b->len;
+    if (out_flush(w) < 0) {
+        return -1;
+    }
+    return mgr_update_watch(m, i);
+}
+
+static void upload_prepare(const distr_manager_t *m, worker_info_t *w) {
+    uint8_t *p = w->up_hdr;
+    uint64_t size = m->blob_sizes[w->up_blob];
+    int k;
+    p[0] = NET_MSG_BLOB;
+    p[1] = 0U;
+    p[2] = 0U;
+    p[3] = 0U;
+    p[4] = (uint8_t)BLOB_HDR_SZ;
+    p += 5;
+    p[0] = 0U;
+    p[1] = 0U;
+    p[2] = 0U;
+    p[3] = (uint8_t)w->up_blob;
+    p[4] = 0U;
+    p[5] = 0U;
+    p[6] = 0U;
+    p[7] = 0U;
+    for (k = 15; k >= 8; --k) {
+        p[k] = (uint8_t)(size & 0xffU);
+        size >>= 8;
+    }
+    w->up_hdr_sent = 0U;
+    w->up_off = 0U;
+}
+
+static int next_needed(const distr_manager_t *m, const worker_info_t *w, int from) {
+    while (from < m->blob_count && (w->up_need & (1U << from)) == 0U) {
+        ++from;
+    }
+    return from;
+}
+
+static ssize_t sendfile_nosigpipe(int out_fd, int in_fd, off_t *off, size_t count) {
+    sigset_t pipe_set;
+    sigset_t old_set;
+    ssize_t r;
+    int saved;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    (void)pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+    r = sendfile(out_fd, in_fd, off, count);
+    saved = errno;
+    if (r < 0 && saved == EPIPE) {
+        struct timespec zero = {0, 0};
+        (void)sigtimedwait(&pipe_set, NULL, &zero);
+    }
+    (void)pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    errno = saved;
+    return r;
+}
+
+static int upload_step(distr_manager_t *m, worker_info_t *w) {
+    while (w->up_blob < m->blob_count) {
+        uint64_t size = m->blob_sizes[w->up_blob];
+        ssize_t r;
+        if (w->up_hdr_sent < sizeof(w->up_hdr)) {
+            r = send(w->conn.fd, w->up_hdr + w->up_hdr_sent, sizeof(w->up_hdr) - w->up_hdr_sent, MSG_NOSIGNAL);
+        } else if (w->up_off < size) {
+            off_t off = (off_t)w->up_off;
+            uint64_t left = size - w->up_off;
+            r = sendfile_nosigpipe(w->conn.fd, m->blob_fds[w->up_blob], &off,
+                                   (size_t)((left > (1U << 30)) ? (1U << 30) : left));
+            if (r == 0) {
+                return -1;
+            }
+            if (r > 0) {
+                w->up_off = (uint64_t)off;
+                w->bytes_out += (uint64_t)r;
+                continue;
+            }
+        } else {
+            w->up_blob = next_needed(m, w, w->up_blob + 1);
+            if (w->up_blob < m->blob_count) {
+                upload_prepare(m, w);
+            }
+            continue;
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        w->up_hdr_sent += (uint32_t)r;
+        w->bytes_out += (uint64_t)r;
+    }
+    return 1;
+}
+
+static int dispatch_local(distr_manager_t *m, int i) {
+    worker_info_t *w = &m->ws[i];
+    size_t task_len = 0U;
+    int rc = m->ops.build_task(i, local_pool_task(m->local, 0), PAYLOAD_BUF_SZ, &task_len, m->ops.user_ctx);
+    if (rc != 0) {
+        return rc;
+    }
+    local_pool_submit(m->local, 0, task_len);
+    w->trace_idx = -1;
+    w->busy = 1;
+    return 0;
+}
+
+static int speculate_idle(distr_manager_t *m) {
+    int keep = 0;
+    int k;
+    for (k = 0; k < m->idle_len; ++k) {
+        int j = m->idle[k];
+        worker_info_t *w = &m->ws[j];
+        worker_info_t *o;
+        pool_buf_t *frame;
+        int best = -1;
+        int i;
+        for (i = 0; w->local == 0 && i < m->cfg.required_workers; ++i) {
+            const worker_info_t *c = &m->ws[i];
+            if (c->busy != 0 && c->local == 0 && c->cancelling == 0 && c->spec_of < 0 && c->spec_by < 0 &&
+                c->task != NULL && (best < 0 || c->task_ns < m->ws[best].task_ns)) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            m->idle[keep++] = j;
+            continue;
+        }
+        o = &m->ws[best];
+        frame = pool_get(o->task->len);
+        if (frame == NULL) {
+            fprintf(stderr, "[manager] out of task buffers\n");
+            return -1;
+        }
+        memcpy(frame->data, o->task->data, o->task->len);
+        frame->len = o->task->len;
+        pool_put(w->task);
+        w->task = frame;
+        if (mgr_send(m, j, NET_MSG_TASK, frame->data + TRACE_TASK_HDR_SZ,
+                     (uint32_t)(frame->len - TRACE_TASK_HDR_SZ)) != 0) {
+            fprintf(stderr, "[manager] send TASK failed\n");
+            return -1;
+        }
+        w->trace_idx = -1;
+        w->busy = 1;
+        w->task_ns = now_ns();
+        w->spec_of = best;
+        o->spec_by = j;
+        fprintf(stderr, "[manager] worker#%d duplicates the task of straggler worker#%d\n", j, best);
+    }
+    m->idle_len = keep;
+    return 0;
+}
+
+static int dispatch_idle(distr_manager_t *m) {
+    const manager_ops_t *ops = &m->ops;
+    trace_log_t *trace = m->trace;
+    int k;
+    int keep = 0;
+    int sent = 0;
+    for (k = 0; k < m->idle_len; ++k) {
+        pool_buf_t *frame;
+        uint8_t *task_payload;
+        int i = m->idle[k];
+        worker_info_t *w = &m->ws[i];
+        size_t task_len = 0U;
+        uint64_t build_begin_ns = 0U;
+        long idx = -1;
+        int rc;
+        if (w->local != 0) {
+            rc = dispatch_local(m, i);
+            m->build_done = rc == DISTR_BUILD_DONE;
+            if (rc > 0) {
+                m->idle[keep++] = i;
+                continue;
+            }
+            if (rc < 0) {
+                fprintf(stderr, "[manager] build TASK failed\n");
+                return -1;
+            }
+            ++sent;
+            continue;
+        }
+        frame = pool_get(TRACE_TASK_HDR_SZ + PAYLOAD_BUF_SZ);
+        if (frame == NULL) {
+            fprintf(stderr, "[manager] out of task buffers\n");
+            return -1;
+        }
+        task_payload = frame->data + TRACE_TASK_HDR_SZ;
+        if (trace != NULL) {
+            build_begin_ns = now_ns();
+        }
+        rc = ops->build_task(i, task_payload, PAYLOAD_BUF_SZ, &task_len, ops->user_ctx);
+        m->build_done = rc == DISTR_BUILD_DONE;
+        if (rc > 0) {
+            pool_put(frame);
+            m->idle[keep++] = i;
+            continue;
+        }
+        if (rc < 0) {
+            pool_put(frame);
+            fprintf(stderr, "[manager] build TASK failed\n");
+            return -1;
+        }
+        frame->len = TRACE_TASK_HDR_SZ + task_len;
+        if (trace != NULL) {
+            idx = trace_log_add(trace, i);
+        }
+        if (idx >= 0) {
+            trace_span_t *span = &trace->spans[idx];
+            span->build_begin_ns = build_begin_ns;
+            span->build_end_ns = now_ns();
+            trace_put_u64(frame->data, span->trace_id);
+            rc = mgr_send(m, i, NET_MSG_TRACE_TASK, frame->data, (uint32_t)frame->len);
+            span->send_end_ns = now_ns();
+        } else {
+            rc = mgr_send(m, i, NET_MSG_TASK, task_payload, (uint32_t)task_len);
+        }
+        pool_put(w->task);
+        w->task = frame;
+        if (rc != 0) {
+            fprintf(stderr, "[manager] send TASK failed\n");
+            return -1;
+        }
+        w->trace_idx = idx;
+        w->busy = 1;
+        w->task_ns = now_ns();
+        ++sent;
+    }
+    m->idle_len = keep;
+    if (m->cfg.speculate != 0 && m->build_done != 0 && trace == NULL && speculate_idle(m) != 0) {
+        return -1;
+    }
+    return sent;
+}
+
+static const uint8_t *take_trace_result(trace_log_t *trace,
+                                        const worker_info_t *w,
+                                        const uint8_t *msg_payload,
+                                        uint32_t *msg_len,
+                                        uint64_t recv_ns) {
+    trace_span_t *span;
+    if (*msg_len < TRACE_RESULT_HDR_SZ) {
+        return NULL;
+    }
+    *msg_len -= TRACE_RESULT_HDR_SZ;
+    if (trace == NULL || w->trace_idx < 0) {
+        return msg_payload + TRACE_RESULT_HDR_SZ;
+    }
+    span = &trace->spans[w->trace_idx];
+    if (trace_get_u64(msg_payload) != span->trace_id) {
+        return NULL;
+    }
+    span->recv_ns = recv_ns;
+    span->w_recv_ns = trace_get_u64(msg_payload + 8);
+    span->w_fork_ns = trace_get_u64(msg_payload + 16);
+    span->w_kernel_begin_ns = trace_get_u64(msg_payload + 24);
+    span->w_kernel_end_ns = trace_get_u64(msg_payload + 32);
+    span->w_send_ns = trace_get_u64(msg_payload + 40);
+    return msg_payload + TRACE_RESULT_HDR_SZ;
+}
+
+static void finish_trace(trace_log_t *trace) {
+    if (trace == NULL) {
+        return;
+    }
+    if (trace_log_write(trace) != 0) {
+        fprintf(stderr, "[manager] failed to write trace %s\n", trace->path);
+    }
+    trace_log_free(trace);
+}
+
+static void mgr_stop_announce(distr_manager_t *m) {
+    if (m->announce_timer_fd >= 0) {
+        close(m->announce_timer_fd);
+        m->announce_timer_fd = -1;
+    }
+    if (m->announce_fd >= 0) {
+        close(m->announce_fd);
+        m->announce_fd = -1;
+    }
+}
+
+static void mgr_close_fds(distr_manager_t *m) {
     int i;
-    uint8_t type = NET_MSG_ABORT;
-    if (strcmp(msg, "SHUTDOWN") == 0) {
-        type = NET_MSG_SHUTDOWN;
+    mgr_stop_announce(m);
+    local_pool_free(m->local);
+    m->local = NULL;
+    if (m->local_fd >= 0) {
+        close(m->local_fd);
+        m->local_fd = -1;
     }
-    for (i = 0; i < n; ++i) {
-        if (ws[i].alive != 0) {
-            (void)net_send_packet(ws[i].fd, type, NULL, 0U, 5);
+    if (m->ws != NULL) {
+        for (i = 0; i < m->cfg.required_workers; ++i) {
+            conn_close(&m->ws[i].conn);
+            out_clear(&m->ws[i]);
+            pool_put(m->ws[i].task);
+            m->ws[i].task = NULL;
+            m->ws[i].alive = 0;
+        }
+    }
+    for (i = 0; i < m->pending_cap; ++i) {
+        conn_close(&m->pending[i]);
+    }
+    if (m->listen_fd >= 0) {
+        close(m->listen_fd);
+        m->listen_fd = -1;
+    }
+    if (m->timer_fd >= 0) {
+        close(m->timer_fd);
+        m->timer_fd = -1;
+    }
+    for (i = 0; i < MGR_CTL_CLIENTS; ++i) {
+        if (m->ctl[i].fd >= 0) {
+            close(m->ctl[i].fd);
+            m->ctl[i].fd = -1;
+        }
+    }
+    if (m->ctl_fd >= 0) {
+        close(m->ctl_fd);
+        m->ctl_fd = -1;
+        (void)unlink(m->cfg.control_path);
+    }
+    for (i = 0; i < m->blob_count; ++i) {
+        if (m->blob_fds[i] >= 0) {
+            close(m->blob_fds[i]);
+            m->blob_fds[i] = -1;
         }
     }
 }
 
-static void close_all(worker_info_t *ws, int n) {
+static void add_task_stats(worker_info_t *w, const uint8_t *p) {
+    int k;
+    for (k = 0; k < TASK_STATS_FIELDS; ++k) {
+        uint64_t v = trace_get_u64(p + 8 * k);
+        if (w->stat_tasks > 0 && w->stats[k] == TASK_STATS_NA) {
+            continue;
+        }
+        if (v == TASK_STATS_NA || w->stat_tasks == 0) {
+            w->stats[k] = v;
+        } else if (k == TASK_STAT_MAXRSS_KB) {
+            w->stats[k] = (v > w->stats[k]) ? v : w->stats[k];
+        } else {
+            w->stats[k] += v;
+        }
+    }
+    ++w->stat_tasks;
+}
+
+static void report_task_stats(const distr_manager_t *m) {
     int i;
-    for (i = 0; i < n; ++i) {
-        if (ws[i].fd >= 0) {
-            close(ws[i].fd);
-            ws[i].fd = -1;
+    for (i = 0; i < m->cfg.required_workers; ++i) {
+        const worker_info_t *w = &m->ws[i];
+        const uint64_t *s = w->stats;
+        if (w->stat_tasks == 0) {
+            continue;
+        }
+        fprintf(stderr,
+                "[manager] worker#%d tasks=%ld user=%.3fs sys=%.3fs max_rss=%lluKB minflt=%llu majflt=%llu "
+                "csw=%llu/%llu",
+                i,
+                w->stat_tasks,
+                (double)s[TASK_STAT_UTIME_US] / 1e6,
+                (double)s[TASK_STAT_STIME_US] / 1e6,
+                (unsigned long long)s[TASK_STAT_MAXRSS_KB],
+                (unsigned long long)s[TASK_STAT_MINFLT],
+                (unsigned long long)s[TASK_STAT_MAJFLT],
+                (unsigned long long)s[TASK_STAT_NVCSW],
+                (unsigned long long)s[TASK_STAT_NIVCSW]);
+        if (s[TASK_STAT_CYCLES] != TASK_STATS_NA && s[TASK_STAT_INSTRUCTIONS] != TASK_STATS_NA &&
+            s[TASK_STAT_CYCLES] > 0U) {
+            fprintf(stderr, " ipc=%.2f", (double)s[TASK_STAT_INSTRUCTIONS] / (double)s[TASK_STAT_CYCLES]);
+        } else {
+            fprintf(stderr, " ipc=n/a");
+        }
+        if (s[TASK_STAT_CACHE_MISSES] != TASK_STATS_NA && s[TASK_STAT_INSTRUCTIONS] != TASK_STATS_NA &&
+            s[TASK_STAT_INSTRUCTIONS] > 0U) {
+            fprintf(stderr, " miss_per_kinstr=%.3f\n",
+                    1000.0 * (double)s[TASK_STAT_CACHE_MISSES] / (double)s[TASK_STAT_INSTRUCTIONS]);
+        } else {
+            fprintf(stderr, " miss_per_kinstr=n/a\n");
         }
     }
 }
 
-int run_manager(const manager_cfg_t *mcfg, const manager_ops_t *ops) {
-    int listen_fd = -1;
-    worker_info_t *ws = NULL;
-    int connected = 0;
+static void report_pool_stats(void) {
+    distr_pool_stats_t st[POOL_CLASSES];
+    int n = distr_pool_stats(st, POOL_CLASSES);
+    int k;
+    for (k = 0; k < n; ++k) {
+        uint64_t total = st[k].hits + st[k].misses;
+        if (total == 0U) {
+            continue;
+        }
+        fprintf(stderr, "[manager] buffer pool %zuB: hits=%llu misses=%llu hit_rate=%.1f%% high_water=%llu\n",
+                st[k].buf_size,
+                (unsigned long long)st[k].hits,
+                (unsigned long long)st[k].misses,
+                100.0 * (double)st[k].hits / (double)total,
+                (unsigned long long)st[k].high_water);
+    }
+}
+
+static void mgr_cancel_task(distr_manager_t *m, int i) {
+    worker_info_t *w = &m->ws[i];
+    if (w->spec_of >= 0) {
+        m->ws[w->spec_of].spec_by = -1;
+    }
+    if (w->spec_by >= 0) {
+        m->ws[w->spec_by].spec_of = -1;
+    }
+    w->spec_of = -1;
+    w->spec_by = -1;
+    if (w->alive == 0 || w->busy == 0 || w->cancelling != 0) {
+        return;
+    }
+    w->cancelling = 1;
+    if (w->local != 0) {
+        local_pool_cancel(m->local, 0);
+    } else {
+        (void)mgr_send(m, i, NET_MSG_CANCEL, NULL, 0U);
+    }
+    fprintf(stderr, "[manager] cancelling the task on worker#%d\n", i);
+}
+
+static void mgr_finish(distr_manager_t *m, int status) {
     int i;
-    struct sigaction sa_new;
-    struct sigaction sa_old;
+    if (m->state == MGR_DONE) {
+        return;
+    }
+    if (m->state == MGR_RUNNING) {
+        uint8_t type = (status == 0) ? NET_MSG_SHUTDOWN : NET_MSG_ABORT;
+        uint64_t deadline = now_ms() + MGR_FLUSH_MS;
+        for (i = 0; i < m->cfg.required_workers; ++i) {
+            if (m->ws[i].alive != 0 && m->ws[i].local == 0) {
+                mgr_cancel_task(m, i);
+                (void)mgr_send(m, i, type, NULL, 0U);
+            }
+        }
+        for (i = 0; i < m->cfg.required_workers; ++i) {
+            if (m->ws[i].alive != 0 && m->ws[i].local == 0) {
+                out_drain(&m->ws[i], deadline);
+            }
+        }
+    }
+    report_task_stats(m);
+    mgr_close_fds(m);
+    report_pool_stats();
+    finish_trace(m->trace);
+    m->trace = NULL;
+    m->state = MGR_DONE;
+    m->status = status;
+    if (m->on_done != NULL) {
+        m->on_done(m, status, m->done_ctx);
+    }
+}
 
-    if (mcfg == NULL || ops == NULL || ops->on_worker_hello == NULL || ops->build_task == NULL ||
-        ops->on_worker_result == NULL || mcfg->required_workers < 1 || mcfg->max_time_sec < 1) {
-        return 2;
+static void mgr_retire(distr_manager_t *m, int i) {
+    worker_info_t *w = &m->ws[i];
+    if (w->local == 0 && mgr_send(m, i, NET_MSG_SHUTDOWN, NULL, 0U) == 0) {
+        out_drain(w, now_ms() + MGR_FLUSH_MS);
     }
+    conn_close(&w->conn);
+    out_clear(w);
+    pool_put(w->task);
+    w->task = NULL;
+    w->alive = 0;
+    fprintf(stderr, "[manager] worker#%d drained\n", i);
+}
 
-    (void)signal(SIGINT, on_sigint);
-    memset(&sa_new, 0, sizeof(sa_new));
-    sa_new.sa_handler = on_sigalrm;
-    sigemptyset(&sa_new.sa_mask);
-    sa_new.sa_flags = 0;
-    if (sigaction(SIGALRM, &sa_new, &sa_old) != 0) {
-        return 2;
+static void mgr_begin(distr_manager_t *m) {
+    int i;
+    mgr_stop_announce(m);
+    if (m->listen_fd >= 0) {
+        (void)epoll_ctl(m->epfd, EPOLL_CTL_DEL, m->listen_fd, NULL);
+        close(m->listen_fd);
+        m->listen_fd = -1;
     }
-    g_timeout = 0;
-    alarm((unsigned int)mcfg->max_time_sec);
-    listen_fd = net_listen(mcfg->host, mcfg->port);
-    if (listen_fd < 0) {
-        perror("net_listen");
-        alarm(0U);
-        (void)sigaction(SIGALRM, &sa_old, NULL);
-        return 2;
+    for (i = 0; i < m->pending_cap; ++i) {
+        conn_close(&m->pending[i]);
+    }
+    for (i = 0; i < m->cfg.required_workers; ++i) {
+        m->idle[i] = i;
+    }
+    m->idle_len = m->cfg.required_workers;
+    m->state = MGR_RUNNING;
+    m->begin_ns = now_ns();
+    m->in_flight = dispatch_idle(m);
+    if (m->in_flight < 0) {
+        mgr_finish(m, 3);
+    } else if (m->in_flight == 0) {
+        mgr_finish(m, 0);
     }
+}
 
-    ws = (worker_info_t *)calloc((size_t)mcfg->required_workers, sizeof(*ws));
-    if (ws == NULL) {
-        close(listen_fd);
-        return 2;
+static int pending_slot(distr_manager_t *m) {
+    int i;
+    mgr_conn_t *grown;
+    int cap;
+    for (i = 0; i < m->pending_cap; ++i) {
+        if (m->pending[i].fd < 0) {
+            return i;
+        }
     }
-    for (i = 0; i < mcfg->required_workers; ++i) {
-        ws[i].fd = -1;
+    cap = (m->pending_cap == 0) ? 16 : m->pending_cap * 2;
+    grown = (mgr_conn_t *)realloc(m->pending, (size_t)cap * sizeof(*grown));
+    if (grown == NULL) {
+        return -1;
+    }
+    for (i = m->pending_cap; i < cap; ++i) {
+        memset(&grown[i], 0, sizeof(grown[i]));
+        grown[i].fd = -1;
     }
+    m->pending = grown;
+    i = m->pending_cap;
+    m->pending_cap = cap;
+    return i;
+}
 
-    fprintf(stderr, "[manager] listening on %s:%s, need workers=%d\n",
-            mcfg->host, mcfg->port, mcfg->required_workers);
+static void mgr_accept(distr_manager_t *m) {
+    for (;;) {
+        int fd = net_accept_nowait(m->listen_fd, 5);
+        int slot;
+        if (fd < 0) {
+            return;
+        }
+        slot = pending_slot(m);
+        if (slot < 0 || set_fd_nonblock(fd, 1) != 0 ||
+            mgr_watch(m, EPOLL_CTL_ADD, fd, MGR_TAG_PENDING, slot, EPOLLIN) != 0) {
+            close(fd);
+            return;
+        }
+        m->pending[slot].fd = fd;
+        conn_reset(&m->pending[slot]);
+    }
+}
 
-    while (connected < mcfg->required_workers) {
-        int fd;
-        uint8_t msg_type = 0U;
-        uint8_t msg_payload[PAYLOAD_BUF_SZ];
-        uint32_t msg_len = 0U;
+static void mgr_on_pending(distr_manager_t *m, int slot) {
+    mgr_conn_t *c = &m->pending[slot];
+    worker_info_t *w;
+    int rc;
 
-        if (g_stop != 0) {
-            fprintf(stderr, "[manager] interrupted\n");
-            goto fail;
+    if (c->fd < 0) {
+        return;
+    }
+    rc = conn_read(c);
+    if (rc == 0) {
+        return;
+    }
+    if (rc < 0 || c->hdr[0] != NET_MSG_HELLO ||
+        m->ops.on_worker_hello(m->connected, c->buf->data, (size_t)c->payload_len, m->ops.user_ctx) != 0) {
+        conn_close(c);
+        return;
+    }
+    pool_put(conn_take(c));
+    w = &m->ws[m->connected];
+    w->conn = *c;
+    w->alive = 1;
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    if (mgr_watch(m, EPOLL_CTL_MOD, w->conn.fd, MGR_TAG_WORKER, m->connected, EPOLLIN) != 0) {
+        mgr_finish(m, 3);
+        return;
+    }
+    if (m->blob_count > 0) {
+        w->uploading = 1;
+        w->up_blob = -1;
+        ++m->uploads_pending;
+        if (mgr_send(m, m->connected, NET_MSG_BLOB_OFFER, m->offer, m->offer_len) != 0) {
+            mgr_finish(m, 3);
+            return;
         }
-        if (g_timeout != 0) {
-            fprintf(stderr, "[manager] timeout waiting workers\n");
-            goto fail;
+    }
+    ++m->connected;
+    fprintf(stderr, "[manager] worker#%d joined\n", m->connected);
+    if (m->connected == m->cfg.required_workers && m->uploads_pending == 0) {
+        mgr_begin(m);
+    }
+}
+
+static void mgr_on_upload(distr_manager_t *m, int i) {
+    worker_info_t *w = &m->ws[i];
+    int rc = (w->up_blob < m->blob_count) ? upload_step(m, w) : 1;
+    if (rc < 0) {
+        fprintf(stderr, "[manager] input upload to worker#%d failed\n", i);
+        mgr_finish(m, 3);
+        return;
+    }
+    if (rc == 0) {
+        return;
+    }
+    w->uploading = 0;
+    --m->uploads_pending;
+    if (mgr_update_watch(m, i) != 0) {
+        mgr_finish(m, 3);
+        return;
+    }
+    if (m->connected == m->cfg.required_workers && m->uploads_pending == 0) {
+        mgr_begin(m);
+    }
+}
+
+static void mgr_on_need(distr_manager_t *m, int i, const uint8_t *p, uint32_t len) {
+    worker_info_t *w = &m->ws[i];
+    uint32_t count;
+    uint32_t k;
+    int missing = 0;
+    if (len < 4U) {
+        goto bad;
+    }
+    count = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+    if (count > (uint32_t)m->blob_count || len != 4U + 4U * count) {
+        goto bad;
+    }
+    w->up_need = 0U;
+    for (k = 0; k < count; ++k) {
+        const uint8_t *q = p + 4U + 4U * k;
+        uint32_t idx = ((uint32_t)q[0] << 24) | ((uint32_t)q[1] << 16) | ((uint32_t)q[2] << 8) | (uint32_t)q[3];
+        if (idx >= (uint32_t)m->blob_count) {
+            goto bad;
+        }
+        w->up_need |= 1U << idx;
+    }
+    w->up_blob = next_needed(m, w, 0);
+    for (k = 0; k < (uint32_t)m->blob_count; ++k) {
+        if ((w->up_need & (1U << k)) != 0U) {
+            ++missing;
+        }
+    }
+    fprintf(stderr, "[manager] worker#%d has %d/%d input(s) cached\n", i, m->blob_count - missing, m->blob_count);
+    if (w->up_blob >= m->blob_count) {
+        mgr_on_upload(m, i);
+        return;
+    }
+    upload_prepare(m, w);
+    if (mgr_update_watch(m, i) != 0) {
+        mgr_finish(m, 3);
+    }
+    return;
+bad:
+    fprintf(stderr, "[manager] bad BLOB_NEED payload from worker#%d\n", i);
+    mgr_finish(m, 3);
+}
+
+static void mgr_on_cancelled(distr_manager_t *m, int i) {
+    worker_info_t *w = &m->ws[i];
+    int more;
+    w->busy = 0;
+    w->cancelling = 0;
+    pool_put(w->task);
+    w->task = NULL;
+    if (w->draining != 0) {
+        mgr_retire(m, i);
+    } else {
+        m->idle[m->idle_len++] = i;
+    }
+    more = dispatch_idle(m);
+    if (more < 0) {
+        mgr_finish(m, 3);
+        return;
+    }
+    m->in_flight += more;
+}
+
+static void mgr_on_frame(distr_manager_t *m, int i, uint8_t msg_type, const pool_buf_t *in, uint64_t recv_ns) {
+    worker_info_t *w = &m->ws[i];
+    trace_log_t *trace = m->trace;
+    const uint8_t *result = in->data;
+    uint32_t msg_len = (uint32_t)in->len;
+    uint64_t reduce_begin_ns;
+    int more;
+    int rc;
+
+    if (msg_type == NET_MSG_BLOB_NEED && w->uploading != 0 && w->up_blob < 0) {
+        mgr_on_need(m, i, result, msg_len);
+        return;
+    }
+    if (msg_type == NET_MSG_TASK_STATS && w->busy != 0) {
+        if (msg_len != TASK_STATS_SZ) {
+            fprintf(stderr, "[manager] bad TASK_STATS payload from worker#%d\n", i);
+            mgr_finish(m, 3);
+            return;
+        }
+        add_task_stats(w, result);
+        return;
+    }
+    if (msg_type == NET_MSG_PARTIAL && w->busy != 0) {
+        if (m->ops.on_worker_partial == NULL || w->cancelling != 0 || w->spec_of >= 0) {
+            return;
         }
-        fd = net_accept_timeout(listen_fd, 1);
+        rc = m->ops.on_worker_partial(i, result, (size_t)msg_len, m->ops.user_ctx);
+        if (rc < 0) {
+            fprintf(stderr, "[manager] bad PARTIAL payload from worker#%d\n", i);
+            mgr_finish(m, 3);
+        } else if (rc > 0) {
+            fprintf(stderr, "[manager] target reached, stopping %d task(s) early\n", m->in_flight);
+            mgr_finish(m, 0);
+        }
+        return;
+    }
+    if (msg_type == NET_MSG_TRACE_RESULT && w->busy != 0) {
+        result = take_trace_result(trace, w, result, &msg_len, recv_ns);
+        if (result == NULL) {
+            fprintf(stderr, "[manager] bad trace header from worker#%d\n", i);
+            mgr_finish(m, 3);
+            return;
+        }
+        msg_type = NET_MSG_RESULT;
+    }
+    if ((msg_type == NET_MSG_RESULT || msg_type == NET_MSG_CANCELLED) && w->busy != 0 && w->cancelling != 0) {
+        mgr_on_cancelled(m, i);
+        return;
+    }
+    if (msg_type == NET_MSG_RESULT && w->busy != 0) {
+        int owner = (w->spec_of >= 0) ? w->spec_of : i;
+        if (w->spec_of >= 0 || w->spec_by >= 0) {
+            mgr_cancel_task(m, (w->spec_of >= 0) ? w->spec_of : w->spec_by);
+        }
+        w->busy = 0;
+        pool_put(w->task);
+        w->task = NULL;
+        ++w->tasks_done;
+        --m->in_flight;
+        if (w->draining != 0) {
+            mgr_retire(m, i);
+        } else {
+            m->idle[m->idle_len++] = i;
+        }
+        reduce_begin_ns = now_ns();
+        rc = m->ops.on_worker_result(owner, result, (size_t)msg_len, m->ops.user_ctx);
+        if (trace != NULL && w->trace_idx >= 0) {
+            trace->spans[w->trace_idx].reduce_begin_ns = reduce_begin_ns;
+            trace->spans[w->trace_idx].reduce_end_ns = now_ns();
+        }
+        if (rc != 0) {
+            fprintf(stderr, "[manager] bad RESULT payload from worker#%d\n", i);
+            mgr_finish(m, 3);
+            return;
+        }
+        more = dispatch_idle(m);
+        if (more < 0) {
+            mgr_finish(m, 3);
+            return;
+        }
+        m->in_flight += more;
+        if (m->in_flight == 0) {
+            mgr_finish(m, 0);
+        }
+        return;
+    }
+    if (msg_type == NET_MSG_ERROR) {
+        fprintf(stderr, "[manager] worker error: %.*s\n", (int)msg_len, (const char *)result);
+    } else {
+        fprintf(stderr, "[manager] malformed reply type=%u\n", (unsigned)msg_type);
+    }
+    mgr_finish(m, 3);
+}
+
+static void mgr_on_writable(distr_manager_t *m, int i) {
+    if (out_flush(&m->ws[i]) < 0 || mgr_update_watch(m, i) != 0) {
+        fprintf(stderr, "[manager] send to worker#%d failed\n", i);
+        mgr_finish(m, 3);
+    }
+}
+
+static void mgr_on_worker(distr_manager_t *m, int i) {
+    worker_info_t *w = &m->ws[i];
+    pool_buf_t *in;
+    uint8_t msg_type;
+    int rc;
+
+    rc = conn_read(&w->conn);
+    if (rc == 0) {
+        return;
+    }
+    if (rc < 0) {
+        fprintf(stderr, "[manager] worker#%d disconnected/timeout\n", i);
+        mgr_finish(m, 3);
+        return;
+    }
+    msg_type = w->conn.hdr[0];
+    in = conn_take(&w->conn);
+    mgr_on_frame(m, i, msg_type, in, now_ns());
+    pool_put(in);
+}
+
+static void mgr_on_local(distr_manager_t *m) {
+    uint64_t ticks;
+    int i;
+    if (read(m->local_fd, &ticks, sizeof(ticks)) != (ssize_t)sizeof(ticks)) {
+        return;
+    }
+    while (m->state != MGR_DONE && m->local != NULL) {
+        pool_buf_t *in = pool_get(PAYLOAD_BUF_SZ);
+        if (in == NULL) {
+            fprintf(stderr, "[manager] out of result buffers\n");
+            mgr_finish(m, 3);
+            return;
+        }
+        if (local_pool_take_partial(m->local, 0, in->data, &in->len) == 0) {
+            pool_put(in);
+            break;
+        }
+        mgr_on_frame(m, 0, NET_MSG_PARTIAL, in, now_ns());
+        pool_put(in);
+    }
+    while (m->state != MGR_DONE && m->local != NULL && (i = local_pool_next_done(m->local, 0)) >= 0) {
+        size_t len = 0U;
+        int rc = 0;
+        const uint8_t *p = local_pool_result(m->local, i, &len, &rc);
+        pool_buf_t *in = pool_get(len);
+        if (in == NULL) {
+            fprintf(stderr, "[manager] out of result buffers\n");
+            mgr_finish(m, 3);
+            return;
+        }
+        memcpy(in->data, p, len);
+        in->len = len;
+        mgr_on_frame(m, 0, (rc == 0) ? NET_MSG_RESULT : (m->ws[0].cancelling != 0) ? NET_MSG_CANCELLED : NET_MSG_ERROR,
+                     in, now_ns());
+        pool_put(in);
+    }
+}
+
+static int mgr_start_local(distr_manager_t *m) {
+    const worker_ops_t *wops = m->cfg.local_ops;
+    uint8_t hello_payload[PAYLOAD_BUF_SZ];
+    size_t hello_len = 0U;
+    worker_cfg_t wcfg;
+
+    memset(&wcfg, 0, sizeof(wcfg));
+    wcfg.max_cores = m->cfg.local_cores;
+    wcfg.max_time_sec = m->cfg.max_time_sec;
+    if (wops->build_hello(hello_payload, sizeof(hello_payload), &hello_len, &wcfg, wops->user_ctx) != 0 ||
+        m->ops.on_worker_hello(0, hello_payload, hello_len, m->ops.user_ctx) != 0) {
+        fprintf(stderr, "[manager] local worker HELLO rejected\n");
+        return -1;
+    }
+    m->local_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m->local_fd < 0 || mgr_watch(m, EPOLL_CTL_ADD, m->local_fd, MGR_TAG_LOCAL, 0, EPOLLIN) != 0) {
+        return -1;
+    }
+    m->local = local_pool_start(wops, 1, m->local_fd, m->cfg.max_time_sec);
+    if (m->local == NULL) {
+        return -1;
+    }
+    m->ws[0].alive = 1;
+    m->ws[0].local = 1;
+    m->connected = 1;
+    fprintf(stderr, "[manager] worker#1 joined (local, %d cores)\n", m->cfg.local_cores);
+    if (m->connected == m->cfg.required_workers) {
+        uint64_t one = 1U;
+        if (write(m->local_fd, &one, sizeof(one)) != (ssize_t)sizeof(one)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int ctl_listen(const char *path) {
+    struct sockaddr_un addr;
+    size_t len = strlen(path);
+    int fd;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (len == 0U || len >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memcpy(addr.sun_path, path, len);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    (void)unlink(path);
+    if (bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, MGR_CTL_CLIENTS) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void ctl_accept(distr_manager_t *m) {
+    for (;;) {
+        struct timeval tv = {1, 0};
+        int fd = accept(m->ctl_fd, NULL, NULL);
+        int k = 0;
         if (fd < 0) {
-            continue;
+            return;
         }
-        if (net_recv_packet(fd, &msg_type, msg_payload, sizeof(msg_payload), &msg_len, 5) < 0) {
-            close(fd);
-            continue;
+        while (k < MGR_CTL_CLIENTS && m->ctl[k].fd >= 0) {
+            ++k;
         }
-        if (msg_type != NET_MSG_HELLO) {
+        if (k == MGR_CTL_CLIENTS || setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0 ||
+            mgr_watch(m, EPOLL_CTL_ADD, fd, MGR_TAG_CTL_CLIENT, k, EPOLLIN) != 0) {
             close(fd);
             continue;
         }
-        if (ops->on_worker_hello(connected, msg_payload, (size_t)msg_len, ops->user_ctx) != 0) {
-            close(fd);
-            continue;
+        m->ctl[k].fd = fd;
+        m->ctl[k].len = 0U;
+    }
+}
+
+static void ctl_status(const distr_manager_t *m, FILE *out) {
+    static const char *const states[] = {"joining", "running", "done"};
+    double elapsed = (m->begin_ns != 0U) ? (double)(now_ns() - m->begin_ns) / 1e9 : 0.0;
+    double progress = -1.0;
+    uint64_t bytes_in = 0U;
+    uint64_t bytes_out = 0U;
+    long done = 0;
+    int active = 0;
+    int i;
+
+    if (m->state == MGR_RUNNING && m->ops.progress != NULL) {
+        progress = m->ops.progress(m->ops.user_ctx);
+    }
+    for (i = 0; i < m->cfg.required_workers; ++i) {
+        const worker_info_t *w = &m->ws[i];
+        bytes_in += w->conn.bytes_in;
+        bytes_out += w->bytes_out;
+        done += w->tasks_done;
+        if (w->alive != 0 && w->draining == 0) {
+            ++active;
         }
-        ws[connected].fd = fd;
-        ws[connected].alive = 1;
-        ++connected;
-        fprintf(stderr, "[manager] worker#%d joined\n", connected);
     }
+    fprintf(out,
+            "{\"state\": \"%s\", \"workers\": %d, \"connected\": %d, \"active\": %d, \"in_flight\": %d, "
+            "\"tasks_done\": %ld, \"elapsed_sec\": %.3f, \"bytes_in\": %llu, \"bytes_out\": %llu",
+            states[m->state],
+            m->cfg.required_workers,
+            m->connected,
+            active,
+            m->in_flight,
+            done,
+            elapsed,
+            (unsigned long long)bytes_in,
+            (unsigned long long)bytes_out);
+    if (progress > 0.0) {
+        fprintf(out, ", \"progress\": %.4f, \"eta_sec\": %.3f", progress, elapsed * (1.0 - progress) / progress);
+    } else if (progress == 0.0) {
+        fprintf(out, ", \"progress\": 0, \"eta_sec\": null");
+    } else {
+        fprintf(out, ", \"progress\": null, \"eta_sec\": null");
+    }
+    fprintf(out, ", \"worker\": [");
+    for (i = 0; i < m->connected; ++i) {
+        const worker_info_t *w = &m->ws[i];
+        fprintf(out,
+                "%s{\"id\": %d, \"alive\": %d, \"busy\": %d, \"draining\": %d, \"tasks\": %ld, "
+                "\"tasks_per_sec\": %.3f, \"bytes_in\": %llu, \"bytes_out\": %llu}",
+                (i > 0) ? ", " : "",
+                i,
+                w->alive,
+                w->busy,
+                w->draining,
+                w->tasks_done,
+                (elapsed > 0.0) ? (double)w->tasks_done / elapsed : 0.0,
+                (unsigned long long)w->conn.bytes_in,
+                (unsigned long long)w->bytes_out);
+    }
+    fprintf(out, "]}");
+}
 
-    for (i = 0; i < mcfg->required_workers; ++i) {
-        uint8_t task_payload[PAYLOAD_BUF_SZ];
-        size_t task_len = 0U;
-        if (ops->build_task(i, task_payload, sizeof(task_payload), &task_len, ops->user_ctx) != 0) {
-            fprintf(stderr, "[manager] build TASK failed\n");
-            goto fail_abort;
+static void ctl_drain(distr_manager_t *m, int i, FILE *out) {
+    worker_info_t *w;
+    int others = 0;
+    int k;
+    if (m->state != MGR_RUNNING) {
+        fprintf(out, "{\"ok\": false, \"error\": \"job is not running\"}");
+        return;
+    }
+    if (i < 0 || i >= m->cfg.required_workers || m->ws[i].alive == 0 || m->ws[i].draining != 0) {
+        fprintf(out, "{\"ok\": false, \"error\": \"no such active worker\"}");
+        return;
+    }
+    for (k = 0; k < m->cfg.required_workers; ++k) {
+        if (k != i && m->ws[k].alive != 0 && m->ws[k].draining == 0) {
+            ++others;
         }
-        if (net_send_packet(ws[i].fd, NET_MSG_TASK, task_payload, (uint32_t)task_len, 5) < 0) {
-            fprintf(stderr, "[manager] send TASK failed\n");
-            goto fail_abort;
+    }
+    if (others == 0) {
+        fprintf(out, "{\"ok\": false, \"error\": \"cannot drain the last active worker\"}");
+        return;
+    }
+    w = &m->ws[i];
+    w->draining = 1;
+    fprintf(stderr, "[manager] draining worker#%d\n", i);
+    fprintf(out, "{\"ok\": true, \"worker\": %d, \"busy\": %d}", i, w->busy);
+    for (k = 0; k < m->idle_len; ++k) {
+        if (m->idle[k] == i) {
+            m->idle[k] = m->idle[--m->idle_len];
+            mgr_retire(m, i);
+            break;
         }
     }
+}
 
-    for (i = 0; i < mcfg->required_workers; ++i) {
-        uint8_t msg_type = 0U;
-        uint8_t msg_payload[PAYLOAD_BUF_SZ];
-        uint32_t msg_len = 0U;
-
-        if (g_stop != 0 || g_timeout != 0) {
-            fprintf(stderr, "[manager] timeout or interrupted during collect\n");
-            goto fail_abort;
-        }
-        if (net_recv_packet(ws[i].fd,
-                            &msg_type,
-                            msg_payload,
-                            sizeof(msg_payload),
-                            &msg_len,
-                            mcfg->max_time_sec) < 0) {
-            fprintf(stderr, "[manager] worker#%d disconnected/timeout\n", i);
-            goto fail_abort;
-        }
-        if (msg_type == NET_MSG_RESULT) {
-            if (ops->on_worker_result(i, msg_payload, (size_t)msg_len, ops->user_ctx) != 0) {
-                fprintf(stderr, "[manager] bad RESULT payload from worker#%d\n", i);
-                goto fail_abort;
-            }
-            continue;
+static void ctl_command(distr_manager_t *m, int fd, const char *line) {
+    char *reply = NULL;
+    size_t reply_len = 0U;
+    size_t off = 0U;
+    FILE *out = open_memstream(&reply, &reply_len);
+    int idx;
+
+    if (out == NULL) {
+        return;
+    }
+    if (strcmp(line, "status") == 0) {
+        ctl_status(m, out);
+    } else if (sscanf(line, "drain %d", &idx) == 1) {
+        ctl_drain(m, idx, out);
+    } else {
+        char app[MGR_CTL_LINE * 2];
+        int rc = 1;
+        app[0] = '\0';
+        if (m->ops.on_control != NULL) {
+            rc = m->ops.on_control(line, app, sizeof(app), m->ops.user_ctx);
         }
-        if (msg_type == NET_MSG_ERROR) {
-            fprintf(stderr,
-                    "[manager] worker error: %.*s\n",
-                    (int)msg_len,
-                    (const char *)msg_payload);
+        if (rc == 0) {
+            fprintf(out, "%s", (app[0] != '\0') ? app : "{\"ok\": true}");
         } else {
-            fprintf(stderr, "[manager] malformed reply type=%u\n", (unsigned)msg_type);
+            fprintf(out, "{\"ok\": false, \"error\": \"%s\"}", (rc > 0) ? "unknown command" : "command failed");
         }
-        goto fail_abort;
     }
+    fputc('\n', out);
+    if (fclose(out) != 0) {
+        free(reply);
+        return;
+    }
+    while (off < reply_len) {
+        ssize_t w = send(fd, reply + off, reply_len - off, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            break;
+        }
+        off += (size_t)w;
+    }
+    free(reply);
+}
 
-    broadcast(ws, mcfg->required_workers, "SHUTDOWN");
-    close_all(ws, mcfg->required_workers);
-    close(listen_fd);
-    alarm(0U);
-    (void)sigaction(SIGALRM, &sa_old, NULL);
-    free(ws);
+static void ctl_on_client(distr_manager_t *m, int k) {
+    mgr_ctl_t *c = &m->ctl[k];
+    char *end;
+    ssize_t r;
+
+    if (c->fd < 0) {
+        return;
+    }
+    r = recv(c->fd, c->line + c->len, sizeof(c->line) - 1U - c->len, MSG_DONTWAIT);
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (r > 0) {
+        c->len += (size_t)r;
+    }
+    c->line[c->len] = '\0';
+    end = strpbrk(c->line, "\r\n");
+    if (r > 0 && end == NULL && c->len < sizeof(c->line) - 1U) {
+        return;
+    }
+    if (end != NULL) {
+        *end = '\0';
+    }
+    if (r >= 0 && c->len > 0U) {
+        ctl_command(m, c->fd, c->line);
+    }
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void mgr_on_timer(distr_manager_t *m) {
+    uint64_t ticks;
+    if (read(m->timer_fd, &ticks, sizeof(ticks)) != (ssize_t)sizeof(ticks)) {
+        return;
+    }
+    if (m->state == MGR_JOINING) {
+        fprintf(stderr, "[manager] timeout waiting workers\n");
+    } else {
+        fprintf(stderr, "[manager] timeout during collect\n");
+    }
+    mgr_finish(m, 3);
+}
+
+static void mgr_announce(distr_manager_t *m) {
+    uint64_t ticks;
+    if (read(m->announce_timer_fd, &ticks, sizeof(ticks)) < 0 && errno != EAGAIN) {
+        return;
+    }
+    announce_wire_set_free_slots(m->announce, (uint32_t)(m->cfg.required_workers - m->connected));
+    (void)send(m->announce_fd, m->announce, sizeof(m->announce), MSG_DONTWAIT);
+}
+
+static int mgr_start_announce(distr_manager_t *m) {
+    struct itimerspec its;
+    const char *host = m->cfg.host;
+    size_t k;
+
+    m->announce_fd = net_announce_open(m->cfg.announce_host, m->cfg.announce_port);
+    m->announce_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m->announce_fd < 0 || m->announce_timer_fd < 0) {
+        perror("net_announce_open");
+        return -1;
+    }
+    m->job_id = now_ns() ^ ((uint64_t)getpid() << 32);
+    announce_wire_init(m->announce, DISTR_WIRE_ANNOUNCE);
+    announce_wire_set_job_id(m->announce, m->job_id);
+    announce_wire_set_port(m->announce, net_local_port(m->listen_fd));
+    if (host != NULL && strcmp(host, "0.0.0.0") != 0 && strlen(host) < ANNOUNCE_HOST_MAX) {
+        for (k = 0; host[k] != '\0'; ++k) {
+            announce_wire_set_host(m->announce, k, (uint8_t)host[k]);
+        }
+    }
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1;
+    its.it_interval.tv_nsec = MGR_ANNOUNCE_MS * 1000000L;
+    if (timerfd_settime(m->announce_timer_fd, 0, &its, NULL) != 0 ||
+        mgr_watch(m, EPOLL_CTL_ADD, m->announce_timer_fd, MGR_TAG_ANNOUNCE, 0, EPOLLIN) != 0) {
+        return -1;
+    }
+    fprintf(stderr, "[manager] announcing job %016llx to %s:%s\n", (unsigned long long)m->job_id,
+            m->cfg.announce_host, m->cfg.announce_port);
     return 0;
+}
+
+static void mgr_release(distr_manager_t *m) {
+    mgr_close_fds(m);
+    if (m->trace != NULL) {
+        trace_log_free(m->trace);
+    }
+    if (m->epfd >= 0) {
+        close(m->epfd);
+    }
+    free(m->ws);
+    free(m->idle);
+    free(m->pending);
+    free(m);
+}
+
+distr_manager_t *distr_manager_start(const manager_cfg_t *mcfg,
+                                     const manager_ops_t *ops,
+                                     distr_manager_done_fn on_done,
+                                     void *done_ctx) {
+    distr_manager_t *m;
+    struct itimerspec its;
+    int flags;
+    int i;
+
+    if (mcfg == NULL || ops == NULL || ops->on_worker_hello == NULL || ops->build_task == NULL ||
+        ops->on_worker_result == NULL || mcfg->required_workers < 1 || mcfg->max_time_sec < 1 ||
+        mcfg->blob_count < 0 || mcfg->blob_count > DISTR_MAX_BLOBS ||
+        (mcfg->blob_count > 0 && mcfg->blob_paths == NULL) ||
+        (mcfg->announce_port != NULL && mcfg->announce_host == NULL) ||
+        (mcfg->local_cores > 0 && (mcfg->local_ops == NULL || mcfg->local_ops->build_hello == NULL ||
+                                   mcfg->local_ops->execute_task == NULL || mcfg->blob_count > 0))) {
+        return NULL;
+    }
+    m = (distr_manager_t *)calloc(1U, sizeof(*m));
+    if (m == NULL) {
+        return NULL;
+    }
+    m->cfg = *mcfg;
+    m->ops = *ops;
+    m->on_done = on_done;
+    m->done_ctx = done_ctx;
+    m->epfd = -1;
+    m->listen_fd = -1;
+    m->timer_fd = -1;
+    m->ctl_fd = -1;
+    m->local_fd = -1;
+    m->announce_fd = -1;
+    m->announce_timer_fd = -1;
+    m->state = MGR_JOINING;
+    m->status = -1;
+    for (i = 0; i < MGR_CTL_CLIENTS; ++i) {
+        m->ctl[i].fd = -1;
+    }
+    m->ws = (worker_info_t *)calloc((size_t)mcfg->required_workers, sizeof(*m->ws));
+    m->idle = (int *)calloc((size_t)mcfg->required_workers, sizeof(*m->idle));
+    if (m->ws == NULL || m->idle == NULL) {
+        goto fail;
+    }
+    for (i = 0; i < mcfg->required_workers; ++i) {
+        m->ws[i].conn.fd = -1;
+        m->ws[i].trace_idx = -1;
+        m->ws[i].spec_of = -1;
+        m->ws[i].spec_by = -1;
+    }
+    for (i = 0; i < mcfg->blob_count; ++i) {
+        struct stat st;
+        m->blob_fds[i] = open(mcfg->blob_paths[i], O_RDONLY | O_CLOEXEC);
+        m->blob_count = i + 1;
+        if (m->blob_fds[i] < 0 || fstat(m->blob_fds[i], &st) != 0) {
+            perror(mcfg->blob_paths[i]);
+            goto fail;
+        }
+        m->blob_sizes[i] = (uint64_t)st.st_size;
+        trace_put_u64(m->offer + 4U + (uint32_t)i * BLOB_OFFER_ENTRY_SZ, m->blob_sizes[i]);
+        if (sha256_fd(m->blob_fds[i], m->offer + 4U + (uint32_t)i * BLOB_OFFER_ENTRY_SZ + 8U) != 0) {
+            perror(mcfg->blob_paths[i]);
+            goto fail;
+        }
+    }
+    m->offer[0] = 0U;
+    m->offer[1] = 0U;
+    m->offer[2] = 0U;
+    m->offer[3] = (uint8_t)m->blob_count;
+    m->offer_len = 4U + (uint32_t)m->blob_count * BLOB_OFFER_ENTRY_SZ;
+
+    m->epfd = epoll_create1(EPOLL_CLOEXEC);
+    m->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m->epfd < 0 || m->timer_fd < 0) {
+        goto fail;
+    }
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = mcfg->max_time_sec;
+    if (timerfd_settime(m->timer_fd, 0, &its, NULL) != 0) {
+        goto fail;
+    }
+    m->listen_fd = net_listen(mcfg->host, mcfg->port);
+    if (m->listen_fd < 0) {
+        perror("net_listen");
+        goto fail;
+    }
+    flags = fcntl(m->listen_fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(m->listen_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        goto fail;
+    }
+    if (mgr_watch(m, EPOLL_CTL_ADD, m->listen_fd, MGR_TAG_LISTEN, 0, EPOLLIN) != 0 ||
+        mgr_watch(m, EPOLL_CTL_ADD, m->timer_fd, MGR_TAG_TIMER, 0, EPOLLIN) != 0) {
+        goto fail;
+    }
+    if (mcfg->control_path != NULL) {
+        m->ctl_fd = ctl_listen(mcfg->control_path);
+        if (m->ctl_fd < 0 || mgr_watch(m, EPOLL_CTL_ADD, m->ctl_fd, MGR_TAG_CONTROL, 0, EPOLLIN) != 0) {
+            perror(mcfg->control_path);
+            goto fail;
+        }
+    }
+    if (mcfg->trace_path != NULL && trace_log_init(&m->trace_store, mcfg->trace_path, mcfg->required_workers) == 0) {
+        m->trace = &m->trace_store;
+    }
+    if (mcfg->local_cores > 0 && mgr_start_local(m) != 0) {
+        goto fail;
+    }
+    if (mcfg->announce_port != NULL && mgr_start_announce(m) != 0) {
+        goto fail;
+    }
+
+    fprintf(stderr, "[manager] listening on %s:%s, need workers=%d\n",
+            mcfg->host, mcfg->port, mcfg->required_workers);
+    return m;
 
-fail_abort:
-    broadcast(ws, mcfg->required_workers, "ABORT");
 fail:
-    close_all(ws, mcfg->required_workers);
-    if (listen_fd >= 0) {
-        close(listen_fd);
+    mgr_release(m);
+    return NULL;
+}
+
+int distr_manager_fd(const distr_manager_t *m) {
+    return (m != NULL) ? m->epfd : -1;
+}
+
+int distr_manager_step(distr_manager_t *m, int timeout_ms) {
+    struct epoll_event evs[MGR_EVENTS];
+    int n;
+    int k;
+
+    if (m == NULL) {
+        return -1;
+    }
+    if (m->state == MGR_DONE) {
+        return 0;
+    }
+    if (m->state == MGR_JOINING && m->connected == m->cfg.required_workers && m->uploads_pending == 0) {
+        mgr_begin(m);
+        return (m->state == MGR_DONE) ? 0 : 1;
+    }
+    n = epoll_wait(m->epfd, evs, MGR_EVENTS, timeout_ms);
+    if (n < 0) {
+        if (errno == EINTR) {
+            return 1;
+        }
+        perror("epoll_wait");
+        mgr_finish(m, 3);
+        return 0;
+    }
+    for (k = 0; k < n && m->state != MGR_DONE; ++k) {
+        int tag = (int)(evs[k].data.u64 >> 32);
+        int idx = (int)(evs[k].data.u64 & 0xffffffffU);
+        if (tag == MGR_TAG_LISTEN) {
+            if (m->state == MGR_JOINING) {
+                mgr_accept(m);
+            }
+        } else if (tag == MGR_TAG_TIMER) {
+            mgr_on_timer(m);
+        } else if (tag == MGR_TAG_PENDING) {
+            if (m->state == MGR_JOINING) {
+                mgr_on_pending(m, idx);
+            }
+        } else if (tag == MGR_TAG_CONTROL) {
+            ctl_accept(m);
+        } else if (tag == MGR_TAG_CTL_CLIENT) {
+            ctl_on_client(m, idx);
+        } else if (tag == MGR_TAG_LOCAL) {
+            mgr_on_local(m);
+        } else if (tag == MGR_TAG_ANNOUNCE) {
+            if (m->state == MGR_JOINING) {
+                mgr_announce(m);
+            }
+        } else if (m->ws[idx].alive != 0) {
+            if ((evs[k].events & EPOLLOUT) != 0U && m->ws[idx].uploading != 0 && m->ws[idx].up_blob >= 0) {
+                mgr_on_upload(m, idx);
+            } else if ((evs[k].events & EPOLLOUT) != 0U) {
+                mgr_on_writable(m, idx);
+            }
+            if ((evs[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0U && m->state != MGR_DONE) {
+                mgr_on_worker(m, idx);
+            }
+        }
     }
-    alarm(0U);
-    (void)sigaction(SIGALRM, &sa_old, NULL);
-    free(ws);
-    return 3;
+    return (m->state == MGR_DONE) ? 0 : 1;
 }
 
+int distr_manager_status(const distr_manager_t *m) {
+    if (m == NULL || m->state != MGR_DONE) {
+        return -1;
+    }
+    return m->status;
+}
+
+void distr_manager_cancel(distr_manager_t *m) {
+    if (m == NULL || m->state == MGR_DONE) {
+        return;
+    }
+    fprintf(stderr, "[manager] cancelled\n");
+    mgr_finish(m, DISTR_MANAGER_CANCELLED);
+}
+
+void distr_manager_free(distr_manager_t *m) {
+    if (m == NULL) {
+        return;
+    }
+    if (m->state != MGR_DONE) {
+        m->on_done = NULL;
+        mgr_finish(m, DISTR_MANAGER_CANCELLED);
+    }
+    mgr_release(m);
+}
+
+int run_manager(const manager_cfg_t *mcfg, const manager_ops_t *ops) {
+    distr_manager_t *m;
+    int status;
+
+    (void)signal(SIGINT, on_sigint);
+    m = distr_manager_start(mcfg, ops, NULL, NULL);
+    if (m == NULL) {
+        return 2;
+    }
+    while (distr_manager_step(m, 1000) > 0) {
+        if (g_stop != 0) {
+            fprintf(stderr, "[manager] interrupted\n");
+            distr_manager_cancel(m);
+        }
+    }
+    status = distr_manager_status(m);
+    distr_manager_free(m);
+    return (status == 0) ? 0 : 3;
+}
@@ -5,13 +5,16 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 static int set_common_sockopts(int fd) {
@@ -23,6 +26,7 @@ static int set_common_sockopts(int fd) {
     (void)setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
 #endif
     (void)setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
     return 0;
 }
 
@@ -125,7 +129,7 @@ int net_listen(const char *host, const char *port) {
     if (listen_fd < 0) {
         return -1;
     }
-    if (listen(listen_fd, 64) < 0) {
+    if (listen(listen_fd, SOMAXCONN) < 0) {
         close(listen_fd);
         return -1;
     }
@@ -133,16 +137,13 @@ int net_listen(const char *host, const char *port) {
 }
 
 int net_accept_timeout(int listen_fd, int timeout_sec) {
-    fd_set rfds;
-    struct timeval tv;
+    struct pollfd pfd;
     int rc;
 
-    FD_ZERO(&rfds);
-    FD_SET(listen_fd, &rfds);
-    tv.tv_sec = timeout_sec;
-    tv.tv_usec = 0;
-
-    rc = select(listen_fd + 1, &rfds, NULL, NULL, &tv);
+    pfd.fd = listen_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    rc = poll(&pfd, 1, timeout_sec * 1000);
     if (rc <= 0) {
         return -1;
     }
@@ -160,6 +161,19 @@ int net_accept_timeout(int listen_fd, int timeout_sec) {
     }
 }
 
+int net_accept_nowait(int listen_fd, int timeout_sec) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return -1;
+    }
+    (void)set_common_sockopts(fd);
+    if (set_io_timeout(fd, timeout_sec) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
 int net_connect_timeout(const char *host, const char *port, int timeout_sec) {
     struct addrinfo hints;
     struct addrinfo *res = NULL;
@@ -188,16 +202,14 @@ int net_connect_timeout(const char *host, const char *port, int timeout_sec) {
             break;
         }
         if (errno == EINPROGRESS) {
-            fd_set wfds;
-            struct timeval tv;
+            struct pollfd pfd;
             int sel;
             int err = 0;
             socklen_t len = (socklen_t)sizeof(err);
-            FD_ZERO(&wfds);
-            FD_SET(fd, &wfds);
-            tv.tv_sec = timeout_sec;
-            tv.tv_usec = 0;
-            sel = select(fd + 1, NULL, &wfds, NULL, &tv);
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            sel = poll(&pfd, 1, timeout_sec * 1000);
             if (sel > 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
                 (void)set_common_sockopts(fd);
                 (void)set_blocking(fd);
@@ -212,6 +224,102 @@ int net_connect_timeout(const char *host, const char *port, int timeout_sec) {
     return fd;
 }
 
+int net_announce_open(const char *host, const char *port) {
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    struct addrinfo *it = NULL;
+    int one = 1;
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        return -1;
+    }
+    for (it = res; it != NULL; it = it->ai_next) {
+        fd = socket(it->ai_family, it->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, it->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one)) == 0 &&
+            connect(fd, it->ai_addr, it->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int net_discover_open(const char *port) {
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    struct addrinfo *it = NULL;
+    int one = 1;
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    if (getaddrinfo(NULL, port, &hints, &res) != 0) {
+        return -1;
+    }
+    for (it = res; it != NULL; it = it->ai_next) {
+        fd = socket(it->ai_family, it->ai_socktype | SOCK_CLOEXEC, it->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#ifdef SO_REUSEPORT
+        (void)setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#endif
+        if (bind(fd, it->ai_addr, it->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int net_recv_datagram(int fd, void *buf, size_t cap, int timeout_ms, char *from, size_t from_sz) {
+    struct sockaddr_in sa;
+    socklen_t sa_len = (socklen_t)sizeof(sa);
+    struct pollfd pfd;
+    ssize_t n;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return -1;
+    }
+    n = recvfrom(fd, buf, cap, MSG_DONTWAIT, (struct sockaddr *)&sa, &sa_len);
+    if (n < 0) {
+        return -1;
+    }
+    if (from != NULL &&
+        (sa.sin_family != AF_INET || inet_ntop(AF_INET, &sa.sin_addr, from, (socklen_t)from_sz) == NULL)) {
+        return -1;
+    }
+    return (int)n;
+}
+
+uint16_t net_local_port(int fd) {
+    struct sockaddr_in sa;
+    socklen_t sa_len = (socklen_t)sizeof(sa);
+    if (getsockname(fd, (struct sockaddr *)&sa, &sa_len) != 0 || sa.sin_family != AF_INET) {
+        return 0U;
+    }
+    return ntohs(sa.sin_port);
+}
+
 int net_send_packet(int fd, uint8_t type, const void *payload, uint32_t payload_len, int timeout_sec) {
     uint8_t hdr[5];
     uint32_t be_len;
@@ -260,9 +368,22 @@ int net_recv_packet(int fd, uint8_t *type, void *payload, size_t payload_cap, ui
     return 0;
 }
 
+int net_recv_raw(int fd, void *buf, size_t n, int timeout_sec) {
+    if (set_io_timeout(fd, timeout_sec) < 0) {
+        return -1;
+    }
+    return recv_all(fd, (uint8_t *)buf, n);
+}
+
 uint64_t now_ms(void) {
     struct timeval tv;
     (void)gettimeofday(&tv, NULL);
     return ((uint64_t)tv.tv_sec * 1000ULL) + ((uint64_t)tv.tv_usec / 1000ULL);
 }
 
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,88 @@
+#define _DEFAULT_SOURCE
+#include "internal.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static const int k_counter_stat[TASK_PERF_COUNTERS] = {
+    TASK_STAT_CYCLES, TASK_STAT_INSTRUCTIONS, TASK_STAT_CACHE_MISSES};
+
+void task_perf_begin(task_perf_t *p) {
+    int k;
+    for (k = 0; k < TASK_PERF_COUNTERS; ++k) {
+        p->fds[k] = -1;
+    }
+#ifdef __linux__
+    {
+        static const uint64_t configs[TASK_PERF_COUNTERS] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+        for (k = 0; k < TASK_PERF_COUNTERS; ++k) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[k];
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            p->fds[k] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0UL);
+        }
+        for (k = 0; k < TASK_PERF_COUNTERS; ++k) {
+            if (p->fds[k] >= 0) {
+                (void)ioctl(p->fds[k], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+#endif
+}
+
+void task_perf_end(task_perf_t *p, uint64_t *stats) {
+    int k;
+
+    for (k = 0; k < TASK_PERF_COUNTERS; ++k) {
+        uint64_t v = 0U;
+        stats[k_counter_stat[k]] = TASK_STATS_NA;
+        if (p->fds[k] < 0) {
+            continue;
+        }
+#ifdef __linux__
+        (void)ioctl(p->fds[k], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+        if (read(p->fds[k], &v, sizeof(v)) == (ssize_t)sizeof(v)) {
+            stats[k_counter_stat[k]] = v;
+        }
+        close(p->fds[k]);
+        p->fds[k] = -1;
+    }
+}
+
+int task_perf_wait(pid_t pid, int *status, uint64_t *stats) {
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    while (wait4(pid, status, 0, &ru) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (stats == NULL) {
+        return 0;
+    }
+    stats[TASK_STAT_UTIME_US] = (uint64_t)ru.ru_utime.tv_sec * 1000000U + (uint64_t)ru.ru_utime.tv_usec;
+    stats[TASK_STAT_STIME_US] = (uint64_t)ru.ru_stime.tv_sec * 1000000U + (uint64_t)ru.ru_stime.tv_usec;
+    stats[TASK_STAT_MAXRSS_KB] = (uint64_t)ru.ru_maxrss;
+    stats[TASK_STAT_MINFLT] = (uint64_t)ru.ru_minflt;
+    stats[TASK_STAT_MAJFLT] = (uint64_t)ru.ru_majflt;
+    stats[TASK_STAT_NVCSW] = (uint64_t)ru.ru_nvcsw;
+    stats[TASK_STAT_NIVCSW] = (uint64_t)ru.ru_nivcsw;
+    return 0;
+}
@@ -0,0 +1,190 @@
+#define _POSIX_C_SOURCE 200809L
+#include "distr.h"
+#include "internal.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_SLAB_BUFS 8
+#define POOL_TCACHE_MAX 16
+#define POOL_ALIGN 16U
+#define POOL_HDR_SZ ((sizeof(pool_buf_t) + POOL_ALIGN - 1U) & ~(size_t)(POOL_ALIGN - 1U))
+
+typedef struct {
+    pool_buf_t *head;
+    int count;
+} pool_list_t;
+
+typedef struct {
+    pool_list_t free[POOL_CLASSES];
+    int registered;
+} pool_tcache_t;
+
+typedef struct {
+    atomic_ullong hits;
+    atomic_ullong misses;
+    atomic_ullong in_use;
+    atomic_ullong high_water;
+} pool_counters_t;
+
+static const size_t k_class_size[POOL_CLASSES] = {256U, 2048U, POOL_BUF_MAX};
+
+static pthread_mutex_t g_pool_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_pool_key;
+static pool_list_t g_pool_free[POOL_CLASSES];
+static pool_counters_t g_pool_counters[POOL_CLASSES];
+static _Thread_local pool_tcache_t t_cache;
+
+static void pool_flush(pool_tcache_t *tc, int cls, int keep) {
+    pool_list_t *l = &tc->free[cls];
+    (void)pthread_mutex_lock(&g_pool_mu);
+    while (l->count > keep) {
+        pool_buf_t *b = l->head;
+        l->head = b->next;
+        --l->count;
+        b->next = g_pool_free[cls].head;
+        g_pool_free[cls].head = b;
+        ++g_pool_free[cls].count;
+    }
+    (void)pthread_mutex_unlock(&g_pool_mu);
+}
+
+static void pool_thread_exit(void *arg) {
+    pool_tcache_t *tc = (pool_tcache_t *)arg;
+    int cls;
+    for (cls = 0; cls < POOL_CLASSES; ++cls) {
+        pool_flush(tc, cls, 0);
+    }
+}
+
+static void pool_key_init(void) {
+    (void)pthread_key_create(&g_pool_key, pool_thread_exit);
+}
+
+static pool_tcache_t *pool_tcache(void) {
+    pool_tcache_t *tc = &t_cache;
+    if (tc->registered == 0) {
+        (void)pthread_once(&g_pool_once, pool_key_init);
+        (void)pthread_setspecific(g_pool_key, tc);
+        tc->registered = 1;
+    }
+    return tc;
+}
+
+static int pool_refill(pool_list_t *l, int cls) {
+    size_t stride = (POOL_HDR_SZ + k_class_size[cls] + POOL_ALIGN - 1U) & ~(size_t)(POOL_ALIGN - 1U);
+    uint8_t *slab;
+    int k;
+
+    (void)pthread_mutex_lock(&g_pool_mu);
+    while (g_pool_free[cls].head != NULL && l->count < POOL_TCACHE_MAX / 2) {
+        pool_buf_t *b = g_pool_free[cls].head;
+        g_pool_free[cls].head = b->next;
+        --g_pool_free[cls].count;
+        b->next = l->head;
+        l->head = b;
+        ++l->count;
+    }
+    (void)pthread_mutex_unlock(&g_pool_mu);
+    if (l->head != NULL) {
+        return 0;
+    }
+    slab = (uint8_t *)aligned_alloc(POOL_ALIGN, stride * POOL_SLAB_BUFS);
+    if (slab == NULL) {
+        return -1;
+    }
+    for (k = 0; k < POOL_SLAB_BUFS; ++k) {
+        pool_buf_t *b = (pool_buf_t *)(void *)(slab + (size_t)k * stride);
+        b->cls = cls;
+        b->cap = k_class_size[cls];
+        b->len = 0U;
+        b->data = (uint8_t *)b + POOL_HDR_SZ;
+        b->next = l->head;
+        l->head = b;
+        ++l->count;
+    }
+    atomic_fetch_add_explicit(&g_pool_counters[cls].misses, 1U, memory_order_relaxed);
+    return 1;
+}
+
+pool_buf_t *pool_get(size_t size) {
+    pool_tcache_t *tc;
+    pool_list_t *l;
+    pool_buf_t *b;
+    unsigned long long used;
+    unsigned long long hw;
+    int cls = 0;
+    int rc = 0;
+
+    while (cls < POOL_CLASSES && k_class_size[cls] < size) {
+        ++cls;
+    }
+    if (cls == POOL_CLASSES) {
+        return NULL;
+    }
+    tc = pool_tcache();
+    l = &tc->free[cls];
+    if (l->head == NULL) {
+        rc = pool_refill(l, cls);
+        if (rc < 0) {
+            return NULL;
+        }
+    }
+    if (rc == 0) {
+        atomic_fetch_add_explicit(&g_pool_counters[cls].hits, 1U, memory_order_relaxed);
+    }
+    b = l->head;
+    l->head = b->next;
+    --l->count;
+    b->next = NULL;
+    b->len = 0U;
+    atomic_init(&b->refs, 1);
+    used = atomic_fetch_add_explicit(&g_pool_counters[cls].in_use, 1U, memory_order_relaxed) + 1U;
+    hw = atomic_load_explicit(&g_pool_counters[cls].high_water, memory_order_relaxed);
+    while (used > hw &&
+           !atomic_compare_exchange_weak_explicit(&g_pool_counters[cls].high_water, &hw, used,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    return b;
+}
+
+pool_buf_t *pool_ref(pool_buf_t *b) {
+    if (b != NULL) {
+        atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed);
+    }
+    return b;
+}
+
+void pool_put(pool_buf_t *b) {
+    pool_tcache_t *tc;
+    pool_list_t *l;
+
+    if (b == NULL || atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    atomic_fetch_sub_explicit(&g_pool_counters[b->cls].in_use, 1U, memory_order_relaxed);
+    tc = pool_tcache();
+    l = &tc->free[b->cls];
+    b->next = l->head;
+    l->head = b;
+    ++l->count;
+    if (l->count > POOL_TCACHE_MAX) {
+        pool_flush(tc, b->cls, POOL_TCACHE_MAX / 2);
+    }
+}
+
+int distr_pool_stats(distr_pool_stats_t *stats, int max_classes) {
+    int k;
+    for (k = 0; stats != NULL && k < POOL_CLASSES && k < max_classes; ++k) {
+        const pool_counters_t *c = &g_pool_counters[k];
+        stats[k].buf_size = k_class_size[k];
+        stats[k].hits = atomic_load_explicit(&c->hits, memory_order_relaxed);
+        stats[k].misses = atomic_load_explicit(&c->misses, memory_order_relaxed);
+        stats[k].in_use = atomic_load_explicit(&c->in_use, memory_order_relaxed);
+        stats[k].high_water = atomic_load_explicit(&c->high_water, memory_order_relaxed);
+    }
+    return POOL_CLASSES;
+}
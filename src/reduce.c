@@ -0,0 +1,295 @@
+#define _POSIX_C_SOURCE 200809L
+#include "distr.h"
+#include "distr_wire.h"
+#include "internal.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const distr_reduce_t *r;
+    long begin;
+    long end;
+    void *acc;
+    distr_task_local_t *task;
+    int started;
+} reduce_part_t;
+
+static size_t acc_stride(size_t acc_size) {
+    size_t align = _Alignof(max_align_t);
+    return (acc_size + align - 1U) & ~(align - 1U);
+}
+
+static void acc_init(const distr_reduce_t *r, void *acc) {
+    if (r->init != NULL) {
+        r->init(acc, r->user_ctx);
+    } else {
+        memset(acc, 0, r->acc_size);
+    }
+}
+
+static void *reduce_thread(void *arg) {
+    reduce_part_t *p = (reduce_part_t *)arg;
+    distr_task_bind(p->task);
+    p->r->map(p->begin, p->end, p->acc, p->r->user_ctx);
+    return NULL;
+}
+
+int distr_map_reduce(const distr_reduce_t *r, long items, int threads, void *acc) {
+    pthread_t *ths = NULL;
+    reduce_part_t *parts = NULL;
+    uint8_t *accs = NULL;
+    size_t stride;
+    long base;
+    long rem;
+    long cursor = 0L;
+    int rc = -1;
+    int t;
+
+    if (r == NULL || r->map == NULL || r->combine == NULL || r->acc_size == 0U || acc == NULL || items < 0L) {
+        return -1;
+    }
+    acc_init(r, acc);
+    if (items == 0L) {
+        return 0;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if ((long)threads > items) {
+        threads = (int)items;
+    }
+    stride = acc_stride(r->acc_size);
+    ths = (pthread_t *)calloc((size_t)threads, sizeof(*ths));
+    parts = (reduce_part_t *)calloc((size_t)threads, sizeof(*parts));
+    accs = (uint8_t *)calloc((size_t)threads, stride);
+    if (ths == NULL || parts == NULL || accs == NULL) {
+        goto cleanup;
+    }
+    base = items / threads;
+    rem = items % threads;
+    for (t = 0; t < threads; ++t) {
+        long span = base + ((t < rem) ? 1L : 0L);
+        parts[t].r = r;
+        parts[t].begin = cursor;
+        parts[t].end = cursor + span;
+        parts[t].acc = accs + (size_t)t * stride;
+        parts[t].task = distr_task_current();
+        acc_init(r, parts[t].acc);
+        cursor += span;
+    }
+    for (t = 1; t < threads; ++t) {
+        parts[t].started = (pthread_create(&ths[t], NULL, reduce_thread, &parts[t]) == 0) ? 1 : 0;
+        if (parts[t].started == 0) {
+            (void)reduce_thread(&parts[t]);
+        }
+    }
+    (void)reduce_thread(&parts[0]);
+    for (t = 0; t < threads; ++t) {
+        if (parts[t].started != 0) {
+            (void)pthread_join(ths[t], NULL);
+        }
+        r->combine(acc, parts[t].acc, r->user_ctx);
+    }
+    rc = (distr_task_cancelled() != 0) ? -1 : 0;
+cleanup:
+    free(ths);
+    free(parts);
+    free(accs);
+    return rc;
+}
+
+static int reduce_run(const worker_ops_t *ops,
+                      distr_task_plan_t *plan,
+                      const uint8_t *group,
+                      size_t group_len,
+                      size_t off,
+                      uint8_t *result_payload,
+                      size_t result_payload_sz,
+                      size_t *result_payload_len) {
+    size_t acc_size = plan->reduce.acc_size;
+    size_t stride = acc_stride(acc_size);
+    uint8_t *acc;
+    int rc = -1;
+
+    if (acc_size == 0U || plan->finalize == NULL) {
+        return -1;
+    }
+    acc = (uint8_t *)calloc(2U, stride);
+    if (acc == NULL) {
+        return -1;
+    }
+    acc_init(&plan->reduce, acc);
+    for (;;) {
+        const uint8_t *task;
+        size_t task_len;
+        if (plan->reduce.acc_size != acc_size || plan->finalize == NULL ||
+            distr_map_reduce(&plan->reduce, plan->items, plan->threads, acc + stride) != 0) {
+            goto cleanup;
+        }
+        plan->reduce.combine(acc, acc + stride, plan->reduce.user_ctx);
+        if (group == NULL || (task = distr_wire_group_next(group, group_len, &off, &task_len)) == NULL) {
+            break;
+        }
+        memset(plan, 0, sizeof(*plan));
+        if (ops->plan_task(task, task_len, plan, ops->user_ctx) != 0) {
+            goto cleanup;
+        }
+    }
+    rc = plan->finalize(acc, result_payload, result_payload_sz, result_payload_len, plan->reduce.user_ctx);
+cleanup:
+    free(acc);
+    return rc;
+}
+
+int task_execute(const worker_ops_t *ops,
+                 const uint8_t *payload,
+                 size_t payload_len,
+                 uint8_t *result_payload,
+                 size_t result_payload_sz,
+                 size_t *result_payload_len,
+                 uint8_t *error_payload,
+                 size_t error_payload_sz,
+                 size_t *error_payload_len) {
+    distr_task_plan_t plan;
+    const uint8_t *task = payload;
+    size_t task_len = payload_len;
+    size_t off = 0U;
+    int group = (payload_len >= DISTR_WIRE_HDR_SZ && distr_wire_tag(payload) == DISTR_WIRE_GROUP) ? 1 : 0;
+    int rc;
+
+    if (ops->plan_task == NULL && group == 0) {
+        return ops->execute_task(payload, payload_len, result_payload, result_payload_sz, result_payload_len,
+                                 error_payload, error_payload_sz, error_payload_len, ops->user_ctx);
+    }
+    if (ops->plan_task == NULL || (group != 0 && distr_group_wire_check(payload, payload_len) != 0)) {
+        return -1;
+    }
+    if (group != 0) {
+        off = (size_t)(distr_group_wire_tail(payload) - payload);
+        task = distr_wire_group_next(payload, payload_len, &off, &task_len);
+        if (task == NULL) {
+            return -1;
+        }
+    }
+    memset(&plan, 0, sizeof(plan));
+    rc = ops->plan_task(task, task_len, &plan, ops->user_ctx);
+    if (rc > 0 && group == 0) {
+        return ops->execute_task(payload, payload_len, result_payload, result_payload_sz, result_payload_len,
+                                 error_payload, error_payload_sz, error_payload_len, ops->user_ctx);
+    }
+    if (rc != 0) {
+        return -1;
+    }
+    *error_payload_len = 0U;
+    return reduce_run(ops, &plan, (group != 0) ? payload : NULL, payload_len, off, result_payload,
+                      result_payload_sz, result_payload_len);
+}
+
+void distr_sum_init(distr_sum_t *s) {
+    s->sum = 0.0;
+    s->comp = 0.0;
+}
+
+void distr_sum_add(distr_sum_t *s, double x) {
+    double t = s->sum + x;
+    if (fabs(s->sum) >= fabs(x)) {
+        s->comp += (s->sum - t) + x;
+    } else {
+        s->comp += (x - t) + s->sum;
+    }
+    s->sum = t;
+}
+
+void distr_sum_merge(distr_sum_t *s, const distr_sum_t *o) {
+    distr_sum_add(s, o->sum);
+    s->comp += o->comp;
+}
+
+double distr_sum_value(const distr_sum_t *s) {
+    return s->sum + s->comp;
+}
+
+void distr_moments_init(distr_moments_t *m) {
+    m->count = 0U;
+    m->min = HUGE_VAL;
+    m->max = -HUGE_VAL;
+    m->mean = 0.0;
+    m->m2 = 0.0;
+}
+
+void distr_moments_add(distr_moments_t *m, double x) {
+    double d = x - m->mean;
+    ++m->count;
+    m->mean += d / (double)m->count;
+    m->m2 += d * (x - m->mean);
+    if (x < m->min) {
+        m->min = x;
+    }
+    if (x > m->max) {
+        m->max = x;
+    }
+}
+
+void distr_moments_merge(distr_moments_t *m, const distr_moments_t *o) {
+    double n;
+    double d;
+    if (o->count == 0U) {
+        return;
+    }
+    if (m->count == 0U) {
+        *m = *o;
+        return;
+    }
+    n = (double)m->count + (double)o->count;
+    d = o->mean - m->mean;
+    m->mean += d * (double)o->count / n;
+    m->m2 += o->m2 + d * d * (double)m->count * (double)o->count / n;
+    m->count += o->count;
+    if (o->min < m->min) {
+        m->min = o->min;
+    }
+    if (o->max > m->max) {
+        m->max = o->max;
+    }
+}
+
+double distr_moments_variance(const distr_moments_t *m) {
+    return (m->count > 1U) ? m->m2 / (double)(m->count - 1U) : 0.0;
+}
+
+int distr_hist_init(distr_hist_t *h, double lo, double hi, int bins) {
+    if (h == NULL || bins < 1 || bins > DISTR_HIST_MAX_BINS || !(hi > lo)) {
+        return -1;
+    }
+    memset(h, 0, sizeof(*h));
+    h->lo = lo;
+    h->hi = hi;
+    h->bins = (uint32_t)bins;
+    return 0;
+}
+
+void distr_hist_add(distr_hist_t *h, double x) {
+    uint32_t k;
+    if (!(x >= h->lo)) {
+        ++h->under;
+        return;
+    }
+    if (x >= h->hi) {
+        ++h->over;
+        return;
+    }
+    k = (uint32_t)((x - h->lo) / (h->hi - h->lo) * (double)h->bins);
+    ++h->count[(k < h->bins) ? k : h->bins - 1U];
+}
+
+void distr_hist_merge(distr_hist_t *h, const distr_hist_t *o) {
+    uint32_t k;
+    h->under += o->under;
+    h->over += o->over;
+    for (k = 0U; k < h->bins && k < o->bins; ++k) {
+        h->count[k] += o->count[k];
+    }
+}
@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+#include "internal.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+static const uint32_t k_sha256[64] = {
+    0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U, 0x3956c25bU, 0x59f111f1U, 0x923f82a4U, 0xab1c5ed5U,
+    0xd807aa98U, 0x12835b01U, 0x243185beU, 0x550c7dc3U, 0x72be5d74U, 0x80deb1feU, 0x9bdc06a7U, 0xc19bf174U,
+    0xe49b69c1U, 0xefbe4786U, 0x0fc19dc6U, 0x240ca1ccU, 0x2de92c6fU, 0x4a7484aaU, 0x5cb0a9dcU, 0x76f988daU,
+    0x983e5152U, 0xa831c66dU, 0xb00327c8U, 0xbf597fc7U, 0xc6e00bf3U, 0xd5a79147U, 0x06ca6351U, 0x14292967U,
+    0x27b70a85U, 0x2e1b2138U, 0x4d2c6dfcU, 0x53380d13U, 0x650a7354U, 0x766a0abbU, 0x81c2c92eU, 0x92722c85U,
+    0xa2bfe8a1U, 0xa81a664bU, 0xc24b8b70U, 0xc76c51a3U, 0xd192e819U, 0xd6990624U, 0xf40e3585U, 0x106aa070U,
+    0x19a4c116U, 0x1e376c08U, 0x2748774cU, 0x34b0bcb5U, 0x391c0cb3U, 0x4ed8aa4aU, 0x5b9cca4fU, 0x682e6ff3U,
+    0x748f82eeU, 0x78a5636fU, 0x84c87814U, 0x8cc70208U, 0x90befffaU, 0xa4506cebU, 0xbef9a3f7U, 0xc67178f2U};
+
+static uint32_t rotr32(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(sha256_ctx_t *c, const uint8_t *p) {
+    uint32_t w[64];
+    uint32_t s[8];
+    int k;
+    for (k = 0; k < 16; ++k) {
+        w[k] = ((uint32_t)p[4 * k] << 24) | ((uint32_t)p[4 * k + 1] << 16) | ((uint32_t)p[4 * k + 2] << 8) |
+               (uint32_t)p[4 * k + 3];
+    }
+    for (k = 16; k < 64; ++k) {
+        uint32_t s0 = rotr32(w[k - 15], 7) ^ rotr32(w[k - 15], 18) ^ (w[k - 15] >> 3);
+        uint32_t s1 = rotr32(w[k - 2], 17) ^ rotr32(w[k - 2], 19) ^ (w[k - 2] >> 10);
+        w[k] = w[k - 16] + s0 + w[k - 7] + s1;
+    }
+    memcpy(s, c->h, sizeof(s));
+    for (k = 0; k < 64; ++k) {
+        uint32_t t1 = s[7] + (rotr32(s[4], 6) ^ rotr32(s[4], 11) ^ rotr32(s[4], 25)) +
+                      ((s[4] & s[5]) ^ (~s[4] & s[6])) + k_sha256[k] + w[k];
+        uint32_t t2 = (rotr32(s[0], 2) ^ rotr32(s[0], 13) ^ rotr32(s[0], 22)) +
+                      ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        s[7] = s[6];
+        s[6] = s[5];
+        s[5] = s[4];
+        s[4] = s[3] + t1;
+        s[3] = s[2];
+        s[2] = s[1];
+        s[1] = s[0];
+        s[0] = t1 + t2;
+    }
+    for (k = 0; k < 8; ++k) {
+        c->h[k] += s[k];
+    }
+}
+
+void sha256_init(sha256_ctx_t *c) {
+    static const uint32_t h0[8] = {0x6a09e667U, 0xbb67ae85U, 0x3c6ef372U, 0xa54ff53aU,
+                                   0x510e527fU, 0x9b05688cU, 0x1f83d9abU, 0x5be0cd19U};
+    memcpy(c->h, h0, sizeof(h0));
+    c->len = 0U;
+    c->buf_len = 0U;
+}
+
+void sha256_update(sha256_ctx_t *c, const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *)data;
+    c->len += (uint64_t)n;
+    if (c->buf_len > 0U) {
+        size_t take = sizeof(c->buf) - c->buf_len;
+        if (take > n) {
+            take = n;
+        }
+        memcpy(c->buf + c->buf_len, p, take);
+        c->buf_len += take;
+        p += take;
+        n -= take;
+        if (c->buf_len < sizeof(c->buf)) {
+            return;
+        }
+        sha256_block(c, c->buf);
+        c->buf_len = 0U;
+    }
+    while (n >= sizeof(c->buf)) {
+        sha256_block(c, p);
+        p += sizeof(c->buf);
+        n -= sizeof(c->buf);
+    }
+    memcpy(c->buf, p, n);
+    c->buf_len = n;
+}
+
+void sha256_final(sha256_ctx_t *c, uint8_t out[SHA256_LEN]) {
+    uint64_t bits = c->len * 8U;
+    int k;
+    c->buf[c->buf_len++] = 0x80U;
+    if (c->buf_len > 56U) {
+        memset(c->buf + c->buf_len, 0, sizeof(c->buf) - c->buf_len);
+        sha256_block(c, c->buf);
+        c->buf_len = 0U;
+    }
+    memset(c->buf + c->buf_len, 0, 56U - c->buf_len);
+    trace_put_u64(c->buf + 56, bits);
+    sha256_block(c, c->buf);
+    for (k = 0; k < 8; ++k) {
+        out[4 * k] = (uint8_t)(c->h[k] >> 24);
+        out[4 * k + 1] = (uint8_t)(c->h[k] >> 16);
+        out[4 * k + 2] = (uint8_t)(c->h[k] >> 8);
+        out[4 * k + 3] = (uint8_t)c->h[k];
+    }
+}
+
+int sha256_fd(int fd, uint8_t out[SHA256_LEN]) {
+    sha256_ctx_t c;
+    uint8_t buf[65536];
+    off_t off = 0;
+    sha256_init(&c);
+    for (;;) {
+        ssize_t r = pread(fd, buf, sizeof(buf), off);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+        sha256_update(&c, buf, (size_t)r);
+        off += (off_t)r;
+    }
+    sha256_final(&c, out);
+    return 0;
+}
@@ -0,0 +1,173 @@
+#define _POSIX_C_SOURCE 200809L
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void trace_put_u64(uint8_t *out, uint64_t v) {
+    int k;
+    for (k = 7; k >= 0; --k) {
+        out[k] = (uint8_t)(v & 0xffU);
+        v >>= 8;
+    }
+}
+
+uint64_t trace_get_u64(const uint8_t *in) {
+    uint64_t v = 0U;
+    int k;
+    for (k = 0; k < 8; ++k) {
+        v = (v << 8) | in[k];
+    }
+    return v;
+}
+
+int trace_log_init(trace_log_t *log, const char *path, int workers) {
+    if (log == NULL || path == NULL || workers < 1) {
+        return -1;
+    }
+    memset(log, 0, sizeof(*log));
+    log->path = path;
+    log->workers = workers;
+    log->origin_ns = now_ns();
+    return 0;
+}
+
+void trace_log_free(trace_log_t *log) {
+    if (log == NULL) {
+        return;
+    }
+    free(log->spans);
+    log->spans = NULL;
+    log->len = 0U;
+    log->cap = 0U;
+}
+
+long trace_log_add(trace_log_t *log, int worker) {
+    trace_span_t *span;
+    if (log->len == log->cap) {
+        size_t cap = (log->cap == 0U) ? 256U : log->cap * 2U;
+        trace_span_t *grown = (trace_span_t *)realloc(log->spans, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        log->spans = grown;
+        log->cap = cap;
+    }
+    span = &log->spans[log->len];
+    memset(span, 0, sizeof(*span));
+    span->trace_id = (uint64_t)log->len + 1U;
+    span->worker = worker;
+    return (long)log->len++;
+}
+
+static int span_complete(const trace_span_t *s) {
+    return s->recv_ns != 0U && s->w_recv_ns != 0U && s->w_send_ns != 0U;
+}
+
+static double rel_us(const trace_log_t *log, int64_t t_ns) {
+    return (double)(t_ns - (int64_t)log->origin_ns) / 1000.0;
+}
+
+static void emit_span(FILE *f, int *first, const trace_log_t *log, const char *name, int pid, int tid,
+                      int64_t begin_ns, int64_t end_ns, uint64_t trace_id) {
+    double dur = (double)(end_ns - begin_ns) / 1000.0;
+    fprintf(f,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"trace_id\":%llu}}",
+            (*first != 0) ? "" : ",",
+            name,
+            pid,
+            tid,
+            rel_us(log, begin_ns),
+            (dur > 0.0) ? dur : 0.0,
+            (unsigned long long)trace_id);
+    *first = 0;
+}
+
+int trace_log_write(const trace_log_t *log) {
+    int64_t *offset = NULL;
+    int64_t *best_rtt = NULL;
+    FILE *f;
+    size_t i;
+    int first = 1;
+    int w;
+
+    if (log == NULL || log->path == NULL) {
+        return -1;
+    }
+    offset = (int64_t *)calloc((size_t)log->workers, sizeof(*offset));
+    best_rtt = (int64_t *)calloc((size_t)log->workers, sizeof(*best_rtt));
+    if (offset == NULL || best_rtt == NULL) {
+        free(offset);
+        free(best_rtt);
+        return -1;
+    }
+    for (w = 0; w < log->workers; ++w) {
+        best_rtt[w] = -1;
+    }
+    for (i = 0U; i < log->len; ++i) {
+        const trace_span_t *s = &log->spans[i];
+        int64_t rtt;
+        if (!span_complete(s)) {
+            continue;
+        }
+        rtt = ((int64_t)s->recv_ns - (int64_t)s->send_end_ns) - ((int64_t)s->w_send_ns - (int64_t)s->w_recv_ns);
+        if (best_rtt[s->worker] < 0 || rtt < best_rtt[s->worker]) {
+            best_rtt[s->worker] = (rtt > 0) ? rtt : 0;
+            offset[s->worker] = (((int64_t)s->w_recv_ns - (int64_t)s->send_end_ns) +
+                                 ((int64_t)s->w_send_ns - (int64_t)s->recv_ns)) / 2;
+        }
+    }
+
+    f = fopen(log->path, "w");
+    if (f == NULL) {
+        free(offset);
+        free(best_rtt);
+        return -1;
+    }
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    fprintf(f, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"manager\"}}");
+    first = 0;
+    for (w = 0; w < log->workers; ++w) {
+        fprintf(f,
+                ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"args\":{\"name\":\"worker#%d\",\"clock_offset_us\":%.3f,\"min_rtt_us\":%.3f}}",
+                w + 1,
+                w + 1,
+                (double)offset[w] / 1000.0,
+                (double)best_rtt[w] / 1000.0);
+    }
+    for (i = 0U; i < log->len; ++i) {
+        const trace_span_t *s = &log->spans[i];
+        int pid = s->worker + 1;
+        int64_t off = offset[s->worker];
+        emit_span(f, &first, log, "build", 0, 0, (int64_t)s->build_begin_ns, (int64_t)s->build_end_ns, s->trace_id);
+        emit_span(f, &first, log, "send", 0, 0, (int64_t)s->build_end_ns, (int64_t)s->send_end_ns, s->trace_id);
+        if (s->reduce_end_ns != 0U) {
+            emit_span(f, &first, log, "reduce", 0, 0, (int64_t)s->reduce_begin_ns, (int64_t)s->reduce_end_ns,
+                      s->trace_id);
+        }
+        if (!span_complete(s)) {
+            continue;
+        }
+        emit_span(f, &first, log, "net.task", pid, 0, (int64_t)s->send_end_ns, (int64_t)s->w_recv_ns - off,
+                  s->trace_id);
+        if (s->w_kernel_begin_ns != 0U) {
+            emit_span(f, &first, log, "dispatch", pid, 0, (int64_t)s->w_recv_ns - off,
+                      (int64_t)s->w_fork_ns - off, s->trace_id);
+            emit_span(f, &first, log, "process.start", pid, 0, (int64_t)s->w_fork_ns - off,
+                      (int64_t)s->w_kernel_begin_ns - off, s->trace_id);
+            emit_span(f, &first, log, "compute", pid, 0, (int64_t)s->w_kernel_begin_ns - off,
+                      (int64_t)s->w_kernel_end_ns - off, s->trace_id);
+            emit_span(f, &first, log, "process.exit", pid, 0, (int64_t)s->w_kernel_end_ns - off,
+                      (int64_t)s->w_send_ns - off, s->trace_id);
+        }
+        emit_span(f, &first, log, "net.result", pid, 0, (int64_t)s->w_send_ns - off, (int64_t)s->recv_ns,
+                  s->trace_id);
+    }
+    fprintf(f, "\n]}\n");
+    free(offset);
+    free(best_rtt);
+    return (fclose(f) == 0) ? 0 : -1;
+}
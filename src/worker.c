@@ -2,48 +2,466 @@
 #include "distr.h"
 #include "internal.h"
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#define PAYLOAD_BUF_SZ 900
+#define WORKER_CANCEL_GRACE_MS 200
 
 typedef struct {
     int rc;
     uint32_t result_len;
     uint32_t error_len;
+    uint64_t kernel_begin_ns;
+    uint64_t kernel_end_ns;
+    uint64_t stats[TASK_STATS_FIELDS];
     uint8_t result_payload[PAYLOAD_BUF_SZ];
     uint8_t error_payload[PAYLOAD_BUF_SZ];
 } task_exec_reply_t;
 
-static volatile sig_atomic_t g_exec_timed_out = 0;
+enum {
+    EXEC_FRAME_PARTIAL = 1,
+    EXEC_FRAME_REPLY = 2
+};
 
-static void on_exec_alarm(int sig) {
+typedef struct {
+    uint32_t kind;
+    uint32_t len;
+} task_exec_frame_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    uint8_t hash[SHA256_LEN];
+    int pending;
+} worker_blob_t;
+
+typedef struct {
+    char name[2U * SHA256_LEN + 1U];
+    uint64_t size;
+    struct timespec mtime;
+} cache_entry_t;
+
+static int g_partial_fd = -1;
+static atomic_int g_task_cancel;
+static _Thread_local distr_task_local_t *t_task_local;
+static worker_blob_t g_blobs[DISTR_MAX_BLOBS];
+static int g_blob_count = 0;
+
+static int write_all_fd(int fd, const void *buf, size_t n) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while (n > 0U) {
+        ssize_t wr = write(fd, p, n);
+        if (wr < 0 && errno == EINTR) {
+            continue;
+        }
+        if (wr <= 0) {
+            return -1;
+        }
+        p += wr;
+        n -= (size_t)wr;
+    }
+    return 0;
+}
+
+static int read_all_fd(int fd, void *buf, size_t n) {
+    uint8_t *p = (uint8_t *)buf;
+    while (n > 0U) {
+        ssize_t rd = read(fd, p, n);
+        if (rd < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rd <= 0) {
+            return -1;
+        }
+        p += rd;
+        n -= (size_t)rd;
+    }
+    return 0;
+}
+
+static void kill_child(pid_t pid) {
+    (void)kill(pid, SIGKILL);
+    (void)task_perf_wait(pid, NULL, NULL);
+}
+
+static void on_task_cancel(int sig) {
     (void)sig;
-    g_exec_timed_out = 1;
-}
-
-static int run_task_with_timeout(const worker_ops_t *ops,
-                                 const uint8_t *payload,
-                                 size_t payload_len,
-                                 int timeout_sec,
-                                 uint8_t *result_payload,
-                                 size_t result_payload_sz,
-                                 size_t *result_payload_len,
-                                 uint8_t *error_payload,
-                                 size_t error_payload_sz,
-                                 size_t *error_payload_len,
-                                 int *timed_out) {
+    atomic_store_explicit(&g_task_cancel, 1, memory_order_relaxed);
+}
+
+static int cancel_child(pid_t pid, int fd) {
+    uint8_t drain[256];
+    uint64_t deadline_ms = now_ms() + WORKER_CANCEL_GRACE_MS;
+    (void)kill(pid, SIGUSR1);
+    for (;;) {
+        struct pollfd pfd;
+        uint64_t now = now_ms();
+        ssize_t rd;
+        if (now >= deadline_ms) {
+            break;
+        }
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, (int)(deadline_ms - now)) <= 0) {
+            continue;
+        }
+        rd = read(fd, drain, sizeof(drain));
+        if (rd == 0) {
+            (void)task_perf_wait(pid, NULL, NULL);
+            return 0;
+        }
+        if (rd < 0 && errno != EINTR) {
+            break;
+        }
+    }
+    kill_child(pid);
+    return 1;
+}
+
+void distr_task_bind(distr_task_local_t *t) {
+    t_task_local = t;
+}
+
+distr_task_local_t *distr_task_current(void) {
+    return t_task_local;
+}
+
+int distr_task_cancelled(void) {
+    const distr_task_local_t *t = t_task_local;
+    if (t == NULL) {
+        return atomic_load_explicit(&g_task_cancel, memory_order_relaxed);
+    }
+    return atomic_load_explicit(&t->cancel, memory_order_relaxed) != 0 ||
+           (t->deadline_ms != 0U && now_ms() >= t->deadline_ms);
+}
+
+int distr_blob_get(int index, const uint8_t **data, size_t *size) {
+    if (index < 0 || index >= g_blob_count || data == NULL || size == NULL) {
+        return -1;
+    }
+    *data = g_blobs[index].data;
+    *size = g_blobs[index].size;
+    return 0;
+}
+
+static void blobs_release(void) {
+    while (g_blob_count > 0) {
+        --g_blob_count;
+        if (g_blobs[g_blob_count].data != NULL) {
+            (void)munmap(g_blobs[g_blob_count].data, g_blobs[g_blob_count].size);
+        }
+        memset(&g_blobs[g_blob_count], 0, sizeof(g_blobs[g_blob_count]));
+    }
+}
+
+static void hash_hex(const uint8_t *hash, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    uint32_t k;
+    for (k = 0; k < SHA256_LEN; ++k) {
+        out[2U * k] = digits[hash[k] >> 4];
+        out[2U * k + 1U] = digits[hash[k] & 0x0fU];
+    }
+    out[2U * SHA256_LEN] = '\0';
+}
+
+static int cache_path(const char *dir, const uint8_t *hash, char *path, size_t path_sz) {
+    char hex[2U * SHA256_LEN + 1U];
+    hash_hex(hash, hex);
+    return (snprintf(path, path_sz, "%s/%s", dir, hex) < (int)path_sz) ? 0 : -1;
+}
+
+static int map_temp_file(const char *dir, size_t size, uint8_t **out, char *path, size_t path_sz) {
+    void *p;
+    int fd;
+
+    if (snprintf(path, path_sz, "%s/.distr-blob-XXXXXX", dir) >= (int)path_sz) {
+        return -1;
+    }
+    fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        goto fail;
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        goto fail;
+    }
+    close(fd);
+    *out = (uint8_t *)p;
+    return 0;
+fail:
+    close(fd);
+    (void)unlink(path);
+    return -1;
+}
+
+static int cache_lookup(const char *dir, worker_blob_t *b) {
+    char path[4096];
+    struct stat st;
+    void *p;
+    int fd;
+
+    if (cache_path(dir, b->hash, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != (uint64_t)b->size) {
+        close(fd);
+        return -1;
+    }
+    (void)futimens(fd, NULL);
+    if (b->size > 0U) {
+        p = mmap(NULL, b->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        b->data = (uint8_t *)p;
+    }
+    close(fd);
+    return 0;
+}
+
+static int blob_in_use(const char *name) {
+    char hex[2U * SHA256_LEN + 1U];
+    int k;
+    for (k = 0; k < g_blob_count; ++k) {
+        hash_hex(g_blobs[k].hash, hex);
+        if (strcmp(hex, name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int cache_entry_cmp(const void *a, const void *b) {
+    const cache_entry_t *x = (const cache_entry_t *)a;
+    const cache_entry_t *y = (const cache_entry_t *)b;
+    if (x->mtime.tv_sec != y->mtime.tv_sec) {
+        return (x->mtime.tv_sec < y->mtime.tv_sec) ? -1 : 1;
+    }
+    if (x->mtime.tv_nsec != y->mtime.tv_nsec) {
+        return (x->mtime.tv_nsec < y->mtime.tv_nsec) ? -1 : 1;
+    }
+    return 0;
+}
+
+static void cache_evict(const char *dir, uint64_t max_bytes) {
+    cache_entry_t *entries = NULL;
+    size_t len = 0U;
+    size_t cap = 0U;
+    uint64_t total = 0U;
+    struct dirent *de;
+    DIR *d = opendir(dir);
+    size_t k;
+
+    if (d == NULL) {
+        return;
+    }
+    while ((de = readdir(d)) != NULL) {
+        char path[4096];
+        struct stat st;
+        if (strlen(de->d_name) != 2U * SHA256_LEN ||
+            strspn(de->d_name, "0123456789abcdef") != 2U * SHA256_LEN ||
+            snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int)sizeof(path) ||
+            stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        total += (uint64_t)st.st_size;
+        if (blob_in_use(de->d_name)) {
+            continue;
+        }
+        if (len == cap) {
+            size_t grown_cap = (cap == 0U) ? 64U : cap * 2U;
+            cache_entry_t *grown = (cache_entry_t *)realloc(entries, grown_cap * sizeof(*grown));
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+            cap = grown_cap;
+        }
+        memcpy(entries[len].name, de->d_name, sizeof(entries[len].name));
+        entries[len].size = (uint64_t)st.st_size;
+        entries[len].mtime = st.st_mtim;
+        ++len;
+    }
+    closedir(d);
+    if (len > 0U) {
+        qsort(entries, len, sizeof(*entries), cache_entry_cmp);
+    }
+    for (k = 0U; k < len && total > max_bytes; ++k) {
+        char path[4096];
+        if (snprintf(path, sizeof(path), "%s/%s", dir, entries[k].name) < (int)sizeof(path) && unlink(path) == 0) {
+            total -= entries[k].size;
+        }
+    }
+    free(entries);
+}
+
+static int handle_offer(int fd, const worker_cfg_t *wcfg, const uint8_t *p, uint32_t len) {
+    uint8_t need[4U + 4U * DISTR_MAX_BLOBS];
+    uint32_t count;
+    uint32_t missing = 0U;
+    uint32_t k;
+
+    if (len < 4U) {
+        return -1;
+    }
+    count = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+    if (count > DISTR_MAX_BLOBS || len != 4U + count * BLOB_OFFER_ENTRY_SZ) {
+        return -1;
+    }
+    blobs_release();
+    if (wcfg->cache_dir != NULL && mkdir(wcfg->cache_dir, 0700) != 0 && errno != EEXIST) {
+        perror(wcfg->cache_dir);
+    }
+    for (k = 0; k < count; ++k) {
+        const uint8_t *e = p + 4U + k * BLOB_OFFER_ENTRY_SZ;
+        worker_blob_t *b = &g_blobs[k];
+        uint64_t size = trace_get_u64(e);
+        if (size > (uint64_t)SIZE_MAX) {
+            return -1;
+        }
+        b->size = (size_t)size;
+        memcpy(b->hash, e + 8, SHA256_LEN);
+        g_blob_count = (int)k + 1;
+        if (wcfg->cache_dir != NULL && cache_lookup(wcfg->cache_dir, b) == 0) {
+            continue;
+        }
+        b->pending = 1;
+        need[4U + 4U * missing] = (uint8_t)(k >> 24);
+        need[5U + 4U * missing] = (uint8_t)(k >> 16);
+        need[6U + 4U * missing] = (uint8_t)(k >> 8);
+        need[7U + 4U * missing] = (uint8_t)k;
+        ++missing;
+    }
+    need[0] = (uint8_t)(missing >> 24);
+    need[1] = (uint8_t)(missing >> 16);
+    need[2] = (uint8_t)(missing >> 8);
+    need[3] = (uint8_t)missing;
+    if (wcfg->cache_dir != NULL) {
+        fprintf(stderr, "[worker] inputs cached: %u/%u\n", (unsigned)(count - missing), (unsigned)count);
+    }
+    return net_send_packet(fd, NET_MSG_BLOB_NEED, need, 4U + 4U * missing, 5);
+}
+
+static int recv_blob(int fd, const worker_cfg_t *wcfg, const uint8_t *hdr, uint32_t hdr_len) {
+    const char *dir = wcfg->cache_dir;
+    char path[4096];
+    worker_blob_t *b;
+    uint32_t index;
+    uint8_t hash[SHA256_LEN];
+    sha256_ctx_t sha;
+
+    if (hdr_len != BLOB_HDR_SZ) {
+        return -1;
+    }
+    index = ((uint32_t)hdr[0] << 24) | ((uint32_t)hdr[1] << 16) | ((uint32_t)hdr[2] << 8) | (uint32_t)hdr[3];
+    if (index >= (uint32_t)g_blob_count || g_blobs[index].pending == 0 ||
+        trace_get_u64(hdr + 8) != (uint64_t)g_blobs[index].size) {
+        return -1;
+    }
+    b = &g_blobs[index];
+    b->pending = 0;
+    if (b->size == 0U) {
+        return 0;
+    }
+    if (dir == NULL) {
+        dir = getenv("TMPDIR");
+        if (dir == NULL || dir[0] == '\0') {
+            dir = "/tmp";
+        }
+    }
+    if (map_temp_file(dir, b->size, &b->data, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    if (wcfg->cache_dir == NULL) {
+        (void)unlink(path);
+        return net_recv_raw(fd, b->data, b->size, wcfg->max_time_sec);
+    }
+    if (net_recv_raw(fd, b->data, b->size, wcfg->max_time_sec) != 0) {
+        (void)unlink(path);
+        return -1;
+    }
+    sha256_init(&sha);
+    sha256_update(&sha, b->data, b->size);
+    sha256_final(&sha, hash);
+    if (memcmp(hash, b->hash, SHA256_LEN) != 0) {
+        fprintf(stderr, "[worker] input blob %u failed hash check\n", (unsigned)index);
+        (void)unlink(path);
+        return -1;
+    }
+    {
+        char final_path[4096];
+        if (cache_path(wcfg->cache_dir, b->hash, final_path, sizeof(final_path)) != 0 ||
+            rename(path, final_path) != 0) {
+            (void)unlink(path);
+            return 0;
+        }
+    }
+    cache_evict(wcfg->cache_dir, (uint64_t)wcfg->cache_max_mb << 20);
+    return 0;
+}
+
+int distr_emit_partial(const uint8_t *payload, size_t payload_len) {
+    task_exec_frame_t frame;
+    if (payload_len > PAYLOAD_BUF_SZ || (payload == NULL && payload_len > 0U)) {
+        return -1;
+    }
+    if (t_task_local != NULL) {
+        return (t_task_local->on_partial != NULL) ? t_task_local->on_partial(payload, payload_len, t_task_local->ctx)
+                                                  : -1;
+    }
+    if (g_partial_fd < 0) {
+        return -1;
+    }
+    frame.kind = EXEC_FRAME_PARTIAL;
+    frame.len = (uint32_t)payload_len;
+    if (write_all_fd(g_partial_fd, &frame, sizeof(frame)) != 0 ||
+        (payload_len > 0U && write_all_fd(g_partial_fd, payload, payload_len) != 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+int run_task_with_timeout(const worker_ops_t *ops,
+                          const uint8_t *payload,
+                          size_t payload_len,
+                          int timeout_sec,
+                          uint8_t *result_payload,
+                          size_t result_payload_sz,
+                          size_t *result_payload_len,
+                          uint8_t *error_payload,
+                          size_t error_payload_sz,
+                          size_t *error_payload_len,
+                          int *timed_out,
+                          task_exec_times_t *times,
+                          task_exec_io_t *io) {
     int pfd[2];
     pid_t pid;
-    struct sigaction sa_new;
-    struct sigaction sa_old;
     task_exec_reply_t reply;
-    ssize_t rd;
+    task_exec_frame_t frame;
+    uint8_t partial[PAYLOAD_BUF_SZ];
+    uint64_t deadline_ms;
+    int cancel_fd = (io != NULL) ? io->cancel_fd : -1;
+    int got = 0;
     int status;
 
     if (ops == NULL || payload == NULL || result_payload == NULL || result_payload_len == NULL ||
@@ -51,9 +469,17 @@ static int run_task_with_timeout(const worker_ops_t *ops,
         return -1;
     }
     *timed_out = 0;
+    if (io != NULL) {
+        io->cancelled = 0;
+        io->killed = 0;
+        io->stop_ns = 0U;
+    }
     if (pipe(pfd) < 0) {
         return -1;
     }
+    if (times != NULL) {
+        times->fork_ns = now_ns();
+    }
     pid = fork();
     if (pid < 0) {
         close(pfd[0]);
@@ -61,71 +487,116 @@ static int run_task_with_timeout(const worker_ops_t *ops,
         return -1;
     }
     if (pid == 0) {
+        struct sigaction sa;
+        task_perf_t perf;
         int rc;
         size_t out_len = 0U;
         size_t err_len = 0U;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_task_cancel;
+        sa.sa_flags = SA_RESTART;
+        (void)sigemptyset(&sa.sa_mask);
+        (void)sigaction(SIGUSR1, &sa, NULL);
         close(pfd[0]);
+        g_partial_fd = pfd[1];
         memset(&reply, 0, sizeof(reply));
-        rc = ops->execute_task(payload,
-                               payload_len,
-                               reply.result_payload,
-                               sizeof(reply.result_payload),
-                               &out_len,
-                               reply.error_payload,
-                               sizeof(reply.error_payload),
-                               &err_len,
-                               ops->user_ctx);
+        task_perf_begin(&perf);
+        reply.kernel_begin_ns = now_ns();
+        rc = task_execute(ops,
+                          payload,
+                          payload_len,
+                          reply.result_payload,
+                          sizeof(reply.result_payload),
+                          &out_len,
+                          reply.error_payload,
+                          sizeof(reply.error_payload),
+                          &err_len);
+        reply.kernel_end_ns = now_ns();
+        task_perf_end(&perf, reply.stats);
         reply.result_len = (uint32_t)out_len;
         reply.error_len = (uint32_t)err_len;
         reply.rc = rc;
-        (void)write(pfd[1], &reply, sizeof(reply));
+        frame.kind = EXEC_FRAME_REPLY;
+        frame.len = (uint32_t)sizeof(reply);
+        (void)write_all_fd(pfd[1], &frame, sizeof(frame));
+        (void)write_all_fd(pfd[1], &reply, sizeof(reply));
         close(pfd[1]);
         _exit((rc >= 0) ? 0 : 2);
     }
 
     close(pfd[1]);
-    memset(&sa_new, 0, sizeof(sa_new));
-    sa_new.sa_handler = on_exec_alarm;
-    sigemptyset(&sa_new.sa_mask);
-    sa_new.sa_flags = 0;
-    if (sigaction(SIGALRM, &sa_new, &sa_old) != 0) {
-        close(pfd[0]);
-        (void)kill(pid, SIGKILL);
-        (void)waitpid(pid, NULL, 0);
-        return -1;
-    }
-    g_exec_timed_out = 0;
-    alarm((unsigned int)timeout_sec);
+    deadline_ms = now_ms() + (uint64_t)timeout_sec * 1000U;
     for (;;) {
-        pid_t wr = waitpid(pid, &status, 0);
-        if (wr == pid) {
+        struct pollfd pfds[2];
+        uint64_t now = now_ms();
+        int prc;
+        if (now >= deadline_ms) {
+            kill_child(pid);
+            close(pfd[0]);
+            *timed_out = 1;
+            return 1;
+        }
+        pfds[0].fd = pfd[0];
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        pfds[1].fd = cancel_fd;
+        pfds[1].events = POLLIN;
+        pfds[1].revents = 0;
+        prc = poll(pfds, 2, (int)(deadline_ms - now));
+        if (prc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (prc < 0) {
             break;
         }
-        if (wr < 0 && errno == EINTR) {
-            if (g_exec_timed_out != 0) {
-                (void)kill(pid, SIGKILL);
-                (void)waitpid(pid, NULL, 0);
-                alarm(0U);
-                (void)sigaction(SIGALRM, &sa_old, NULL);
-                close(pfd[0]);
-                *timed_out = 1;
-                return 1;
+        if (prc == 0) {
+            continue;
+        }
+        if (pfds[0].revents == 0 && pfds[1].revents != 0) {
+            uint8_t hdr[5];
+            uint64_t stop_begin_ns;
+            ssize_t n = recv(cancel_fd, hdr, sizeof(hdr), MSG_PEEK | MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                continue;
+            }
+            if (n > 0 && hdr[0] != NET_MSG_CANCEL && hdr[0] != NET_MSG_SHUTDOWN && hdr[0] != NET_MSG_ABORT) {
+                cancel_fd = -1;
+                continue;
+            }
+            stop_begin_ns = now_ns();
+            io->killed = cancel_child(pid, pfd[0]);
+            io->stop_ns = now_ns() - stop_begin_ns;
+            close(pfd[0]);
+            io->cancelled = 1;
+            return 1;
+        }
+        if (pfds[0].revents == 0 || read_all_fd(pfd[0], &frame, sizeof(frame)) != 0) {
+            break;
+        }
+        if (frame.kind == EXEC_FRAME_PARTIAL && frame.len <= sizeof(partial)) {
+            if (read_all_fd(pfd[0], partial, frame.len) != 0) {
+                break;
+            }
+            if (io != NULL && io->on_partial != NULL) {
+                io->on_partial(partial, frame.len, io->ctx);
             }
             continue;
         }
-        alarm(0U);
-        (void)sigaction(SIGALRM, &sa_old, NULL);
-        close(pfd[0]);
-        return -1;
+        if (frame.kind == EXEC_FRAME_REPLY && frame.len == sizeof(reply) &&
+            read_all_fd(pfd[0], &reply, sizeof(reply)) == 0) {
+            got = 1;
+        }
+        break;
     }
-    alarm(0U);
-    (void)sigaction(SIGALRM, &sa_old, NULL);
-
-    rd = read(pfd[0], &reply, sizeof(reply));
     close(pfd[0]);
-    if (rd != (ssize_t)sizeof(reply)) {
+    if (got == 0) {
+        kill_child(pid);
         return -1;
     }
+    if (task_perf_wait(pid, &status, reply.stats) != 0) {
+        return -1;
+    }
+
     if ((size_t)reply.result_len > result_payload_sz || (size_t)reply.error_len > error_payload_sz) {
         return -1;
     }
@@ -137,28 +608,104 @@ static int run_task_with_timeout(const worker_ops_t *ops,
     }
     *result_payload_len = reply.result_len;
     *error_payload_len = reply.error_len;
+    if (times != NULL) {
+        times->kernel_begin_ns = reply.kernel_begin_ns;
+        times->kernel_end_ns = reply.kernel_end_ns;
+        memcpy(times->stats, reply.stats, sizeof(times->stats));
+    }
     return reply.rc;
 }
 
-int run_worker(const worker_cfg_t *wcfg, const worker_ops_t *ops) {
+static void forward_partial(const uint8_t *payload, size_t payload_len, void *ctx) {
+    int fd = *(const int *)ctx;
+    (void)net_send_packet(fd, NET_MSG_PARTIAL, payload, (uint32_t)payload_len, 5);
+}
+
+static int send_task_stats(int fd, const task_exec_times_t *times) {
+    uint8_t buf[TASK_STATS_SZ];
+    int k;
+    for (k = 0; k < TASK_STATS_FIELDS; ++k) {
+        trace_put_u64(buf + 8 * k, times->stats[k]);
+    }
+    return net_send_packet(fd, NET_MSG_TASK_STATS, buf, TASK_STATS_SZ, 5);
+}
+
+static int discover_manager(const worker_cfg_t *wcfg, char *host, size_t host_sz, char *port, size_t port_sz) {
+    uint8_t buf[sizeof(announce_wire_layout_t)];
+    uint64_t deadline_ms = now_ms() + (uint64_t)wcfg->max_time_sec * 1000U;
+    int fd = net_discover_open(wcfg->discover_port);
+    int rc = -1;
+
+    if (fd < 0) {
+        perror("net_discover_open");
+        return -1;
+    }
+    while (rc != 0) {
+        uint64_t now = now_ms();
+        uint32_t free_slots;
+        size_t k;
+        int n;
+        if (now >= deadline_ms) {
+            fprintf(stderr, "[worker] no manager announced on port %s\n", wcfg->discover_port);
+            break;
+        }
+        n = net_recv_datagram(fd, buf, sizeof(buf), (int)(deadline_ms - now), host, host_sz);
+        if (n < 0 || announce_wire_check(buf, (size_t)n) != 0 || distr_wire_tag(buf) != DISTR_WIRE_ANNOUNCE) {
+            continue;
+        }
+        free_slots = announce_wire_get_free_slots(buf);
+        if (free_slots == 0U || announce_wire_get_port(buf) == 0U) {
+            continue;
+        }
+        if (announce_wire_get_host(buf, 0) != 0U && host_sz > ANNOUNCE_HOST_MAX) {
+            for (k = 0; k < ANNOUNCE_HOST_MAX - 1; ++k) {
+                host[k] = (char)announce_wire_get_host(buf, k);
+            }
+            host[k] = '\0';
+        }
+        (void)snprintf(port, port_sz, "%u", (unsigned)announce_wire_get_port(buf));
+        fprintf(stderr, "[worker] discovered job %016llx at %s:%s (%u free)\n",
+                (unsigned long long)announce_wire_get_job_id(buf), host, port, (unsigned)free_slots);
+        rc = 0;
+    }
+    close(fd);
+    return rc;
+}
+
+static int worker_session(const worker_cfg_t *wcfg, const worker_ops_t *ops, pool_buf_t *in_buf, pool_buf_t *out_buf) {
     int fd = -1;
     uint8_t hello_payload[PAYLOAD_BUF_SZ];
-    uint8_t result_payload[PAYLOAD_BUF_SZ];
+    uint8_t *out_payload = out_buf->data;
+    uint8_t *result_payload = out_payload + TRACE_RESULT_HDR_SZ;
     uint8_t error_payload[PAYLOAD_BUF_SZ];
-    uint8_t in_payload[PAYLOAD_BUF_SZ];
+    uint8_t *in_payload = in_buf->data;
     uint8_t in_type = 0U;
     uint32_t in_len = 0U;
+    char found_host[ANNOUNCE_HOST_MAX + 1];
+    char found_port[8];
+    const char *host;
+    const char *port;
     size_t hello_len = 0U;
     size_t result_len = 0U;
     size_t error_len = 0U;
     int rc;
     int timed_out = 0;
+    int cancelled = 0;
 
     if (wcfg == NULL || ops == NULL || ops->build_hello == NULL || ops->execute_task == NULL ||
         wcfg->max_cores < 1 || wcfg->max_time_sec < 1) {
         return 2;
     }
-    fd = net_connect_timeout(wcfg->host, wcfg->port, 5);
+    host = wcfg->host;
+    port = wcfg->port;
+    if (wcfg->discover_port != NULL) {
+        if (discover_manager(wcfg, found_host, sizeof(found_host), found_port, sizeof(found_port)) != 0) {
+            return 2;
+        }
+        host = found_host;
+        port = found_port;
+    }
+    fd = net_connect_timeout(host, port, 5);
     if (fd < 0) {
         perror("net_connect_timeout");
         return 2;
@@ -173,67 +720,141 @@ int run_worker(const worker_cfg_t *wcfg, const worker_ops_t *ops) {
         close(fd);
         return 2;
     }
-    if (net_recv_packet(fd, &in_type, in_payload, sizeof(in_payload), &in_len, wcfg->max_time_sec) < 0) {
-        close(fd);
-        return 2;
-    }
-    if (in_type == NET_MSG_ABORT || in_type == NET_MSG_SHUTDOWN) {
-        close(fd);
-        return 3;
-    }
-    if (in_type != NET_MSG_TASK) {
-        static const uint8_t bad_task[] = "bad_task_format";
-        (void)net_send_packet(fd, NET_MSG_ERROR, bad_task, (uint32_t)(sizeof(bad_task) - 1U), 5);
-        close(fd);
-        return 2;
-    }
-    result_len = 0U;
-    error_len = 0U;
-    rc = run_task_with_timeout(ops,
-                               in_payload,
-                               (size_t)in_len,
-                               wcfg->max_time_sec,
-                               result_payload,
-                               sizeof(result_payload),
-                               &result_len,
-                               error_payload,
-                               sizeof(error_payload),
-                               &error_len,
-                               &timed_out);
-    if (rc < 0) {
-        close(fd);
-        return 2;
-    }
-    if (timed_out != 0) {
-        static const uint8_t timed_out_msg[] = "timed_out";
-        (void)net_send_packet(fd, NET_MSG_ERROR, timed_out_msg, (uint32_t)(sizeof(timed_out_msg) - 1U), 5);
-        close(fd);
-        return 3;
-    }
-    if (rc > 0) {
-        static const uint8_t task_failed[] = "task_failed";
-        if (error_len == 0U) {
-            memcpy(error_payload, task_failed, sizeof(task_failed) - 1U);
-            error_len = sizeof(task_failed) - 1U;
+    for (;;) {
+        task_exec_times_t times;
+        task_exec_io_t io;
+        const uint8_t *task_payload = in_payload;
+        size_t task_len;
+        uint64_t recv_ns;
+        int traced;
+
+        if (net_recv_packet(fd, &in_type, in_payload, TRACE_TASK_HDR_SZ + PAYLOAD_BUF_SZ, &in_len, wcfg->max_time_sec) < 0) {
+            close(fd);
+            return 2;
+        }
+        recv_ns = now_ns();
+        if (in_type == NET_MSG_SHUTDOWN) {
+            close(fd);
+            return 0;
+        }
+        if (in_type == NET_MSG_ABORT) {
+            close(fd);
+            return 3;
+        }
+        if (in_type == NET_MSG_CANCEL) {
+            if (cancelled != 0) {
+                (void)net_send_packet(fd, NET_MSG_CANCELLED, NULL, 0U, 5);
+                cancelled = 0;
+            }
+            continue;
+        }
+        if (in_type == NET_MSG_BLOB_OFFER) {
+            if (handle_offer(fd, wcfg, in_payload, in_len) != 0) {
+                fprintf(stderr, "[worker] bad input offer\n");
+                close(fd);
+                return 3;
+            }
+            continue;
+        }
+        if (in_type == NET_MSG_BLOB) {
+            if (recv_blob(fd, wcfg, in_payload, in_len) != 0) {
+                fprintf(stderr, "[worker] failed to receive input blob\n");
+                close(fd);
+                return 3;
+            }
+            continue;
+        }
+        traced = (in_type == NET_MSG_TRACE_TASK && in_len >= TRACE_TASK_HDR_SZ) ? 1 : 0;
+        if (in_type != NET_MSG_TASK && traced == 0) {
+            static const uint8_t bad_task[] = "bad_task_format";
+            (void)net_send_packet(fd, NET_MSG_ERROR, bad_task, (uint32_t)(sizeof(bad_task) - 1U), 5);
+            close(fd);
+            return 2;
+        }
+        task_len = (size_t)in_len;
+        if (traced != 0) {
+            task_payload += TRACE_TASK_HDR_SZ;
+            task_len -= TRACE_TASK_HDR_SZ;
+        }
+        result_len = 0U;
+        error_len = 0U;
+        memset(&times, 0, sizeof(times));
+        io.cancel_fd = fd;
+        io.cancelled = 0;
+        io.on_partial = forward_partial;
+        io.ctx = &fd;
+        rc = run_task_with_timeout(ops,
+                                   task_payload,
+                                   task_len,
+                                   wcfg->max_time_sec,
+                                   result_payload,
+                                   PAYLOAD_BUF_SZ,
+                                   &result_len,
+                                   error_payload,
+                                   sizeof(error_payload),
+                                   &error_len,
+                                   &timed_out,
+                                   &times,
+                                   &io);
+        if (rc < 0) {
+            close(fd);
+            return 2;
+        }
+        if (io.cancelled != 0) {
+            fprintf(stderr, "[worker] task cancelled in %.1f ms (%s)\n", (double)io.stop_ns / 1e6,
+                    (io.killed != 0) ? "killed" : "stopped");
+            cancelled = 1;
+            continue;
+        }
+        cancelled = 0;
+        if (timed_out != 0) {
+            static const uint8_t timed_out_msg[] = "timed_out";
+            (void)net_send_packet(fd, NET_MSG_ERROR, timed_out_msg, (uint32_t)(sizeof(timed_out_msg) - 1U), 5);
+            close(fd);
+            return 3;
+        }
+        if (rc > 0) {
+            static const uint8_t task_failed[] = "task_failed";
+            if (error_len == 0U) {
+                memcpy(error_payload, task_failed, sizeof(task_failed) - 1U);
+                error_len = sizeof(task_failed) - 1U;
+            }
+            (void)net_send_packet(fd, NET_MSG_ERROR, error_payload, (uint32_t)error_len, 5);
+            close(fd);
+            return 3;
+        }
+        if (send_task_stats(fd, &times) != 0) {
+            close(fd);
+            return 2;
+        }
+        if (traced != 0) {
+            memcpy(out_payload, in_payload, TRACE_TASK_HDR_SZ);
+            trace_put_u64(out_payload + 8, recv_ns);
+            trace_put_u64(out_payload + 16, times.fork_ns);
+            trace_put_u64(out_payload + 24, times.kernel_begin_ns);
+            trace_put_u64(out_payload + 32, times.kernel_end_ns);
+            trace_put_u64(out_payload + 40, now_ns());
+            rc = net_send_packet(fd, NET_MSG_TRACE_RESULT, out_payload,
+                                 (uint32_t)(TRACE_RESULT_HDR_SZ + result_len), 5);
+        } else {
+            rc = net_send_packet(fd, NET_MSG_RESULT, result_payload, (uint32_t)result_len, 5);
+        }
+        if (rc < 0) {
+            close(fd);
+            return 2;
         }
-        (void)net_send_packet(fd, NET_MSG_ERROR, error_payload, (uint32_t)error_len, 5);
-        close(fd);
-        return 3;
-    }
-    if (net_send_packet(fd, NET_MSG_RESULT, result_payload, (uint32_t)result_len, 5) < 0) {
-        close(fd);
-        return 2;
     }
+}
 
-    if (net_recv_packet(fd, &in_type, in_payload, sizeof(in_payload), &in_len, 5) < 0) {
-        close(fd);
-        return 2;
-    }
-    if (in_type == NET_MSG_SHUTDOWN) {
-        close(fd);
-        return 0;
+int run_worker(const worker_cfg_t *wcfg, const worker_ops_t *ops) {
+    pool_buf_t *in_buf = pool_get(TRACE_TASK_HDR_SZ + PAYLOAD_BUF_SZ);
+    pool_buf_t *out_buf = pool_get(TRACE_RESULT_HDR_SZ + PAYLOAD_BUF_SZ);
+    int rc = 2;
+    if (in_buf != NULL && out_buf != NULL) {
+        rc = worker_session(wcfg, ops, in_buf, out_buf);
     }
-    close(fd);
-    return 3;
+    pool_put(in_buf);
+    pool_put(out_buf);
+    blobs_release();
+    return rc;
 }
-